@@ -4,19 +4,80 @@
 //  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
 //
 
+// The test target of CMake defines it true
+#ifndef ENABLES_TEST
+#define ENABLES_TEST false
+#endif
+
+#if ENABLES_TEST
+#undef NDEBUG   // the tests are assertions, which are kept in a release build
+#endif
+
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <chrono>
+#include <regex>
+#include <memory>
+#include <cstdio>
+#include <system_error>
+#include <thread>
+#include <functional>
+#include <stdexcept>
+#include <optional>
+#include <tuple>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
 #include "assert.h"
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
 
+#include "xml_async_parser.h"
 #include "xml_document.h"
-
-#define ENABLES_TEST false
+#include "xml_document_reference.h"
+#include "xml_document_parser.h"
+#include "xml_flat_document.h"
+#include "xml_lazy_document.h"
+#include "xml_binary_document.h"
+#include "xml_sax_parser.h"
+#include "xml_reader.h"
+#include "xml_mapped_file.h"
+#include "xml_scan_kernels.h"
+#include "xml_batch_parser.h"
+#include "xml_parallel_parser.h"
+#include "xml_policy_parser.h"
+#include "xml_query.h"
+#include "xml_path_filter.h"
+#include "xml_writer.h"
 
 #if ENABLES_TEST
 
+/**
+ * Counts the allocations of the process, to test that a reused parser allocates nothing
+ */
+namespace {
+    std::atomic<size_t> allocation_count{0};
+
+    inline void* allocate(size_t size) {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        if (auto pointer = std::malloc(size > 0 ? size : 1)) {
+            return pointer;
+        }
+        throw std::bad_alloc();
+    }
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+
 void test_xml_declaration() {
     // Empty is error
     try {
@@ -84,6 +145,55 @@ void test_xml_no_escaped_character() {
     bbxml::parse_xml(R"(<?xml version="1.0"?><value>&lt;&gt;&apos;&quot;&amp;</value>)");
 }
 
+void test_xml_character_reference() {
+    auto document = bbxml::parse_xml(R"(<?xml version="1.0"?><value key="&#x3C;&#60;">&#65;&#x41;&#x1F600;</value>)");
+    assert(document.root_node->inner_text().compare("AA\xF0\x9F\x98\x80") == 0);
+    assert(document.root_node->attributes.at("key").compare("<<") == 0);
+
+    for (auto text : {R"(<?xml version="1.0"?><value>&#x110000;</value>)", R"(<?xml version="1.0"?><value>&#0;</value>)", R"(<?xml version="1.0"?><value>&#x41</value>)"}) {
+        try {
+            bbxml::parse_xml(text);
+            assert(false);
+        }
+        catch (const bbxml::xml_error& e) {
+            assert(e.code() == bbxml::xml_error_code::no_escaped_character);
+        }
+    }
+}
+
+void test_xml_names() {
+    auto document = bbxml::parse_xml(R"(<?xml version="1.0"?><root><item c="3" a="1" b="2" a="4"/><item/></root>)");
+    auto& items = document.root_node->nodes;
+    assert(items[0]->name == items[1]->name);
+    assert(items[0]->name.data() == items[1]->name.data());
+    assert(items[0]->name == "item");
+
+    auto& attributes = items[0]->attributes;
+    assert(attributes.size() == 3);
+    assert(attributes.at("a").compare("4") == 0);
+    std::string keys;
+    for (const auto& attribute : attributes) {
+        keys += attribute.first;
+    }
+    assert(keys.compare("cab") == 0);  // In the order of the document
+    assert(attributes.at(document.names->find("b")).compare("2") == 0);
+    assert(attributes.find(bbxml::xml_name()) == attributes.end());
+    try {
+        attributes.at("d");
+        assert(false);
+    }
+    catch (const std::out_of_range&) {
+    }
+
+    // A node taken out of the document keeps the table of the names
+    auto item = items[0];
+    document = bbxml::xml_document();
+    assert(item->name == "item");
+    assert(item->attributes.begin()->first == "c" && item->attributes.at("b").compare("2") == 0);
+    auto root = bbxml::parse_xml(R"(<?xml version="1.0"?><root key="value"/>)").root_node;
+    assert(root->name == "root" && root->attributes.begin()->first == "key");
+}
+
 void test_xml_comment() {
     try {
         bbxml::parse_xml(R"(<?xml version="1.0"?><!--)");
@@ -127,14 +237,1097 @@ void test_xml_comment() {
     bbxml::parse_xml(R"(<?xml version="1.0"?><root/><!-- This is a comment -->    )");
 }
 
+void test_xml_flat_document() {
+    const std::string text = R"(<?xml version="1.0"?><root><a key="&lt;value&gt;">TEXT<![CDATA[<cdata>]]></a><b/>text<c/></root>)";
+    auto doc = bbxml::parse_xml_flat(text);
+    assert(doc.description() == bbxml::parse_xml(text).description());
+    
+    auto root = doc.root_node();
+    assert(root.name() == "root");
+    assert(root.nodes().size() == 4);
+    auto a = root.nodes().front();
+    assert(a.attributes().at("key") == "<value>");
+    assert(a.value() == "TEXT<cdata>");
+    assert(a.parent().id() == root.id());
+
+    // A text of only character references to spaces is dropped in every mode, same as parse_xml()
+    const std::string spaces = "<?xml version=\"1.0\"?><root><a>&#32;&#10;</a><b> &#x9; </b>&#32;<c>&#32;x</c></root>";
+    auto in_situ = spaces;
+    const auto expected = bbxml::parse_xml(spaces).description();
+    assert(bbxml::parse_xml_flat(spaces).description() == expected);
+    assert(bbxml::parse_xml_view(spaces).description() == expected);
+    assert(bbxml::parse_xml_in_situ(in_situ).description() == expected);
+    assert(bbxml::parse_xml_view(spaces).root_node().nodes().size() == 3);
+}
+
+void test_xml_view_document() {
+    const std::string text = R"(<?xml version="1.0"?><root><a key="&lt;value&gt;">TEXT<![CDATA[<cdata>]]></a><b>&amp;</b><c>text</c></root>)";
+    auto doc = bbxml::parse_xml_view(text);
+    assert(doc.description() == bbxml::parse_xml(text).description());
+    
+    // Refers the text unless it has to be unescaped or joined
+    auto c = doc.root_node().nodes().begin();
+    std::advance(c, 2);
+    assert((*c).value().data() == text.data() + text.find("text</c>"));
+    assert(doc.unescaped_strings.size() == 2);
+}
+
+void test_xml_in_situ() {
+    const std::string text = "<?xml version=\"1.0\"?><root><a key=\"&lt;value&gt;\" k2='v'>TEXT&amp;<!-- c --><![CDATA[<cdata>]]></a><b/>text<c>\n</c></root>";
+    auto buffer = text;
+    auto doc = bbxml::parse_xml_in_situ(buffer);
+    assert(doc.description() == bbxml::parse_xml_view(text).description());
+
+    // Unescaped and joined in the buffer, and followed by "\0"
+    auto a = doc.root_node().nodes().front();
+    assert(a.name() == "a" && a.name().data()[1] == '\0');
+    assert(a.attributes().at("key") == "<value>" && a.attributes().at("key").data()[7] == '\0');
+    assert(a.value() == "TEXT&<cdata>" && a.value().data()[12] == '\0');
+    assert(a.value().data() == buffer.data() + text.find("TEXT"));
+    auto b = doc.root_node().nodes().begin();
+    ++b;
+    assert((*b).value().empty() && *(*b).value().data() == '\0');
+    assert(doc.strings == "#text" && doc.unescaped_strings.empty());
+
+    // The errors are at the same positions, after the lines before them are rewritten
+    for (auto broken : {"<?xml version=\"1.0\"?>\n<a\nk=\"&amp;\">x&lt;\n<!-- \n -->y\n&bad;</a>", "<?xml version=\"1.0\"?>\n<a\nk=\"&amp;\" j=\"\n&bad;\"/>", "<?xml version=\"1.0\"?>\n<a>&amp;\n<b\n/></c>"}) {
+        auto position_of = [](const bbxml::xml_error& e) {
+            return std::make_tuple(e.code(), e.offset(), e.line(), e.column());
+        };
+        decltype(position_of(std::declval<bbxml::xml_error>())) expected;
+        try {
+            bbxml::parse_xml(broken);
+            assert(false);
+        }
+        catch (const bbxml::xml_error& e) {
+            expected = position_of(e);
+        }
+        std::string in_situ = broken;
+        try {
+            bbxml::parse_xml_in_situ(in_situ);
+            assert(false);
+        }
+        catch (const bbxml::xml_error& e) {
+            assert(position_of(e) == expected);
+        }
+    }
+}
+
+void test_xml_lazy_document() {
+    const std::string text = "<?xml version=\"1.0\"?><root><a k2='v' key=\"&lt;value&gt;\" key='last'>TEXT&amp;<!-- c --><![CDATA[<cdata>]]></a><b/>text<c>\n&#32;</c><d><e>1</e><e>2</e></d></root>";
+    auto doc = bbxml::parse_xml_lazy(text);
+    assert(doc.entries.size() == 12);
+    assert(doc.materialized_elements() == 0);
+
+    // Only the branch read is materialized; the top level, the root, "d" and the second "e"
+    auto d = doc.root_node().nodes()[4];
+    assert(d.name() == "d" && d.name().data() == text.data() + text.find("d><e>"));
+    assert(d.nodes().size() == 2 && d.nodes()[1].value() == "2");
+    assert(d.parent().name() == "root");
+    assert(doc.materialized_elements() == 4);
+
+    auto a = doc.root_node().nodes().front();
+    assert(a.attributes().size() == 2 && a.attributes().at("key") == "last" && a.attributes().at("k2") == "v");
+    assert(a.value() == "TEXT&<cdata>" && a.nodes().empty());
+    auto text_node = doc.root_node().nodes()[2];
+    assert(text_node.name() == "#text" && text_node.value() == "text" && text_node.value().data() == text.data() + text.find("text<c>"));
+    assert(doc.root_node().nodes()[3].nodes().empty());    // only spaces after decoding
+    assert(doc.description() == bbxml::parse_xml(text).description());
+
+    // The whole source is checked at once
+    try {
+        bbxml::parse_xml_lazy("<?xml version=\"1.0\"?><root><a k=\"&bad;\"/></root>");
+        assert(false);
+    }
+    catch (const bbxml::xml_error& e) {
+        assert(e.code() == bbxml::xml_error_code::illegal_attributes);
+    }
+}
+
+void test_xml_file() {
+    const std::string text = R"(<?xml version="1.0"?><root><a key="&lt;value&gt;">TEXT</a></root>)";
+    const char* path = "test_xml_file.xml";
+    {
+        std::ofstream ofs{path, std::ios::out | std::ios::binary};
+        ofs << text;
+    }
+    assert(bbxml::parse_xml_file(path).description() == bbxml::parse_xml(text).description());
+    {
+        auto doc = bbxml::parse_xml_view_file(path);
+        assert(doc.description() == bbxml::parse_xml(text).description());
+        assert(doc.source.data() == doc.source_file->data().data());
+    }
+    std::remove(path);
+    
+    try {
+        bbxml::parse_xml_file(path);
+        assert(false);
+    }
+    catch (const std::system_error& e) {
+        assert(e.code() == std::errc::no_such_file_or_directory);
+    }
+}
+
+/**
+ * Records the events, joining the texts split over chunks
+ */
+struct xml_sax_recorder : bbxml::xml_sax_handler {
+    std::string events;
+    
+    void start_element(std::string_view name, const bbxml::xml_sax_attributes& attributes) override {
+        events += "<" + std::string(name);
+        for (const auto& attribute : attributes) {
+            events += " " + std::string(attribute.first) + "=" + std::string(attribute.second);
+        }
+        events += ">";
+    }
+    void end_element(std::string_view name) override { events += "</" + std::string(name) + ">"; }
+    void text(std::string_view text) override { events += text; }
+    void cdata(std::string_view text) override { events += text; }
+    void comment(std::string_view text) override { events += "#" + std::string(text) + "#"; }
+};
+
+void test_xml_binary() {
+    const std::string text = R"(<?xml version="1.0" encoding="UTF-8"?><catalog><book id="bk1" lang="en"><title>A &amp; B</title><price>5.95</price></book><book id="bk2"><title>C</title><![CDATA[<d>]]></book></catalog>)";
+    const auto expected = bbxml::parse_xml(text).description();
+    const auto source_checksum = bbxml::xml_checksum(text);
+
+    // From the flat document and from the tree, to the same document; a name is in the pool once
+    const auto binary = bbxml::to_xml_binary(bbxml::parse_xml_view(text), source_checksum);
+    auto document = bbxml::load_xml_binary(binary, source_checksum);
+    assert(document.description() == expected);
+    assert(document.attributes.at("encoding") == "UTF-8");
+    assert(document.strings.empty() && document.source.data() > binary.data() && document.source.data() < binary.data() + binary.size());
+    assert(document.source.find("book") == document.source.rfind("book"));
+    assert(bbxml::load_xml_binary(bbxml::to_xml_binary(bbxml::parse_xml(text))).description() == expected);
+    auto buffer = text;
+    assert(bbxml::load_xml_binary(bbxml::to_xml_binary(bbxml::parse_xml_in_situ(buffer))).description() == expected);
+
+    const char* path = "test_xml_binary.bin";
+    bbxml::write_xml_binary_file(path, bbxml::parse_xml(text), source_checksum);
+    {
+        auto file_document = bbxml::load_xml_binary_file(path, source_checksum);
+        assert(file_document.description() == expected);
+        assert(file_document.source.data() >= file_document.source_file->data().data());
+    }
+    std::remove(path);
+    try {
+        bbxml::write_xml_binary_file("no_such_directory/test_xml_binary.bin", bbxml::parse_xml(text), source_checksum);
+        assert(false);
+    }
+    catch (const std::system_error& e) {
+        assert(e.code() == std::io_errc::stream);
+    }
+
+    // A stale, broken or foreign binary is rejected
+    auto rejection = [](const std::string& binary, uint64_t source_checksum) {
+        try {
+            bbxml::load_xml_binary(binary, source_checksum);
+            assert(false);
+        }
+        catch (const bbxml::xml_binary_error& e) {
+            return e.code();
+        }
+        return bbxml::xml_binary_error_code::not_binary;
+    };
+    assert(rejection(binary, source_checksum + 1) == bbxml::xml_binary_error_code::stale_source);
+    assert(rejection(text, 0) == bbxml::xml_binary_error_code::not_binary);
+    assert(rejection(binary.substr(0, binary.size() - 8), 0) == bbxml::xml_binary_error_code::truncated);
+    auto broken = binary;
+    broken[broken.size() - 9] ^= 1;
+    assert(rejection(broken, 0) == bbxml::xml_binary_error_code::corrupted);
+    auto old_version = binary;
+    old_version[8] += 1;
+    assert(rejection(old_version, 0) == bbxml::xml_binary_error_code::unsupported_version);
+}
+
+void test_xml_sax_parser() {
+    const std::string text = R"(<?xml version="1.0"?><root><!-- a-b --><a key="&lt;value&gt;">TEXT&amp;<![CDATA[<cdata>]]]></a><b/></root>)";
+    xml_sax_recorder whole;
+    bbxml::parse_xml_sax(text, whole);
+    assert(whole.events == "<root># a-b #<a key=<value>>TEXT&<cdata>]</a><b></b></root>");
+    
+    // Splits every tag, entity and CDATA marker
+    xml_sax_recorder pushed;
+    bbxml::xml_push_parser parser{pushed};
+    for (auto c : text) {
+        parser.feed(&c, 1);
+    }
+    parser.finish();
+    assert(pushed.events == whole.events);
+    
+    // The same tree as parse_xml(), from the events of the pieces
+    bbxml::xml_tree_handler tree;
+    bbxml::xml_push_parser tree_parser{tree};
+    for (size_t i = 0; i < text.size(); i += 7) {
+        tree_parser.feed(std::string_view(text).substr(i, 7));
+    }
+    tree_parser.finish();
+    assert(tree.take_document().description() == bbxml::parse_xml(text).description());
+    
+    try {
+        xml_sax_recorder recorder;
+        bbxml::xml_push_parser parser{recorder};
+        parser.feed("<?xml version=\"1.0\"?>\n<root><a>");
+        parser.feed("</b></root>");
+        parser.finish();
+        assert(false);
+    }
+    catch (const bbxml::xml_error& e) {
+        assert(e.code() == bbxml::xml_error_code::missing_closing_tag);
+        assert(e.line() == 2 && e.column() == 11);
+    }
+
+    // A stray "&" fails as soon as it can not be a reference, instead of being kept until the end
+    try {
+        xml_sax_recorder recorder;
+        bbxml::xml_push_parser parser{recorder};
+        parser.feed("<?xml version=\"1.0\"?><root>a &am");
+        parser.feed("p b");
+        assert(false);
+    }
+    catch (const bbxml::xml_error& e) {
+        assert(e.code() == bbxml::xml_error_code::no_escaped_character && e.column() == 30);
+    }
+}
+
+#if defined(BBXML_HAS_COROUTINES)
+void test_xml_async_parser() {
+    // Thousands of parses in flight on one thread, fed a few bytes at a time in turn
+    const size_t count = 2000;
+    std::vector<std::string> texts;
+    for (size_t i = 0; i < count; ++i) {
+        texts.push_back("<?xml version=\"1.0\"?><message id=\"" + std::to_string(i) + "\"><body>text &amp; " + std::to_string(i * i) + "</body><![CDATA[<raw>]]><empty/></message>");
+    }
+    std::vector<bbxml::xml_memory_pipe> pipes(count);
+    std::vector<bbxml::xml_task<bbxml::xml_document>> tasks;
+    for (auto& pipe : pipes) {
+        tasks.push_back(bbxml::parse_xml_async(pipe, 16));
+        tasks.back().start();
+    }
+    for (size_t offset = 0, piece = 3; offset < texts.back().size(); offset += piece) {
+        for (size_t i = 0; i < count; ++i) {
+            if (offset < texts[i].size()) {
+                pipes[i].write(std::string_view(texts[i]).substr(offset, piece));
+            }
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        assert(!tasks[i].done());
+        pipes[i].close();
+        assert(tasks[i].done());
+        assert(tasks[i].get().description() == bbxml::parse_xml(texts[i]).description());
+    }
+
+    // The error is thrown from the task
+    {
+        bbxml::xml_memory_pipe pipe;
+        auto task = bbxml::parse_xml_async(pipe);
+        task.start();
+        pipe.write("<?xml version=\"1.0\"?><root><a></b></root>");
+        pipe.close();
+        try {
+            task.get();
+            assert(false);
+        }
+        catch (const bbxml::xml_error& e) {
+            assert(e.code() == bbxml::xml_error_code::missing_closing_tag);
+        }
+    }
+
+    // A task destroyed while it waits does not leave its read in the pipe
+    {
+        bbxml::xml_memory_pipe pipe;
+        {
+            auto task = bbxml::parse_xml_async(pipe);
+            task.start();
+            pipe.write("<?xml version=\"1.0\"?><root>");
+        }
+        pipe.write("</root>");
+        pipe.close();
+    }
+
+#if !defined(_WIN32)
+    // A task destroyed while it waits in the loop, or after its read, is not resumed
+    {
+        bbxml::xml_poll_loop loop;
+        int fd[2];
+        assert(::pipe(fd) == 0);
+        bbxml::xml_fd_source source{fd[0], loop};
+        std::optional<bbxml::xml_task<bbxml::xml_document>> first{bbxml::parse_xml_async(source, 8)};
+        first->start();
+        assert(loop.waiting() == 1);
+        first.reset();
+        assert(loop.waiting() == 0);
+
+        // The first task resumed destroys the other, which has been read already
+        std::optional<bbxml::xml_task<void>> second;
+        char byte;
+        auto destroyer = [&]() -> bbxml::xml_task<void> {
+            co_await source.read_some(&byte, 1);
+            second.reset();
+        };
+        bbxml::xml_sax_handler handler;
+        auto third = destroyer();
+        second.emplace(bbxml::parse_xml_async(source, handler, 8));
+        third.start();
+        second->start();
+        assert(loop.waiting() == 2);
+        assert(::write(fd[1], "<r", 2) == 2);
+        loop.run_once(0);
+        assert(!second && third.done() && loop.waiting() == 0);
+        ::close(fd[1]);
+        ::close(fd[0]);
+    }
+
+    // From pipes of the system, waited by poll() together
+    {
+        const std::string text = texts[1];
+        bbxml::xml_poll_loop loop;
+        int fds[2][2];
+        std::vector<bbxml::xml_fd_source> sources;
+        std::vector<bbxml::xml_task<bbxml::xml_document>> fd_tasks;
+        sources.reserve(2);
+        for (auto& fd : fds) {
+            assert(::pipe(fd) == 0);
+            sources.emplace_back(fd[0], loop);
+            fd_tasks.push_back(bbxml::parse_xml_async(sources.back(), 8));
+            fd_tasks.back().start();
+        }
+        assert(loop.waiting() == 2);
+        for (size_t offset = 0; offset < text.size(); offset += 10) {
+            for (auto& fd : fds) {
+                const auto piece = std::string_view(text).substr(offset, 10);
+                assert(::write(fd[1], piece.data(), piece.size()) == static_cast<ssize_t>(piece.size()));
+            }
+            loop.run_once(0);
+        }
+        for (auto& fd : fds) {
+            ::close(fd[1]);
+        }
+        loop.run();
+        for (auto& task : fd_tasks) {
+            assert(task.done() && task.get().description() == bbxml::parse_xml(text).description());
+        }
+        for (auto& fd : fds) {
+            ::close(fd[0]);
+        }
+    }
+#endif
+}
+#endif
+
+void test_xml_reader() {
+    const std::string text = R"(<?xml version="1.0" encoding="UTF-8"?>
+<root><!-- a-b --><a key="&lt;value&gt;" k="v">TEXT&amp;<![CDATA[<cdata>]]]></a><b/></root>)";
+    xml_sax_recorder whole;
+    bbxml::parse_xml_sax(text, whole);
+
+    // Drives the recorder by the tokens, which are the same as the events
+    xml_sax_recorder pulled;
+    bbxml::xml_reader reader{text};
+    assert(reader.version() == "1.0" && reader.declaration_attributes().at(0).second == "UTF-8");
+    while (reader.next() != bbxml::xml_token::end_of_document) {
+        switch (reader.token()) {
+            case bbxml::xml_token::start_element: pulled.start_element(reader.name(), reader.attributes()); break;
+            case bbxml::xml_token::end_element: pulled.end_element(reader.name()); break;
+            case bbxml::xml_token::text: pulled.text(reader.value()); break;
+            case bbxml::xml_token::cdata: pulled.cdata(reader.value()); break;
+            case bbxml::xml_token::comment: pulled.comment(reader.value()); break;
+            default: assert(false);
+        }
+    }
+    assert(pulled.events == whole.events);
+    assert(reader.next() == bbxml::xml_token::end_of_document);
+
+    // Skips "a", and stops at "b" without reading the rest
+    bbxml::xml_reader skipping{text};
+    assert(skipping.next() == bbxml::xml_token::text);
+    assert(skipping.next() == bbxml::xml_token::start_element && skipping.name() == "root" && skipping.depth() == 1);
+    assert(skipping.next() == bbxml::xml_token::comment);
+    assert(skipping.next() == bbxml::xml_token::start_element && skipping.name() == "a" && skipping.depth() == 2);
+    skipping.skip_subtree();
+    assert(skipping.token() == bbxml::xml_token::end_element && skipping.name() == "a" && skipping.depth() == 2);
+    assert(skipping.position().offset == text.find("a><b/>"));
+    assert(skipping.next() == bbxml::xml_token::start_element && skipping.name() == "b" && skipping.is_empty_element());
+    assert(skipping.attributes().empty());
+
+    // The same errors as parse_xml(); a skipped text is not unescaped, but the tags are checked
+    const std::string broken = R"(<?xml version="1.0"?><root><a>&undefined;</a><b></c></root>)";
+    bbxml::xml_reader checking{broken};
+    checking.next();
+    checking.next();
+    checking.skip_subtree();
+    assert(checking.next() == bbxml::xml_token::start_element);
+    try {
+        checking.next();
+        assert(false);
+    }
+    catch (const bbxml::xml_error& e) {
+        assert(e.code() == bbxml::xml_error_code::missing_closing_tag);
+        assert(e.offset() == broken.find("/c>"));
+    }
+    try {
+        bbxml::xml_reader reading{broken};
+        while (reading.next() != bbxml::xml_token::end_of_document) {
+        }
+        assert(false);
+    }
+    catch (const bbxml::xml_error& e) {
+        assert(e.code() == bbxml::xml_error_code::no_escaped_character);
+    }
+}
+
+void test_xml_batch() {
+    const std::vector<std::string_view> texts = {
+        R"(<?xml version="1.0"?><a>1</a>)",
+        R"(<?xml version="1.0"?><a>&</a>)",
+        R"(<?xml version="1.0"?><b c="2"/>)",
+    };
+    bbxml::xml_thread_pool pool{2};
+    auto results = bbxml::parse_xml_batch(texts, pool);
+    auto flat_results = bbxml::parse_xml_flat_batch(texts, pool);
+    assert(results.size() == 3 && flat_results.size() == 3);
+    assert(results[0] && results[0].document.root_node->value.compare("1") == 0);
+    assert(flat_results[0] && flat_results[0].document.root_node().value() == "1");
+    assert(!results[1] && !flat_results[1]);
+    try {
+        std::rethrow_exception(results[1].error);
+    }
+    catch (const bbxml::xml_error& e) {
+        assert(e.code() == bbxml::xml_error_code::no_escaped_character);
+    }
+    assert(results[2] && results[2].document.root_node->attributes.at("c").compare("2") == 0);
+    assert(flat_results[2] && flat_results[2].document.root_node().attributes().at("c") == "2");
+}
+
+void test_xml_parallel() {
+    std::string text = "<?xml version=\"1.0\"?>\n<catalog>\n";
+    for (int i = 0; i < 100; ++i) {
+        text += "  <book id=\"" + std::to_string(i) + "\"><title>&lt;" + std::to_string(i) + "&gt;</title><!-- </book> --><![CDATA[<book>]]></book>\n";
+    }
+    text += "</catalog>\n";
+    bbxml::xml_thread_pool pool{4};
+    auto expected = bbxml::parse_xml(text);
+    for (size_t chunk_size : {16, 100, 1000}) {
+        auto document = bbxml::parse_xml_parallel(text, pool, chunk_size);
+        assert(document.description() == expected.description());
+        assert(document.root_node->nodes.size() == 100);
+        assert(document.root_node->nodes[99]->parent.lock() == document.root_node);
+    }
+
+    auto broken = text;
+    broken.insert(broken.rfind("</book>"), "<open>");
+    try {
+        bbxml::parse_xml_parallel(broken, pool, 100);
+        assert(false);
+    }
+    catch (const bbxml::xml_error& e) {
+        assert(e.code() == bbxml::xml_error_code::missing_closing_tag);
+        assert(e.line() == 102);
+    }
+}
+
+void test_xml_query() {
+    auto document = bbxml::parse_xml(R"(<?xml version="1.0"?>
+<catalog>
+    <book id="bk101"><title>A</title><price>1</price></book>
+    <book id="bk102"><title>B</title><price>2</price><book id="bk103"><price>3</price></book></book>
+    <magazine id="mg101"><price>4</price></magazine>
+</catalog>)");
+    auto values = [&](const char* expression) {
+        std::string values;
+        bbxml::xml_query(expression).for_each(document, [&](const std::shared_ptr<bbxml::xml_node>& node) {
+            values += node->value.empty() ? node->attributes.at("id") : node->value;
+        });
+        return values;
+    };
+    assert(values("/catalog/book[@id='bk101']/price") == "1");
+    assert(values("/catalog/book/price") == "12");
+    assert(values("//book/price") == "123");
+    assert(values("//book//price") == "123");
+    assert(values("/catalog/*/price") == "124");
+    assert(values("//*[@id!=\"bk102\"]") == "bk101bk103mg101");
+    assert(values("catalog/book[2]") == "bk102");
+    assert(values("//book[1]") == "bk101bk103");
+    assert(values("//book[@id][2]/title") == "B");
+    assert(values("/book") == "");
+
+    bbxml::xml_query price{"price"};
+    auto book = bbxml::xml_query("//book[@id='bk103']").select_first(document);
+    assert(price.select(book).size() == 1 && price.select_first(book)->value == "3");
+    assert(bbxml::xml_query("/catalog/magazine").select(book).size() == 1);
+
+    for (auto expression : {"", "/", "book/", "book[0]", "book[@id='x]", "book[id]", "a b"}) {
+        try {
+            bbxml::xml_query{expression};
+            assert(false);
+        }
+        catch (const std::invalid_argument&) {
+        }
+    }
+}
+
+void test_xml_path_filter() {
+    const std::string text = R"(<?xml version="1.0"?>
+<catalog>
+    <book id="bk101"><title>A</title><price>1</price></book>
+    <book id="bk102"><title>B</title><price>2</price></book>
+    <magazine id="mg101"><price>4</price></magazine>
+</catalog>)";
+    std::string values;
+    bbxml::xml_path_filter filter{"/catalog/book", "//magazine/price"};
+    filter.parse(text, [&](size_t query, const std::shared_ptr<bbxml::xml_node>& node) {
+        assert(node->parent.expired());
+        values += std::to_string(query) + (query == 0 ? node->nodes[1]->value : node->value);
+    });
+    assert(values == "0102" "14");
+
+    // The nodes are kept after the parse, with their names
+    std::vector<std::shared_ptr<bbxml::xml_node>> kept;
+    filter.parse(text, [&](size_t, const std::shared_ptr<bbxml::xml_node>& node) { kept.push_back(node); });
+    assert(kept.size() == 3 && kept[0]->name == "book" && kept[0]->attributes.begin()->first == "id");
+    assert(kept[1]->nodes[0]->name == "title" && kept[2]->name == "price");
+
+    // The rest of the document is checked
+    try {
+        filter.parse(text.substr(0, text.rfind("</magazine>")) + "</book></catalog>", [](size_t, const std::shared_ptr<bbxml::xml_node>&) {});
+        assert(false);
+    }
+    catch (const bbxml::xml_error& e) {
+        assert(e.code() == bbxml::xml_error_code::missing_closing_tag);
+    }
+}
+
+void test_xml_parse_stats() {
+    const std::string text = R"(<?xml version="1.0" encoding="UTF-8"?><root a="&lt;1&gt;" b="2"><!-- c --><x>&amp;&#x41;</x><![CDATA[<y>]]><z/></root>)";
+    bbxml::xml_parse_stats stats;
+    auto document = bbxml::parse_xml(text, stats);
+    assert(document.description() == bbxml::parse_xml(text).description());
+    assert(stats.bytes == text.size());
+    assert(stats.nodes == 5);       // root, x, its text, the CDATA text, z
+    assert(stats.attributes == 3);
+    assert(stats.entities == 4);
+    assert(stats.comments == 1);
+    assert(stats.cdata_sections == 1);
+    assert(stats.allocations >= stats.nodes);
+    assert(stats.total_time().count() > 0);
+
+    bbxml::xml_parse_stats counts;
+    counts.measures_time = false;
+    bbxml::parse_xml(text, counts);
+    assert(counts.nodes == stats.nodes && counts.allocations == stats.allocations);
+    assert(counts.total_time().count() == 0);
+
+    // Sums over documents, and keeps the counts up to an error
+    try {
+        bbxml::parse_xml(R"(<?xml version="1.0"?><root><x/><y>&undefined;</y></root>)", stats);
+        assert(false);
+    }
+    catch (const bbxml::xml_error& e) {
+        assert(e.code() == bbxml::xml_error_code::no_escaped_character);
+    }
+    assert(stats.nodes == 5 + 3);
+    assert(stats.comments == 1);
+}
+
+void test_xml_parse_limits() {
+    auto error_of = [](const std::function<void()>& parse) -> std::optional<std::pair<bbxml::xml_error_code, size_t>> {
+        try {
+            parse();
+        }
+        catch (const bbxml::xml_error& e) {
+            return std::make_pair(e.code(), e.offset());
+        }
+        return std::nullopt;
+    };
+    using bbxml::xml_error_code;
+    const std::string head = R"(<?xml version="1.0"?>)";
+
+    bbxml::xml_parse_limits limits;
+    limits.max_depth = 2;
+    assert(!error_of([&] { bbxml::parse_xml(head + "<a><b/></a>", limits); }));
+    assert(error_of([&] { bbxml::parse_xml(head + "<a><b><c/></b></a>", limits); }) == std::make_pair(xml_error_code::too_deep, head.size() + 7));
+
+    limits = bbxml::xml_parse_limits();
+    limits.max_attributes = 2;
+    assert(error_of([&] { bbxml::parse_xml(head + "<a x=\"1\" y=\"2\" z=\"3\"/>", limits); }) == std::make_pair(xml_error_code::too_many_attributes, head.size() + 15));
+
+    limits = bbxml::xml_parse_limits();
+    limits.max_name_length = 3;
+    assert(!error_of([&] { bbxml::parse_xml(head + "<abc abc=\"\"/>", limits); }));
+    assert(error_of([&] { bbxml::parse_xml(head + "<abcd/>", limits); })->first == xml_error_code::too_long_name);
+    assert(error_of([&] { bbxml::parse_xml(head + "<a abcd=\"\"/>", limits); })->first == xml_error_code::too_long_name);
+
+    // A text, a CDATA section, a comment or a value over the limit fails even if it does not end
+    limits = bbxml::xml_parse_limits();
+    limits.max_text_length = 4;
+    assert(!error_of([&] { bbxml::parse_xml(head + "<a>1234<![CDATA[1234]]><!--1234--></a>", limits); }));
+    for (auto body : {"<a>12345</a>", "<a><![CDATA[12345]]></a>", "<a><!--12345--></a>", "<a x=\"12345\"/>", "<a><!--12345"}) {
+        const auto text = head + body;
+        const auto expected = error_of([&] { bbxml::parse_xml(text, limits); });
+        assert(expected->first == xml_error_code::too_long_text);
+        bbxml::xml_sax_handler handler;
+        assert(error_of([&] { bbxml::parse_xml_sax(text, handler, limits); }) == expected);
+        assert(error_of([&] {
+            bbxml::xml_push_parser parser{handler, limits};
+            for (auto c : text) {
+                parser.feed(&c, 1);
+            }
+            parser.finish();
+        }) == expected);
+    }
+
+    // An unfinished tag or declaration is not kept over the limits, and one illegal already is dropped up to its end
+    limits = bbxml::xml_parse_limits();
+    limits.max_name_length = 64;
+    limits.max_text_length = 64;
+    const std::string spaces(1000, ' ');
+    const std::string many(100000, 'x');
+    for (const auto& text : {head + "<a x=\"1\"" + spaces, head + "<a" + many, "<?xml" + spaces, "<?xml version=\"1.0\" x=\"" + many,
+                             head + "<a x=1" + many + ">", "<?xml version=\"1.1\"" + many + "?>", head + "<a/>" + spaces + "<b/>",
+                             head + "<a x=1" + many, head + "<a/>" + spaces + "x", head + "<a/>" + spaces}) {
+        const auto expected = error_of([&] { bbxml::parse_xml(text, limits); });
+        bbxml::xml_sax_handler handler;
+        assert(error_of([&] {
+            bbxml::xml_push_parser parser{handler, limits};
+            for (size_t i = 0; i < text.size(); i += 7) {
+                parser.feed(text.data() + i, std::min<size_t>(7, text.size() - i));
+            }
+            parser.finish();
+        }) == expected);
+    }
+
+    limits = bbxml::xml_parse_limits();
+    limits.max_nodes = 3;
+    assert(!error_of([&] { bbxml::parse_xml(head + "<a><b/>c</a>", limits); }));
+    assert(error_of([&] { bbxml::parse_xml(head + "<a><b/>c<!---->", limits); }) == std::make_pair(xml_error_code::too_many_nodes, head.size() + 9));
+
+    // The depth over the chunks is checked when they are joined
+    std::string deep = head;
+    for (int i = 0; i < 40; ++i) {
+        deep += "<e" + std::to_string(i) + " x=\"1\">";
+    }
+    limits = bbxml::xml_parse_limits();
+    limits.max_depth = 32;
+    bbxml::xml_thread_pool pool{2};
+    const auto expected = error_of([&] { bbxml::parse_xml(deep, limits); });
+    assert(expected->first == xml_error_code::too_deep);
+    assert(error_of([&] { bbxml::parse_xml_parallel(deep, pool, 64, limits); }) == expected);
+    assert(!error_of([&] { bbxml::parse_xml(deep, bbxml::xml_parse_limits::unlimited()); }));     // An unclosed document is kept as it is
+}
+
+void test_xml_parse_flags() {
+    using namespace bbxml;
+    const std::string text = R"(<?xml version="1.0"?><root a="&lt;"> <x> 1 &amp; 2 </x><!-- c --><y><![CDATA[<z>]]></y> </root>)";
+    assert(parse_xml<xml_parse_default>(text).description() == parse_xml(text).description());
+
+    // Not checked nor decoded
+    const std::string illegal = R"(<?xml version="1.0"?><r&d a="&undefined;">&lt;&</r&d>)";
+    assert(parse_xml<xml_parse_trusted>(illegal).description() == "XML version=1.0\n+ r&d, a=&undefined;, &lt;&\n");
+    try {
+        parse_xml<xml_parse_trusted | xml_parse_validate_names>(illegal);
+        assert(false);
+    }
+    catch (const xml_error& e) {
+        assert(e.code() == xml_error_code::illegal_tag_name);
+    }
+    try {
+        parse_xml<xml_parse_trusted | xml_parse_decode_entities>(illegal);
+        assert(false);
+    }
+    catch (const xml_error& e) {
+        assert(e.code() == xml_error_code::illegal_attributes);
+    }
+    try {
+        parse_xml<xml_parse_trusted>(R"(<?xml version="1.0"?><a></b>)");     // The structure is checked whichever the flags are
+        assert(false);
+    }
+    catch (const xml_error& e) {
+        assert(e.code() == xml_error_code::missing_closing_tag);
+    }
+
+    auto document = parse_xml<xml_parse_default | xml_parse_trim_texts | xml_parse_keep_comments | xml_parse_keep_cdata>(text);
+    assert(document.description() == "XML version=1.0\n+ root, a=<\n + x, 1 & 2\n + #comment,  c \n + y\n  + #cdata-section, <z>\n");
+
+    document = parse_xml<xml_parse_decode_entities>(text);
+    assert(document.description() == "XML version=1.0\n+ root, a=<\n + #text,  \n + x\n  + #text,  1 & 2 \n + y\n  + #text, <z>\n + #text,  \n");
+    assert(document.root_node->nodes[1]->nodes[0]->name == "#text");
+
+    document = parse_xml<xml_parse_default | xml_parse_keep_comments>(R"(<?xml version="1.0"?><!-- c --><root/><!-- d -->)");
+    assert(document.root_node->name == "root");    // The comments around the root are not the root
+
+    // The comments and the CDATA sections kept by the flags are written back as they are
+    const std::string kept = R"(<?xml version="1.0"?><root><!-- c --><a><![CDATA[<z>]]></a></root>)";
+    document = parse_xml<xml_parse_default | xml_parse_keep_comments | xml_parse_keep_cdata>(kept);
+    assert(to_xml_string(document) == kept);
+}
+
+void test_xml_document_parser() {
+    auto message = [](size_t i) {
+        const auto id = std::to_string(1000 + i);
+        return R"(<?xml version="1.0" encoding="UTF-8"?><message id=")" + id + R"(" type="quote"><symbol>AB&amp;C</symbol>)"
+            + R"(<note>a note longer than the inline buffer of std::string, )" + id + R"(</note>)"
+            + R"(<legs><leg side="buy" venue="a venue longer than the inline buffer"/><leg side="sell"/></legs> mixed <b>text</b></message>)";
+    };
+    std::vector<std::string> messages;
+    for (size_t i = 0; i < 100; ++i) {
+        messages.push_back(message(i));
+    }
+
+    bbxml::xml_document_parser parser;
+    for (const auto& text : messages) {
+        assert(parser.parse(text).description() == bbxml::parse_xml(text).description());
+    }
+
+    // After warming up, the same shapes allocate nothing
+    const auto pooled_nodes = parser.pooled_nodes();
+    const auto allocations = allocation_count.load();
+    for (const auto& text : messages) {
+        parser.parse(text);
+    }
+    assert(allocation_count.load() == allocations);
+    assert(parser.pooled_nodes() == pooled_nodes);
+
+    // A node kept out of the parser is left as it is, with its subtree
+    auto legs = parser.parse(messages[0]).root_node->nodes[2];
+    parser.parse(messages[1]);
+    assert(legs->name == "legs" && legs->nodes.size() == 2 && legs->nodes[0]->attributes.at("side") == "buy");
+    assert(legs->parent.expired());
+    assert(parser.document().root_node->nodes[1]->value == "a note longer than the inline buffer of std::string, 1001");
+    assert(parser.parse(messages[2]).description() == bbxml::parse_xml(messages[2]).description());
+
+    // Ever new names do not grow the table forever, and a node kept out of the parser keeps the old table
+    auto kept = parser.parse(messages[0]).root_node;
+    for (size_t i = 0; i < 10000; ++i) {
+        parser.parse("<?xml version=\"1.0\"?><name" + std::to_string(i) + " key" + std::to_string(i) + "=\"1\"/>");
+    }
+    assert(parser.document().names->size() < 10000);
+    assert(kept->name == "message" && kept->attributes.at("id") == "1000");
+    assert(parser.parse(messages[4]).description() == bbxml::parse_xml(messages[4]).description());
+
+    // An error empties the document
+    try {
+        parser.parse(R"(<?xml version="1.0"?><a><b></a>)");
+        assert(false);
+    }
+    catch (const bbxml::xml_error& e) {
+        assert(e.code() == bbxml::xml_error_code::missing_closing_tag);
+    }
+    assert(parser.document().root_node == nullptr && parser.document().version.empty());
+    assert(parser.parse(messages[3]).description() == bbxml::parse_xml(messages[3]).description());
+}
+
+void test_xml_writer() {
+    const std::string text = R"(<?xml version="1.0" encoding="UTF-8"?><root><a key="&lt;&quot;&apos;&gt;">x &amp; y<![CDATA[<z>]]></a><b/>text<c><d>]]&gt;</d></c></root>)";
+    auto document = bbxml::parse_xml(text);
+    auto xml = bbxml::to_xml_string(document);
+    assert(xml == R"(<?xml version="1.0" encoding="UTF-8"?><root><a key="&lt;&quot;&apos;&gt;">x &amp; y&lt;z&gt;</a><b/>text<c><d>]]&gt;</d></c></root>)");
+    assert(bbxml::parse_xml(xml).description() == document.description());
+
+    bbxml::xml_write_options options;
+    options.declaration = false;
+    options.pretty = true;
+    auto pretty = bbxml::to_xml_string(document, options);
+    assert(pretty.find("<c>\n    <d>]]&gt;</d>\n  </c>") != std::string::npos);
+    assert(bbxml::parse_xml("<?xml version=\"1.0\"?>" + pretty).description() == document.description());
+
+    std::ostringstream oss;
+    {
+        bbxml::xml_writer writer{oss, {}, 16};
+        writer.write(document);
+        writer.write(*document.root_node->nodes[0]);
+    }
+    assert(oss.str() == xml + bbxml::to_xml_string(*document.root_node->nodes[0]));
+
+    std::string inner_text = "> ";
+    document.root_node->append_inner_text(inner_text);
+    assert(inner_text == "> x & y<z>text]]>");
+    assert(document.root_node->inner_text() == inner_text.substr(2));
+
+    bbxml::xml_name_table names;
+    bbxml::xml_node node;
+    node.name = names.intern("#comment");
+    node.value = " c ";
+    assert(bbxml::to_xml_string(node) == "<!-- c -->");
+    node.name = names.intern("#cdata-section");
+    node.value = "x]]>y";
+    xml = bbxml::to_xml_string(node);
+    assert(xml == "<![CDATA[x]]]]><![CDATA[>y]]>");
+    assert(bbxml::parse_xml("<?xml version=\"1.0\"?><a>" + xml + "</a>").root_node->value == "x]]>y");
+}
+
 #endif
 
+/**
+ * Repeats the children of the root element until the document reaches the given size
+ */
+std::string scale_xml(const std::string& text, size_t size) {
+    auto first = text.find('>', text.find('<', text.find("?>") + 2)) + 1;
+    auto last = text.rfind("</");
+    auto records = text.substr(first, last - first);
+    
+    std::string scaled = text.substr(0, first);
+    scaled.reserve(size + text.size());
+    while (scaled.size() < size) {
+        scaled += records;
+    }
+    scaled += text.substr(last);
+    return scaled;
+}
+
+double measure_throughput(bbxml::xml_document (*parse_xml)(const std::string&), const std::string& text) {
+    auto begin = std::chrono::steady_clock::now();
+    parse_xml(text);
+    auto end = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(end - begin).count();
+    return text.size() / elapsed / (1024 * 1024);
+}
+
+/**
+ * @return GB/s of `scan` repeated over the text, where nothing is found
+ */
+template <class Scan>
+double measure_scan(const std::string& text, size_t repeats, Scan scan) {
+    const char* volatile data = text.data();   // keeps the compiler from hoisting an inlined scan out of the loop
+    size_t found = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeats; ++i) {
+        const char* first = data;
+        found += scan(first, first + text.size()) - first;
+    }
+    auto end = std::chrono::steady_clock::now();
+    assert(found == text.size() * repeats);
+    double elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(end - begin).count();
+    return text.size() * repeats / elapsed / (1024 * 1024 * 1024);
+}
+
+/**
+ * Compares each scan kernel by the instruction set, and with the std::regex it replaces.
+ * The texts for std::regex are short, since std::regex recurses on every character and overflows the stack on long ones.
+ */
+void benchmark_scan_kernels() {
+    const std::string text(1024 * 1024, 'a');
+    const std::string spaces(1024 * 1024, ' ');
+    const std::string short_text(4 * 1024, 'a');
+    const std::string short_spaces(4 * 1024, ' ');
+
+    auto regex_scan = [](const char* pattern) {
+        auto re = std::make_shared<std::regex>(pattern);
+        return [re](const char* first, const char* last) {
+            std::cmatch m;
+            return std::regex_search(first, last, m, *re) ? m[0].first : last;
+        };
+    };
+    auto regex_non_space = [](const char* first, const char* last) {
+        static const std::regex re{R"(^\s*$)"};
+        return std::regex_match(first, last, re) ? last : first;
+    };
+
+    std::cout << "memchr: '<' " << measure_scan(text, 1000, [](const char* first, const char* last) { return bb::scan_char(first, last, '<'); }) << " GB/s" << std::endl;
+    const char* isa_names[] = {"scalar", "sse2", "avx2"};
+    const auto detected = bb::detected_scan_isa();
+    for (int isa = 0; isa <= static_cast<int>(detected); ++isa) {
+        bb::set_scan_isa(static_cast<bb::scan_isa>(isa));
+        std::cout << isa_names[isa] << ":"
+            << " quotes " << measure_scan(text, 1000, [](const char* first, const char* last) { return bb::scan_either(first, last, '"', '\''); }) << " GB/s,"
+            << " \"-->\" " << measure_scan(text, 1000, [](const char* first, const char* last) { return bb::scan_sequence(first, last, "-->", 3); }) << " GB/s,"
+            << " \"]]>\" " << measure_scan(text, 1000, [](const char* first, const char* last) { return bb::scan_sequence(first, last, "]]>", 3); }) << " GB/s,"
+            << " spaces " << measure_scan(spaces, 1000, bb::scan_non_space) << " GB/s" << std::endl;
+    }
+    bb::set_scan_isa(detected);
+
+    std::cout << "std::regex:"
+        << " '<' " << measure_scan(short_text, 1000, regex_scan(R"([<])")) << " GB/s,"
+        << " quotes " << measure_scan(short_text, 1000, regex_scan(R"(['"])")) << " GB/s,"
+        << " \"-->\" " << measure_scan(short_text, 1000, regex_scan(R"(-->)")) << " GB/s,"
+        << " \"]]>\" " << measure_scan(short_text, 1000, regex_scan(R"(\]\]>)")) << " GB/s,"
+        << " spaces " << measure_scan(short_spaces, 1000, regex_non_space) << " GB/s" << std::endl;
+}
+
+/**
+ * Compares reading a file into a string with mapping it, both parsed by parse_xml_view()
+ */
+void benchmark_file_loading(const std::string& text) {
+    const char* path = "scaled.xml";
+    {
+        std::ofstream ofs{path, std::ios::out | std::ios::binary};
+        ofs << text;
+    }
+    auto measure = [&](auto load_and_parse) {
+        auto begin = std::chrono::steady_clock::now();
+        [[maybe_unused]] auto nodes = load_and_parse();
+        auto end = std::chrono::steady_clock::now();
+        assert(nodes > 0);
+        return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(end - begin).count();
+    };
+    std::cout << "ifstream + ostringstream: " << measure([&] {
+        std::ifstream ifs{path, std::ios::in | std::ios::binary};
+        std::ostringstream oss;
+        oss << ifs.rdbuf();
+        auto copied = oss.str();
+        return bbxml::parse_xml_view(copied).nodes.size();
+    }) << " ms" << std::endl;
+    std::cout << "parse_xml_view_file: " << measure([&] {
+        return bbxml::parse_xml_view_file(path).nodes.size();
+    }) << " ms" << std::endl;
+    const char* binary_path = "scaled.bin";
+    bbxml::write_xml_binary_file(binary_path, bbxml::parse_xml_view(text));
+    std::cout << "load_xml_binary_file: " << measure([&] {
+        return bbxml::load_xml_binary_file(binary_path).nodes.size();
+    }) << " ms" << std::endl;
+    std::remove(path);
+    std::remove(binary_path);
+}
+
+/**
+ * Parses copies of the text as a batch of messages, by the number of the workers
+ */
+void benchmark_batch(const std::string& text) {
+    const std::vector<std::string_view> texts(10000, text);
+    for (size_t threads = 1; threads <= std::max(std::thread::hardware_concurrency(), 1u); threads *= 2) {
+        bbxml::xml_thread_pool pool{threads};
+        auto begin = std::chrono::steady_clock::now();
+        auto results = bbxml::parse_xml_flat_batch(texts, pool);
+        auto end = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(end - begin).count();
+        std::cout << "batch of " << texts.size() << " on " << threads << " workers: " << texts.size() / elapsed << " documents/s" << std::endl;
+    }
+}
+
+/**
+ * Parses the text on the workers at once, by the number of the workers
+ */
+void benchmark_parallel(const std::string& text) {
+    for (size_t threads = 1; threads <= std::max(std::thread::hardware_concurrency(), 1u); threads *= 2) {
+        bbxml::xml_thread_pool pool{threads};
+        auto begin = std::chrono::steady_clock::now();
+        auto document = bbxml::parse_xml_parallel(text, pool);
+        auto end = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(end - begin).count();
+        std::cout << "parallel on " << threads << " workers: " << text.size() / elapsed / (1024 * 1024) << " MB/s" << std::endl;
+    }
+}
+
+/**
+ * Finds the nodes of the records with compiled queries, and by the walk of the tree by hand with string compares
+ */
+void benchmark_query(const std::string& text) {
+    auto document = bbxml::parse_xml(text);
+    auto measure = [](const char* label, size_t repeats, auto find) {
+        size_t found = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < repeats; ++i) {
+            found += find();
+        }
+        auto end = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(end - begin).count();
+        std::cout << label << ": " << elapsed / repeats * 1000 << " ms, " << found / repeats << " nodes" << std::endl;
+    };
+
+    const bbxml::xml_query by_id{"/catalog/book[@id='bk101']/price"};
+    measure("query by id", 10, [&]() {
+        size_t found = 0;
+        by_id.for_each(document, [&](const std::shared_ptr<bbxml::xml_node>&) { ++found; });
+        return found;
+    });
+    measure("hand by id", 10, [&]() {
+        size_t found = 0;
+        if (document.root_node->name.str() == "catalog") {
+            for (const auto& book : document.root_node->nodes) {
+                auto id = book->attributes.find("id");
+                if (book->name.str() == "book" && id != book->attributes.end() && id->second == "bk101") {
+                    for (const auto& price : book->nodes) {
+                        found += price->name.str() == "price";
+                    }
+                }
+            }
+        }
+        return found;
+    });
+
+    const bbxml::xml_query descendants{"//book/price"};
+    measure("query descendants", 10, [&]() {
+        size_t found = 0;
+        descendants.for_each(document, [&](const std::shared_ptr<bbxml::xml_node>&) { ++found; });
+        return found;
+    });
+    measure("hand descendants", 10, [&]() {
+        size_t found = 0;
+        std::function<void(const bbxml::xml_node&)> walk = [&](const bbxml::xml_node& node) {
+            for (const auto& child : node.nodes) {
+                found += node.name.str() == "book" && child->name.str() == "price";
+                walk(*child);
+            }
+        };
+        walk(*document.root_node);
+        return found;
+    });
+}
+
+/**
+ * Pulls the records out of the text with the filter, and by parsing the whole document and querying it
+ */
+void benchmark_path_filter(const std::string& text) {
+    size_t found = 0;
+    auto begin = std::chrono::steady_clock::now();
+    bbxml::xml_path_filter{"/catalog/book"}.parse(text, [&](size_t, const std::shared_ptr<bbxml::xml_node>&) { ++found; });
+    auto end = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(end - begin).count();
+    std::cout << "path filter: " << text.size() / elapsed / (1024 * 1024) << " MB/s, " << found << " nodes" << std::endl;
+
+    begin = std::chrono::steady_clock::now();
+    found = bbxml::xml_query{"/catalog/book"}.select(bbxml::parse_xml(text)).size();
+    end = std::chrono::steady_clock::now();
+    elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(end - begin).count();
+    std::cout << "parse_xml and query: " << text.size() / elapsed / (1024 * 1024) << " MB/s, " << found << " nodes" << std::endl;
+}
+
+/**
+ * Serializes the document, and takes the description and the inner text of it
+ */
+void benchmark_writer(const std::string& text) {
+    auto document = bbxml::parse_xml(text);
+    auto measure = [&](const char* label, auto f) {
+        auto begin = std::chrono::steady_clock::now();
+        auto size = f().size();
+        auto end = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(end - begin).count();
+        std::cout << label << ": " << size / elapsed / (1024 * 1024) << " MB/s" << std::endl;
+    };
+    measure("to_xml_string", [&]() { return bbxml::to_xml_string(document); });
+    measure("description", [&]() { return document.description(); });
+    measure("inner_text", [&]() { return document.root_node->inner_text(); });
+}
+
 int main(int argc, const char * argv[]) {
 #if ENABLES_TEST
     test_xml_declaration();
     test_xml_version();
     test_xml_no_escaped_character();
+    test_xml_character_reference();
+    test_xml_names();
     test_xml_comment();
+    test_xml_flat_document();
+    test_xml_view_document();
+    test_xml_in_situ();
+    test_xml_lazy_document();
+    test_xml_sax_parser();
+#if defined(BBXML_HAS_COROUTINES)
+    test_xml_async_parser();
+#endif
+    test_xml_reader();
+    test_xml_file();
+    test_xml_binary();
+    test_xml_batch();
+    test_xml_parallel();
+    test_xml_query();
+    test_xml_path_filter();
+    test_xml_writer();
+    test_xml_document_parser();
+    test_xml_parse_stats();
+    test_xml_parse_limits();
+    test_xml_parse_flags();
 #endif
     
     try {
@@ -152,16 +1345,25 @@ int main(int argc, const char * argv[]) {
 </node>
 )");
 #else
-		std::ifstream ifs{"sample.xml", std::ios::in};
-		std::ostringstream oss;
-		oss << ifs.rdbuf();
-
 		auto begin = std::chrono::system_clock::now();
-		auto doc = bbxml::parse_xml(oss.str());
+		auto doc = bbxml::parse_xml_file("sample.xml");
 		auto end = std::chrono::system_clock::now();
 		double elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
 
 		std::cout << elapsed << " ms" << std::endl;
+        
+        // Compares the tokenizer with the std::regex reference on sample.xml scaled up to 100 MB
+        bbxml::xml_mapped_file sample{"sample.xml"};
+        auto scaled = scale_xml(std::string(sample.data()), 100 * 1024 * 1024);
+        std::cout << "tokenizer: " << measure_throughput(bbxml::parse_xml, scaled) << " MB/s" << std::endl;
+        std::cout << "reference: " << measure_throughput(bbxml::reference::parse_xml, scaled) << " MB/s" << std::endl;
+        benchmark_scan_kernels();
+        benchmark_file_loading(scaled);
+        benchmark_batch(std::string(sample.data()));
+        benchmark_parallel(scaled);
+        benchmark_query(scaled);
+        benchmark_path_filter(scaled);
+        benchmark_writer(scaled);
 #endif
 		std::cout << doc.description() << std::endl;
         std::cout << doc.root_node->inner_text() << std::endl;
@@ -0,0 +1,139 @@
+//
+//  xml_async_parser.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_async_parser.h"
+
+#if defined(BBXML_HAS_COROUTINES)
+
+#include <algorithm>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <system_error>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+using namespace bbxml;
+
+void xml_memory_pipe::write(std::string_view data) {
+    buffer_.insert(buffer_.end(), data.begin(), data.end());
+    resume_reader();
+}
+
+void xml_memory_pipe::close() {
+    is_closed_ = true;
+    resume_reader();
+}
+
+size_t xml_memory_pipe::take(char* data, size_t size) noexcept {
+    size = std::min(size, buffer_.size());
+    std::copy_n(buffer_.begin(), size, data);
+    buffer_.erase(buffer_.begin(), buffer_.begin() + size);
+    return size;
+}
+
+void xml_memory_pipe::resume_reader() {
+    if (reader_ && (!buffer_.empty() || is_closed_)) {
+        std::exchange(reader_, nullptr).resume();
+    }
+}
+
+#if !defined(_WIN32)
+
+namespace {
+    /**
+     * @return the size read, or -errno
+     */
+    long read_fd(int fd, char* data, size_t size) noexcept {
+        const auto result = ::read(fd, data, size);
+        return result >= 0 ? static_cast<long>(result) : -static_cast<long>(errno);
+    }
+
+    bool is_would_block(long result) noexcept {
+        return result == -EAGAIN || result == -EWOULDBLOCK || result == -EINTR;
+    }
+}
+
+bool xml_poll_loop::run_once(int timeout_ms) {
+    if (waits_.empty()) {
+        return false;
+    }
+    std::vector<pollfd> fds;
+    fds.reserve(waits_.size());
+    for (const auto& wait : waits_) {
+        fds.push_back({wait.fd, POLLIN, 0});
+    }
+    if (::poll(fds.data(), fds.size(), timeout_ms) < 0) {
+        if (errno == EINTR) {
+            return true;
+        }
+        throw std::system_error(errno, std::generic_category(), "Can not poll");
+    }
+
+    // The resumed tasks add their next waits to waits_, and may destroy the others in ready_
+    auto waits = std::move(waits_);
+    waits_.clear();
+    for (size_t i = 0; i < waits.size(); ++i) {
+        auto& wait = waits[i];
+        if (fds[i].revents != 0) {
+            *wait.result = read_fd(wait.fd, wait.data, wait.size);
+            if (!is_would_block(*wait.result)) {
+                ready_.push_back(wait);
+                continue;
+            }
+        }
+        waits_.push_back(wait);
+    }
+    while (!ready_.empty()) {
+        auto reader = ready_.front().reader;
+        ready_.pop_front();
+        reader.resume();
+    }
+    return !waits_.empty();
+}
+
+void xml_poll_loop::cancel(const long* result) noexcept {
+    auto is_canceled = [&](const wait& wait) { return wait.result == result; };
+    waits_.erase(std::remove_if(waits_.begin(), waits_.end(), is_canceled), waits_.end());
+    ready_.erase(std::remove_if(ready_.begin(), ready_.end(), is_canceled), ready_.end());
+}
+
+xml_fd_source::xml_fd_source(int fd, xml_poll_loop& loop) : fd_(fd), loop_(loop) {
+    const auto flags = ::fcntl(fd, F_GETFL);
+    if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        throw std::system_error(errno, std::generic_category(), "Can not make the descriptor non-blocking");
+    }
+}
+
+xml_fd_source::read_awaiter::~read_awaiter() {
+    if (is_waiting) {
+        source.loop_.cancel(&result);
+    }
+}
+
+bool xml_fd_source::read_awaiter::await_ready() {
+    result = read_fd(source.fd_, data, size);
+    return !is_would_block(result);
+}
+
+void xml_fd_source::read_awaiter::await_suspend(std::coroutine_handle<> reader) {
+    source.loop_.waits_.push_back({source.fd_, data, size, &result, reader});
+    is_waiting = true;
+}
+
+size_t xml_fd_source::read_awaiter::await_resume() {
+    is_waiting = false;
+    if (result < 0) {
+        throw std::system_error(static_cast<int>(-result), std::generic_category(), "Can not read");
+    }
+    return static_cast<size_t>(result);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,323 @@
+//
+//  xml_async_parser.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_async_parser_h
+#define xml_async_parser_h
+
+#include "xml_document.h"
+#include "xml_sax_parser.h"
+
+// C++20 coroutines; the rest of the library is C++17, and this header is empty without them
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define BBXML_HAS_COROUTINES 1
+
+#include <cassert>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace bb {
+
+    struct xml_task_promise_base {
+        /**
+         * Resumes the awaiting coroutine at the end, or returns to the one which resumed the task at the top
+         */
+        struct final_awaiter {
+            bool await_ready() noexcept { return false; }
+
+            template <class Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                auto continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        final_awaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() noexcept { error = std::current_exception(); }
+    };
+
+    template <class T>
+    struct xml_task_promise : xml_task_promise_base {
+        std::optional<T> value;
+
+        void return_value(T value) { this->value = std::move(value); }
+
+        /**
+         * Moves the value out; only once
+         */
+        T result() {
+            assert(value.has_value() && "the result of a task is taken only once");
+            T result = std::move(*value);
+            value.reset();
+            return result;
+        }
+    };
+
+    template <>
+    struct xml_task_promise<void> : xml_task_promise_base {
+        void return_void() noexcept {}
+        void result() noexcept {}
+    };
+
+}
+
+namespace bbxml {
+
+    /**
+     * A coroutine of parse_xml_async(), which runs when it is awaited or started, and owns its frame.
+     *
+     * A task started at the top runs until its source has no bytes, and returns to the caller of start();
+     * the source resumes it when bytes arrive. An exception thrown in it is kept, and rethrown by get() or co_await.
+     *
+     * A task may be destroyed while it waits; its read is withdrawn from the source, which can be written after that.
+     */
+    template <class T>
+    class xml_task {
+    public:
+        struct promise_type : bb::xml_task_promise<T> {
+            xml_task get_return_object() { return xml_task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        };
+
+        xml_task(xml_task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+        xml_task& operator=(xml_task&& other) noexcept {
+            if (this != &other) {
+                destroy();
+                handle_ = std::exchange(other.handle_, nullptr);
+            }
+            return *this;
+        }
+        ~xml_task() { destroy(); }
+
+        /**
+         * Runs a task at the top until it waits for its source, or ends
+         */
+        void start() { handle_.resume(); }
+
+        bool done() const noexcept { return handle_.done(); }
+
+        /**
+         * The result of a done task, which is moved out; call it once
+         *
+         * @throw the exception thrown in the task, xml_error usually
+         */
+        T get() {
+            assert(handle_.done());
+            if (handle_.promise().error) {
+                std::rethrow_exception(handle_.promise().error);
+            }
+            return handle_.promise().result();
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            handle_.promise().continuation = awaiting;
+            return handle_;
+        }
+
+        T await_resume() { return get(); }
+
+    private:
+        explicit xml_task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+        void destroy() {
+            if (handle_) {
+                handle_.destroy();
+            }
+        }
+
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    /**
+     * Parses a document read from an asynchronous source, pushing every read to xml_push_parser;
+     * the task suspends while the source has no bytes, and a partial document is parsed as far as it has arrived.
+     *
+     * Source:
+     *   awaitable read_some(char* data, size_t size);     // resumes with the size read, size_t; 0 at the end of the input
+     *
+     * The source and the handler must outlive the task. A task keeps only a chunk and an unfinished markup,
+     * so one thread can interleave thousands of them.
+     *
+     * @throw xml_error same as parse_xml(), from get() or co_await of the task
+     */
+    template <class Source>
+    xml_task<void> parse_xml_async(Source& source, xml_sax_handler& handler, size_t chunk_size = 4096, xml_parse_limits limits = xml_parse_limits()) {
+        xml_push_parser parser{handler, limits};
+        std::vector<char> chunk(chunk_size);
+        while (const size_t size = co_await source.read_some(chunk.data(), chunk.size())) {
+            parser.feed(chunk.data(), size);
+        }
+        parser.finish();
+    }
+
+    /**
+     * Same as parse_xml_async() with a handler, into xml_document as parse_xml()
+     */
+    template <class Source>
+    xml_task<xml_document> parse_xml_async(Source& source, size_t chunk_size = 4096, xml_parse_limits limits = xml_parse_limits()) {
+        xml_tree_handler handler;
+        co_await parse_xml_async(source, handler, chunk_size, limits);
+        co_return handler.take_document();
+    }
+
+    /**
+     * A pipe in memory, a source of parse_xml_async() for tests and for bytes received by another layer.
+     *
+     * write() resumes the task waiting for the bytes on the thread of the writer, until it waits again or ends.
+     * Not thread-safe; a pipe is written and read on one thread.
+     */
+    class xml_memory_pipe {
+    public:
+        struct read_awaiter {
+            xml_memory_pipe& pipe;
+            char* data;
+            size_t size;
+            std::coroutine_handle<> reader = nullptr;
+
+            /**
+             * Withdraws the read if the frame of the waiting task is destroyed
+             */
+            ~read_awaiter() {
+                if (reader && pipe.reader_ == reader) {
+                    pipe.reader_ = nullptr;
+                }
+            }
+
+            bool await_ready() const noexcept { return !pipe.buffer_.empty() || pipe.is_closed_; }
+            void await_suspend(std::coroutine_handle<> reader) noexcept { pipe.reader_ = this->reader = reader; }
+            size_t await_resume() noexcept { return pipe.take(data, size); }
+        };
+
+        void write(std::string_view data);
+
+        /**
+         * Ends the input; the reader reads 0 after the bytes written
+         */
+        void close();
+
+        read_awaiter read_some(char* data, size_t size) noexcept { return {*this, data, size}; }
+
+    private:
+        size_t take(char* data, size_t size) noexcept;
+        void resume_reader();
+
+        std::deque<char> buffer_;
+        bool is_closed_ = false;
+        std::coroutine_handle<> reader_;
+    };
+
+}
+
+#if !defined(_WIN32)
+
+namespace bbxml {
+
+    class xml_fd_source;
+
+    /**
+     * Waits for the file descriptors of xml_fd_source by poll(), and resumes the tasks reading them; one thread for all of them
+     */
+    class xml_poll_loop {
+    public:
+        /**
+         * Polls once, and reads the ready descriptors and resumes their tasks
+         *
+         * @param timeout_ms -1 to wait until a descriptor is ready
+         * @return whether a task is still waiting
+         */
+        bool run_once(int timeout_ms = -1);
+
+        /**
+         * Runs until no task waits
+         */
+        void run() {
+            while (run_once()) {
+            }
+        }
+
+        size_t waiting() const noexcept { return waits_.size(); }
+
+    private:
+        friend class xml_fd_source;
+
+        struct wait {
+            int fd;
+            char* data;
+            size_t size;
+            long* result;   // the size read, or -errno; identifies the wait
+            std::coroutine_handle<> reader;
+        };
+
+        /**
+         * Removes the wait of a destroyed task, which may be read already and not resumed yet
+         */
+        void cancel(const long* result) noexcept;
+
+        std::vector<wait> waits_;
+        std::deque<wait> ready_;    // read, and to be resumed in this run_once()
+    };
+
+    /**
+     * A non-blocking file descriptor as a source of parse_xml_async(); a pipe, a socket or a file.
+     * The descriptor is not owned; it is read until it reports the end.
+     *
+     * A read error is thrown as std::system_error from the task.
+     */
+    class xml_fd_source {
+    public:
+        struct read_awaiter {
+            xml_fd_source& source;
+            char* data;
+            size_t size;
+            long result = 0;
+            bool is_waiting = false;
+
+            /**
+             * Withdraws the wait if the frame of the waiting task is destroyed
+             */
+            ~read_awaiter();
+
+            /**
+             * Reads at once; waits in the loop only when the descriptor has no bytes yet
+             */
+            bool await_ready();
+            void await_suspend(std::coroutine_handle<> reader);
+            size_t await_resume();
+        };
+
+        /**
+         * Makes `fd` non-blocking
+         *
+         * @throw std::system_error if it can not be
+         */
+        xml_fd_source(int fd, xml_poll_loop& loop);
+
+        read_awaiter read_some(char* data, size_t size) noexcept { return {*this, data, size}; }
+
+    private:
+        int fd_;
+        xml_poll_loop& loop_;
+    };
+
+}
+
+#endif
+
+#endif
+
+#endif /* xml_async_parser_h */
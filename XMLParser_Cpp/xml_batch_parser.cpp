@@ -0,0 +1,38 @@
+//
+//  xml_batch_parser.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_batch_parser.h"
+
+using namespace bbxml;
+
+std::vector<xml_batch_result<xml_document>> bbxml::parse_xml_batch(const std::string_view* texts, size_t count, xml_thread_pool& pool) {
+    std::vector<xml_batch_result<xml_document>> results(count);
+    pool.run(count, [&](size_t index, size_t) {
+        try {
+            results[index].document = parse_xml(texts[index].data(), texts[index].data() + texts[index].size());
+        }
+        catch (...) {
+            results[index].error = std::current_exception();
+        }
+    });
+    return results;
+}
+
+std::vector<xml_batch_result<xml_flat_document>> bbxml::parse_xml_flat_batch(const std::string_view* texts, size_t count, xml_thread_pool& pool) {
+    std::vector<xml_batch_result<xml_flat_document>> results(count);
+    std::vector<xml_flat_document> arenas(pool.size());
+    pool.run(count, [&](size_t index, size_t worker) {
+        auto& arena = arenas[worker];
+        try {
+            parse_xml_flat(texts[index], arena);
+            results[index].document = arena;
+        }
+        catch (...) {
+            results[index].error = std::current_exception();
+        }
+    });
+    return results;
+}
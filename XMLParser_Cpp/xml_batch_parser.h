@@ -0,0 +1,60 @@
+//
+//  xml_batch_parser.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_batch_parser_h
+#define xml_batch_parser_h
+
+#include "xml_document.h"
+#include "xml_flat_document.h"
+#include "xml_thread_pool.h"
+
+#include <exception>
+#include <string_view>
+#include <vector>
+
+namespace bbxml {
+
+    /**
+     * A document of a batch, or the error which stopped parsing it
+     */
+    template <class Document>
+    struct xml_batch_result {
+        Document document;
+        std::exception_ptr error;   // xml_error usually; the document is empty then
+
+        explicit operator bool() const noexcept { return !error; }
+    };
+
+    /**
+     * Parses independent documents on the workers of the pool; the results are in the order of the texts.
+     *
+     * An error of a document is kept in its result, and does not stop the others.
+     * The parsers share no state, so the throughput grows with the workers until the memory bandwidth runs out.
+     *
+     * NOTE: Not arena-backed; the nodes are shared_ptr on the global heap, as they are owned by the caller after the batch,
+     * so the workers contend in malloc for every node. parse_xml_flat_batch() builds in an arena per worker.
+     */
+    extern std::vector<xml_batch_result<xml_document>> parse_xml_batch(const std::string_view* texts, size_t count, xml_thread_pool& pool);
+
+    inline std::vector<xml_batch_result<xml_document>> parse_xml_batch(const std::vector<std::string_view>& texts, xml_thread_pool& pool) {
+        return parse_xml_batch(texts.data(), texts.size(), pool);
+    }
+
+    /**
+     * Same as parse_xml_batch(), into xml_flat_document as parse_xml_flat().
+     *
+     * Every worker builds in its own arena, a document whose arrays are reused over the texts,
+     * and only the result is copied out in exact size; so the allocations per document do not grow with its size.
+     */
+    extern std::vector<xml_batch_result<xml_flat_document>> parse_xml_flat_batch(const std::string_view* texts, size_t count, xml_thread_pool& pool);
+
+    inline std::vector<xml_batch_result<xml_flat_document>> parse_xml_flat_batch(const std::vector<std::string_view>& texts, xml_thread_pool& pool) {
+        return parse_xml_flat_batch(texts.data(), texts.size(), pool);
+    }
+
+}
+
+#endif /* xml_batch_parser_h */
@@ -0,0 +1,344 @@
+//
+//  xml_binary_document.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_binary_document.h"
+#include "xml_mapped_file.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+using namespace bbxml;
+
+namespace {
+    constexpr char binary_magic[8] = {'B', 'B', 'X', 'M', 'L', 'B', 'I', 'N'};
+    constexpr uint32_t byte_order_mark = 0x01020304;
+
+    struct xml_binary_header {
+        char magic[8];
+        uint32_t format_version;
+        uint32_t byte_order;        // byte_order_mark as written
+        uint32_t node_size;         // sizeof(xml_flat_node)
+        uint32_t attribute_size;    // sizeof(xml_flat_attribute)
+        uint64_t source_checksum;
+        uint64_t checksum;          // of the bytes after the header
+        uint32_t nodes_size;
+        uint32_t node_attributes_size;
+        uint32_t attributes_size;   // of the declaration
+        uint32_t version;
+        uint32_t version_size;
+        uint32_t strings_size;      // in bytes
+    };
+    static_assert(sizeof(xml_binary_header) % 8 == 0, "the sections after the header are aligned to 8 bytes");
+
+    inline uint64_t padded(uint64_t size) {
+        return (size + 7) & ~uint64_t(7);
+    }
+
+    inline uint64_t rotate_left(uint64_t x, int bits) {
+        return (x << bits) | (x >> (64 - bits));
+    }
+
+    inline uint64_t load_word(const char* itr) {
+        uint64_t word;
+        std::memcpy(&word, itr, sizeof(word));
+        return word;
+    }
+
+    /**
+     * Builds the sections of a binary; every string is interned in the pool with the flag of the source,
+     * which is the pool itself when it is loaded.
+     *
+     * The keys of `offsets` refer the strings of the document being written, which outlives the writer.
+     */
+    struct xml_binary_writer {
+        std::vector<xml_flat_node> nodes;
+        std::vector<xml_flat_attribute> node_attributes;
+        std::vector<xml_flat_attribute> attributes;
+        std::string strings;
+        std::unordered_map<std::string_view, uint32_t> offsets;
+
+        std::pair<uint32_t, uint32_t> intern(std::string_view string) {
+            if (string.size() > xml_flat_string_size_mask) {
+                throw std::length_error("xml_flat_document supports up to 1 GiB");
+            }
+            auto itr = offsets.find(string);
+            if (itr == offsets.end()) {
+                if (strings.size() + string.size() > UINT32_MAX) {
+                    throw std::length_error("A binary of xml_flat_document supports strings up to 4 GiB");
+                }
+                itr = offsets.emplace(string, static_cast<uint32_t>(strings.size())).first;
+                strings.append(string);
+            }
+            return {itr->second, static_cast<uint32_t>(string.size()) | xml_flat_string_in_source};
+        }
+
+        xml_flat_attribute make_attribute(std::string_view key, std::string_view value) {
+            const auto key_string = intern(key);
+            const auto value_string = intern(value);
+            return {key_string.first, key_string.second, value_string.first, value_string.second};
+        }
+
+        /**
+         * Appends the node and its subtree in the document order, same as parse_xml_flat()
+         */
+        xml_node_id append(const xml_node& node, xml_node_id parent) {
+            if (nodes.size() >= xml_null_node_id) {
+                throw std::length_error("Too many nodes for xml_flat_document");
+            }
+            const auto id = static_cast<xml_node_id>(nodes.size());
+            const auto name = intern(node.name);
+            const auto value = intern(node.value);
+            nodes.push_back({parent, xml_null_node_id, xml_null_node_id, name.first, name.second, value.first, value.second,
+                static_cast<uint32_t>(node_attributes.size()), static_cast<uint32_t>(node.attributes.size())});
+            for (const auto& attribute : node.attributes) {
+                node_attributes.push_back(make_attribute(attribute.first, attribute.second));
+            }
+            auto last_child = xml_null_node_id;
+            for (const auto& child : node.nodes) {
+                const auto child_id = append(*child, id);
+                if (last_child == xml_null_node_id) {
+                    nodes[id].first_child = child_id;
+                }
+                else {
+                    nodes[last_child].next_sibling = child_id;
+                }
+                last_child = child_id;
+            }
+            return id;
+        }
+
+        template <class Attributes>
+        std::string finish(std::string_view version, const Attributes& declaration_attributes, uint64_t source_checksum) {
+            for (const auto& attribute : declaration_attributes) {
+                attributes.push_back(make_attribute(attribute.first, attribute.second));
+            }
+            const auto version_string = intern(version);
+
+            xml_binary_header header{};
+            std::memcpy(header.magic, binary_magic, sizeof(binary_magic));
+            header.format_version = xml_binary_format_version;
+            header.byte_order = byte_order_mark;
+            header.node_size = sizeof(xml_flat_node);
+            header.attribute_size = sizeof(xml_flat_attribute);
+            header.source_checksum = source_checksum;
+            header.nodes_size = static_cast<uint32_t>(nodes.size());
+            header.node_attributes_size = static_cast<uint32_t>(node_attributes.size());
+            header.attributes_size = static_cast<uint32_t>(attributes.size());
+            header.version = version_string.first;
+            header.version_size = version_string.second & xml_flat_string_size_mask;
+            header.strings_size = static_cast<uint32_t>(strings.size());
+
+            std::string out;
+            out.reserve(sizeof(header) + padded(nodes.size() * sizeof(xml_flat_node)) + padded(node_attributes.size() * sizeof(xml_flat_attribute))
+                        + padded(attributes.size() * sizeof(xml_flat_attribute)) + padded(strings.size()));
+            out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+            auto append_section = [&](const void* data, size_t size) {
+                out.append(static_cast<const char*>(data), size);
+                out.append(padded(size) - size, '\0');
+            };
+            append_section(nodes.data(), nodes.size() * sizeof(xml_flat_node));
+            append_section(node_attributes.data(), node_attributes.size() * sizeof(xml_flat_attribute));
+            append_section(attributes.data(), attributes.size() * sizeof(xml_flat_attribute));
+            append_section(strings.data(), strings.size());
+
+            header.checksum = xml_checksum(std::string_view(out).substr(sizeof(header)));
+            std::memcpy(&out[0], &header, sizeof(header));
+            return out;
+        }
+    };
+
+    [[noreturn]] inline void reject(xml_binary_error_code code, const std::string& message) {
+        throw xml_binary_error(code, message);
+    }
+
+    /**
+     * A string of a loaded binary has to be in the pool, which is the source of the document
+     */
+    inline void check_string(uint32_t offset, uint32_t size, uint32_t strings_size) {
+        if ((size & xml_flat_string_in_source) == 0 || (size & xml_flat_string_escaped) != 0
+            || uint64_t(offset) + (size & xml_flat_string_size_mask) > strings_size) {
+            reject(xml_binary_error_code::corrupted, "A string of the binary is out of the pool");
+        }
+    }
+
+    /**
+     * A node refers only the nodes after it but the parent, so that the links have no loop
+     */
+    inline void check_node(const xml_flat_node& node, xml_node_id id, const xml_binary_header& header) {
+        const auto is_before = [&](xml_node_id other) { return other == xml_null_node_id || other < id; };
+        const auto is_after = [&](xml_node_id other) { return other == xml_null_node_id || (other > id && other < header.nodes_size); };
+        if (!is_before(node.parent) || !is_after(node.first_child) || !is_after(node.next_sibling)
+            || uint64_t(node.attributes) + node.attributes_size > header.node_attributes_size) {
+            reject(xml_binary_error_code::corrupted, "A node of the binary is out of the table");
+        }
+        check_string(node.name, node.name_size, header.strings_size);
+        check_string(node.value, node.value_size, header.strings_size);
+    }
+
+    inline void check_attribute(const xml_flat_attribute& attribute, const xml_binary_header& header) {
+        check_string(attribute.key, attribute.key_size, header.strings_size);
+        check_string(attribute.value, attribute.value_size, header.strings_size);
+    }
+
+    template <class Document>
+    void write_binary_file(const std::string& path, const Document& document, uint64_t source_checksum) {
+        const auto binary = to_xml_binary(document, source_checksum);
+        const auto temporary_path = path + ".tmp";
+        {
+            // iostreams do not tell the cause, and errno is not set by them for sure
+            std::ofstream ofs{temporary_path, std::ios::out | std::ios::binary | std::ios::trunc};
+            if (!ofs) {
+                throw std::system_error(std::make_error_code(std::io_errc::stream), "Can not open \"" + temporary_path + "\"");
+            }
+            ofs.write(binary.data(), binary.size());
+            ofs.close();
+            if (!ofs) {
+                std::remove(temporary_path.c_str());
+                throw std::system_error(std::make_error_code(std::io_errc::stream), "Can not write \"" + temporary_path + "\"");
+            }
+        }
+        // rename() does not replace a file on Windows
+        if (std::rename(temporary_path.c_str(), path.c_str()) != 0 && (std::remove(path.c_str()), std::rename(temporary_path.c_str(), path.c_str()) != 0)) {
+            const auto error = errno;
+            std::remove(temporary_path.c_str());
+            throw std::system_error(error, std::generic_category(), "Can not rename \"" + temporary_path + "\" to \"" + path + "\"");
+        }
+    }
+}
+
+/**
+ * Four lanes of multiply and rotate over 8-byte words, which run in parallel; the tail and the size are mixed in at last
+ */
+uint64_t bbxml::xml_checksum(std::string_view data) noexcept {
+    constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+    uint64_t lanes[4] = {prime1 + prime2, prime2, 0, 0 - prime1};
+
+    auto itr = data.data();
+    const auto end = itr + data.size();
+    for (; end - itr >= 32; itr += 32) {
+        for (int i = 0; i < 4; ++i) {
+            lanes[i] = rotate_left(lanes[i] + load_word(itr + i * 8) * prime2, 31) * prime1;
+        }
+    }
+    auto hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+    for (; end - itr >= 8; itr += 8) {
+        hash = rotate_left(hash ^ (load_word(itr) * prime2), 27) * prime1 + prime3;
+    }
+    for (; itr < end; ++itr) {
+        hash = rotate_left(hash ^ (static_cast<unsigned char>(*itr) * prime3), 11) * prime1;
+    }
+    hash ^= data.size();
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::string bbxml::to_xml_binary(const xml_flat_document& document, uint64_t source_checksum) {
+    xml_binary_writer writer;
+    writer.nodes = document.nodes;
+    for (auto& node : writer.nodes) {
+        const auto name = writer.intern(document.string(node.name, node.name_size));
+        const auto value = writer.intern(document.string(node.value, node.value_size));
+        node.name = name.first;
+        node.name_size = name.second;
+        node.value = value.first;
+        node.value_size = value.second;
+    }
+    writer.node_attributes.reserve(document.node_attributes.size());
+    for (const auto& attribute : document.node_attributes) {
+        writer.node_attributes.push_back(writer.make_attribute(document.string(attribute.key, attribute.key_size), document.string(attribute.value, attribute.value_size)));
+    }
+    return writer.finish(document.version, document.attributes, source_checksum);
+}
+
+std::string bbxml::to_xml_binary(const xml_document& document, uint64_t source_checksum) {
+    xml_binary_writer writer;
+    if (document.root_node) {
+        writer.append(*document.root_node, xml_null_node_id);
+    }
+    return writer.finish(document.version, document.attributes, source_checksum);
+}
+
+void bbxml::write_xml_binary_file(const std::string& path, const xml_flat_document& document, uint64_t source_checksum) {
+    write_binary_file(path, document, source_checksum);
+}
+
+void bbxml::write_xml_binary_file(const std::string& path, const xml_document& document, uint64_t source_checksum) {
+    write_binary_file(path, document, source_checksum);
+}
+
+xml_flat_document bbxml::load_xml_binary(std::string_view binary, uint64_t source_checksum) {
+    if (binary.size() < sizeof(binary_magic) || std::memcmp(binary.data(), binary_magic, sizeof(binary_magic)) != 0) {
+        reject(xml_binary_error_code::not_binary, "Not a binary of xml_flat_document");
+    }
+    if (binary.size() < sizeof(xml_binary_header)) {
+        reject(xml_binary_error_code::truncated, "The binary is truncated in the header");
+    }
+    xml_binary_header header;
+    std::memcpy(&header, binary.data(), sizeof(header));
+    if (header.format_version != xml_binary_format_version) {
+        reject(xml_binary_error_code::unsupported_version, "Unsupported binary version " + std::to_string(header.format_version));
+    }
+    if (header.byte_order != byte_order_mark || header.node_size != sizeof(xml_flat_node) || header.attribute_size != sizeof(xml_flat_attribute)) {
+        reject(xml_binary_error_code::incompatible_layout, "The binary is written in another layout");
+    }
+    if (source_checksum != 0 && header.source_checksum != source_checksum) {
+        reject(xml_binary_error_code::stale_source, "The binary is written from another source");
+    }
+
+    const auto nodes_offset = uint64_t(sizeof(header));
+    const auto node_attributes_offset = nodes_offset + padded(uint64_t(header.nodes_size) * sizeof(xml_flat_node));
+    const auto attributes_offset = node_attributes_offset + padded(uint64_t(header.node_attributes_size) * sizeof(xml_flat_attribute));
+    const auto strings_offset = attributes_offset + padded(uint64_t(header.attributes_size) * sizeof(xml_flat_attribute));
+    const auto size = strings_offset + padded(header.strings_size);
+    if (binary.size() < size) {
+        reject(xml_binary_error_code::truncated, "The binary is truncated");
+    }
+    if (binary.size() > size || xml_checksum(binary.substr(sizeof(header))) != header.checksum) {
+        reject(xml_binary_error_code::corrupted, "The checksum of the binary does not match");
+    }
+
+    xml_flat_document document;
+    document.nodes.resize(header.nodes_size);
+    std::memcpy(document.nodes.data(), binary.data() + nodes_offset, header.nodes_size * sizeof(xml_flat_node));
+    document.node_attributes.resize(header.node_attributes_size);
+    std::memcpy(document.node_attributes.data(), binary.data() + node_attributes_offset, header.node_attributes_size * sizeof(xml_flat_attribute));
+    for (xml_node_id id = 0; id < header.nodes_size; ++id) {
+        check_node(document.nodes[id], id, header);
+    }
+    for (const auto& attribute : document.node_attributes) {
+        check_attribute(attribute, header);
+    }
+
+    document.source = binary.substr(strings_offset, header.strings_size);
+    check_string(header.version, header.version_size | xml_flat_string_in_source, header.strings_size);
+    document.version = document.source.substr(header.version, header.version_size);
+    for (uint32_t i = 0; i < header.attributes_size; ++i) {
+        xml_flat_attribute attribute;
+        std::memcpy(&attribute, binary.data() + attributes_offset + i * sizeof(attribute), sizeof(attribute));
+        check_attribute(attribute, header);
+        document.attributes[std::string(document.string(attribute.key, attribute.key_size))] = document.string(attribute.value, attribute.value_size);
+    }
+    return document;
+}
+
+xml_flat_document bbxml::load_xml_binary_file(const std::string& path, uint64_t source_checksum) {
+    auto file = std::make_shared<const xml_mapped_file>(path);
+    auto document = load_xml_binary(file->data(), source_checksum);
+    document.source_file = std::move(file);
+    return document;
+}
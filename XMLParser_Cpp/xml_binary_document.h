@@ -0,0 +1,98 @@
+//
+//  xml_binary_document.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_binary_document_h
+#define xml_binary_document_h
+
+#include "xml_document.h"
+#include "xml_flat_document.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace bbxml {
+
+    /**
+     * The version of the binary format; a binary of another version is rejected
+     */
+    constexpr uint32_t xml_binary_format_version = 1;
+
+    enum class xml_binary_error_code {
+        not_binary,             // no magic at the head
+        unsupported_version,
+        incompatible_layout,    // written on a machine of another byte order or another layout of xml_flat_node
+        truncated,
+        corrupted,              // the checksum or a range does not match
+        stale_source,           // written from another source than the one expected
+    };
+
+    /**
+     * Thrown when a binary is rejected; a cache should be rebuilt from the source then
+     */
+    class xml_binary_error : public std::runtime_error {
+    public:
+        xml_binary_error(xml_binary_error_code code, const std::string& message) : std::runtime_error(message), code_(code) {}
+
+        xml_binary_error_code code() const noexcept { return code_; }
+
+    private:
+        xml_binary_error_code code_;
+    };
+
+    /**
+     * A 64-bit checksum of the bytes, fast enough to check a cache at the memory bandwidth; not cryptographic
+     */
+    extern uint64_t xml_checksum(std::string_view data) noexcept;
+
+    /**
+     * Writes the document into the binary format of xml_flat_document, to be loaded by load_xml_binary() without parsing.
+     *
+     * The binary is position-independent; a header, then the node table, the attribute ranges of the nodes,
+     * the attributes of the declaration and the string pool, each padded to 8 bytes.
+     * The nodes and the attributes are of xml_flat_node and xml_flat_attribute, whose strings are offsets in the pool;
+     * every name, key and value is interned in the pool, so a name is stored once.
+     * The header has the format version, the byte order and the sizes of the structures, and the checksum of the rest.
+     *
+     * `source_checksum` is any 64-bit fingerprint of the source, such as xml_checksum() of its text;
+     * load_xml_binary() rejects the binary if it is given another one.
+     *
+     * @throw std::length_error if the strings are over 4 GiB
+     */
+    extern std::string to_xml_binary(const xml_flat_document& document, uint64_t source_checksum = 0);
+    extern std::string to_xml_binary(const xml_document& document, uint64_t source_checksum = 0);
+
+    /**
+     * Writes to_xml_binary() into a file, through a temporary file renamed over it, so a reader never sees half of it
+     *
+     * @throw std::system_error if the file can not be written
+     */
+    extern void write_xml_binary_file(const std::string& path, const xml_flat_document& document, uint64_t source_checksum = 0);
+    extern void write_xml_binary_file(const std::string& path, const xml_document& document, uint64_t source_checksum = 0);
+
+    /**
+     * Loads a binary of to_xml_binary() as a document which refers it, same as parse_xml_view(); the binary must outlive the document.
+     *
+     * Nothing is parsed: the header and the checksum are checked, the node table and the attribute ranges are checked
+     * to be in range and copied as they are, and the strings are the pool in the binary itself.
+     *
+     * @param source_checksum 0 not to check the source
+     * @throw xml_binary_error if the binary is not of this format, of this version and this machine, or is broken or stale
+     */
+    extern xml_flat_document load_xml_binary(std::string_view binary, uint64_t source_checksum = 0);
+
+    /**
+     * Maps the file, and loads it same as load_xml_binary(); the document owns the mapping
+     *
+     * @throw std::system_error if the file can not be read
+     * @throw xml_binary_error same as load_xml_binary()
+     */
+    extern xml_flat_document load_xml_binary_file(const std::string& path, uint64_t source_checksum = 0);
+
+}
+
+#endif /* xml_binary_document_h */
@@ -7,36 +7,313 @@
 #ifndef xml_document_h
 #define xml_document_h
 
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <exception>
+#include <iosfwd>
 #include <string>
+#include <string_view>
 #include <regex>
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace bbxml {
 
+    class xml_name_table;
+
+    /**
+     * A name of an element or an attribute, interned in xml_name_table.
+     *
+     * The same names in a table share one string, so names of a table are compared by the pointers;
+     * names of different tables, or a name and a string, are compared by the characters.
+     * The string is valid while the table is alive.
+     */
+    class xml_name {
+    public:
+        struct entry {
+            std::string string;
+            const xml_name_table* table;
+        };
+
+        xml_name() noexcept : entry_(&empty_entry()) {}   // "", as the name of no table
+        explicit xml_name(const entry* entry) noexcept : entry_(entry) {}
+
+        const std::string& str() const noexcept { return entry_->string; }
+        operator const std::string&() const noexcept { return entry_->string; }
+        operator std::string_view() const noexcept { return entry_->string; }
+        const char* data() const noexcept { return entry_->string.data(); }
+        const char* c_str() const noexcept { return entry_->string.c_str(); }
+        size_t size() const noexcept { return entry_->string.size(); }
+        bool empty() const noexcept { return entry_->string.empty(); }
+        int compare(std::string_view other) const noexcept { return std::string_view(entry_->string).compare(other); }
+        const xml_name_table* table() const noexcept { return entry_->table; }
+
+        friend bool operator==(const xml_name& a, const xml_name& b) noexcept {
+            return a.entry_ == b.entry_ || (a.entry_->table != b.entry_->table && a.entry_->string == b.entry_->string);
+        }
+        friend bool operator!=(const xml_name& a, const xml_name& b) noexcept { return !(a == b); }
+        friend bool operator==(const xml_name& a, std::string_view b) noexcept { return a.entry_->string == b; }
+        friend bool operator!=(const xml_name& a, std::string_view b) noexcept { return a.entry_->string != b; }
+        friend bool operator==(std::string_view a, const xml_name& b) noexcept { return a == b.entry_->string; }
+        friend bool operator!=(std::string_view a, const xml_name& b) noexcept { return a != b.entry_->string; }
+
+    private:
+        friend class xml_attributes;
+
+        static const entry& empty_entry() noexcept;
+
+        const entry* entry_;
+    };
+
+    extern std::ostream& operator<<(std::ostream& os, const xml_name& name);
+
+    /**
+     * Interns names for a document or a parser; not thread-safe while interning
+     */
+    class xml_name_table {
+    public:
+        xml_name_table() = default;
+        xml_name_table(const xml_name_table&) = delete;
+        xml_name_table& operator=(const xml_name_table&) = delete;
+
+        xml_name intern(std::string_view name);
+
+        /**
+         * Looks up an interned name without interning it; "" of no table if it is not interned
+         */
+        xml_name find(std::string_view name) const noexcept;
+        size_t size() const noexcept { return entries_.size(); }
+
+    private:
+        std::deque<xml_name::entry> entries_;   // never moved
+        std::unordered_map<std::string_view, const xml_name::entry*> index_;
+    };
+
+    /**
+     * Attributes of an element, in the order of the document; the same key is kept at the place of the first one.
+     * Stored in a flat array, whose first few are inline in the container without a heap allocation.
+     *
+     * The keys are of a table, and compared by the pointers; a string is looked up in the table once.
+     */
+    class xml_attributes {
+    public:
+        typedef std::pair<xml_name, std::string> value_type;
+        typedef value_type* iterator;
+        typedef const value_type* const_iterator;
+
+        static constexpr size_t inline_capacity = 4;
+
+        xml_attributes() noexcept : data_(inline_data()), size_(0), capacity_(inline_capacity) {}
+        xml_attributes(const xml_attributes& other);
+        xml_attributes(xml_attributes&& other) noexcept;
+        xml_attributes& operator=(const xml_attributes& other);
+        xml_attributes& operator=(xml_attributes&& other) noexcept;
+        ~xml_attributes();
+
+        iterator begin() noexcept { return data_; }
+        iterator end() noexcept { return data_ + size_; }
+        const_iterator begin() const noexcept { return data_; }
+        const_iterator end() const noexcept { return data_ + size_; }
+        size_t size() const noexcept { return size_; }
+        bool empty() const noexcept { return size_ == 0; }
+
+        iterator find(xml_name key) noexcept;
+        const_iterator find(xml_name key) const noexcept;
+        iterator find(std::string_view key) noexcept;
+        const_iterator find(std::string_view key) const noexcept;
+        size_t count(std::string_view key) const noexcept { return find(key) != end() ? 1 : 0; }
+
+        /**
+         * @throw std::out_of_range same as std::map::at()
+         */
+        std::string& at(xml_name key);
+        const std::string& at(xml_name key) const;
+        std::string& at(std::string_view key);
+        const std::string& at(std::string_view key) const;
+
+        /**
+         * Sets the value of the key, or appends the key; the last one wins for a duplicated key, same as std::map::operator[]
+         * The key has to be of the table of the other keys.
+         */
+        void set(xml_name key, std::string value);
+
+        void clear() noexcept;
+
+    private:
+        value_type* inline_data() noexcept { return reinterpret_cast<value_type*>(inline_storage_); }
+        void move_from(xml_attributes& other) noexcept;
+
+        value_type* data_;
+        uint32_t size_;
+        uint32_t capacity_;
+        alignas(value_type) unsigned char inline_storage_[sizeof(value_type) * inline_capacity];
+    };
+
     struct xml_node {
         std::weak_ptr<xml_node> parent;
-        std::string name;
-        std::map<std::string, std::string> attributes;
+        xml_name name;
+        xml_attributes attributes;
         std::string value;
         std::vector<std::shared_ptr<xml_node>> nodes;
-        
+        std::shared_ptr<const xml_name_table> names;    // keeps the name and the keys alive, so a node can outlive its document
+
         std::string inner_text() const noexcept;
+
+        /**
+         * Appends the value and the inner texts of the children to `out`, without a string per node
+         */
+        void append_inner_text(std::string& out) const;
     };
 
     struct xml_document {
         std::string version;
-        std::map<std::string, std::string> attributes;
+        xml_attributes attributes;
         std::shared_ptr<xml_node> root_node;
+        std::shared_ptr<const xml_name_table> names;
 
 		std::string description() const noexcept;
     };
     
-    class xml_error : public std::exception {};
+    enum class xml_error_code {
+        no_xml_declaration,
+        unsupported_version,
+        illegal_attributes,
+        no_escaped_character,
+        illegal_comment,
+        no_tag_name,
+        illegal_tag_name,
+        missing_opening_tag,
+        missing_closing_tag,
+        illegal_closing_tag,
+        illegal_format,
+        too_deep,               // exceeds xml_parse_limits::max_depth
+        too_many_attributes,
+        too_long_name,
+        too_long_text,
+        too_many_nodes,
+    };
+    
+    struct xml_position {
+        size_t offset;  // 0-origin byte offset from the head of the document
+        size_t line;    // 1-origin
+        size_t column;  // 1-origin, in bytes
+    };
     
+    class xml_error : public std::exception {
+    public:
+        xml_error(xml_error_code code, const std::string& message, const xml_position& position, const char* file = nullptr, int file_line = 0);
+        
+        xml_error_code code() const noexcept { return code_; }
+        const xml_position& position() const noexcept { return position_; }
+        size_t offset() const noexcept { return position_.offset; }
+        size_t line() const noexcept { return position_.line; }
+        size_t column() const noexcept { return position_.column; }
+        
+        virtual const char* what() const noexcept override;
+        
+    private:
+        xml_error_code code_;
+        xml_position position_;
+        std::string what_;
+    };
+    
+    /**
+     * Bounds of a document, to parse an untrusted input in bounded memory and stack.
+     *
+     * They are checked by the tokenizer at every markup in constant time, so parsing stays linear in the input;
+     * an input over a limit throws xml_error of the code of the limit, at the head of the markup or the text.
+     * The defaults fit any usual document, and keep the recursion over a tree, such as its destruction, off the stack limit.
+     */
+    struct xml_parse_limits {
+        size_t max_depth = 1024;                        // of nested elements
+        size_t max_attributes = 1024;                   // in a tag
+        size_t max_name_length = 50000;                 // of a tag name or an attribute key, in bytes
+        size_t max_text_length = 10 * 1024 * 1024;      // of a text, a CDATA section, a comment, an attribute value or the spaces in a tag, in bytes
+        size_t max_nodes = SIZE_MAX;                    // elements, texts, CDATA sections and comments, as the nodes of DOM
+
+        static xml_parse_limits unlimited() noexcept {
+            return {SIZE_MAX, SIZE_MAX, SIZE_MAX, SIZE_MAX, SIZE_MAX};
+        }
+    };
+
+    /**
+     * Features of parse_xml<Flags>() in "xml_policy_parser.h", selected at compile time; a feature off is compiled out.
+     *
+     * The tokenizer checks the structure and the limits whichever they are.
+     */
+    enum xml_parse_flags : unsigned {
+        xml_parse_validate_names = 1u << 0,     // checks the characters of the tag names
+        xml_parse_decode_entities = 1u << 1,    // checks and unescapes the texts and the attribute values; keeps them as they are if off
+        xml_parse_skip_space_texts = 1u << 2,   // drops a text of only spaces
+        xml_parse_fold_texts = 1u << 3,         // folds a single text child of an element into its value
+        xml_parse_trim_texts = 1u << 4,         // trims the spaces around a text
+        xml_parse_keep_comments = 1u << 5,      // keeps a comment as a "#comment" node
+        xml_parse_keep_cdata = 1u << 6,         // keeps a CDATA section as a "#cdata-section" node, instead of joining it to the text
+
+        xml_parse_default = xml_parse_validate_names | xml_parse_decode_entities | xml_parse_skip_space_texts | xml_parse_fold_texts,  // same as parse_xml()
+        xml_parse_trusted = xml_parse_skip_space_texts | xml_parse_fold_texts,  // for an input known to be valid and to have no references
+    };
+
+    /**
+     * Counts and times of parse_xml(), to find out what makes an input slow.
+     *
+     * The time is split into exclusive phases; `tokenize` is scanning the markup, the names and the attribute spans,
+     * `attributes` is unescaping the values and interning the keys, `unescape` is decoding the texts,
+     * and `build` is making and linking the nodes.
+     * The allocations are of the tree, estimated from the nodes, the lists, the strings and the attributes.
+     */
+    struct xml_parse_stats {
+        size_t bytes = 0;
+        size_t nodes = 0;               // elements and texts
+        size_t attributes = 0;          // with the ones of the declaration
+        size_t entities = 0;            // entity and character references, in texts and attribute values
+        size_t comments = 0;
+        size_t cdata_sections = 0;
+        size_t allocations = 0;
+        std::chrono::nanoseconds tokenize_time{0};
+        std::chrono::nanoseconds attributes_time{0};
+        std::chrono::nanoseconds unescape_time{0};
+        std::chrono::nanoseconds build_time{0};
+        bool measures_time = true;      // false to only count, without reading the clock at every phase
+
+        std::chrono::nanoseconds total_time() const noexcept { return tokenize_time + attributes_time + unescape_time + build_time; }
+    };
+
     extern xml_document parse_xml(const std::string& text);
+
+    /**
+     * Same as parse_xml(), within the limits instead of the default ones
+     */
+    extern xml_document parse_xml(const std::string& text, const xml_parse_limits& limits);
+    extern xml_document parse_xml(const char* first, const char* last, const xml_parse_limits& limits);
+
+    /**
+     * Same as parse_xml(), and adds the counts and the times into `stats`, so that it can sum over documents.
+     * Only this overload pays for them; the others are built without any instrumentation.
+     *
+     * The counts cost little, but the times read the clock a few times per element;
+     * turn off `measures_time` to watch the counts of every document in production.
+     *
+     * When it throws, `stats` has the counts up to the error.
+     */
+    extern xml_document parse_xml(const std::string& text, xml_parse_stats& stats);
+    extern xml_document parse_xml(const char* first, const char* last, xml_parse_stats& stats);
+    
+    /**
+     * Parses [first, last) without copying it into a string
+     */
+    extern xml_document parse_xml(const char* first, const char* last);
+    
+    /**
+     * Parses a file through a memory mapping instead of reading it into a string
+     *
+     * @throw std::system_error if the file can not be read
+     */
+    extern xml_document parse_xml_file(const std::string& path);
     
 }
 
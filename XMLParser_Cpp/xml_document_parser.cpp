@@ -0,0 +1,276 @@
+//
+//  xml_document_parser.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_document_parser.h"
+#include "xml_node_builder.h"
+#include "xml_parser.h"
+
+#include <assert.h>
+#include <algorithm>
+
+using namespace bbxml;
+
+namespace {
+    constexpr size_t no_parent = SIZE_MAX;
+
+    /**
+     * Attributes checked against the old ones one by one, to write the values in place
+     */
+    constexpr size_t max_attributes_in_place = 8;
+
+    /**
+     * Names kept over documents; past them, a new table is started so that ever new names do not grow the table forever
+     */
+    constexpr size_t max_kept_names = 4096;
+
+    /**
+     * Sets the attributes of the spans to `attributes`, same as bb::make_xml_attributes().
+     *
+     * When the keys are the same as the old ones, the values are unescaped into the old strings,
+     * so that an element of the same tag as the last time allocates nothing.
+     */
+    void assign_attributes(xml_attributes& attributes, const std::vector<bb::xml_attribute_span>& spans, xml_name_table& names) {
+        xml_name keys[max_attributes_in_place];
+        bool is_same = spans.size() == attributes.size() && spans.size() <= max_attributes_in_place;
+        for (size_t i = 0; is_same && i < spans.size(); ++i) {
+            keys[i] = names.intern(std::string_view(spans[i].key_first, spans[i].key_last - spans[i].key_first));
+            is_same = std::any_of(attributes.begin(), attributes.end(), [&](const xml_attributes::value_type& attribute) { return attribute.first == keys[i]; });
+        }
+        // The same sizes and every old key in the new ones; so no key is duplicated in the spans
+        for (auto itr = attributes.begin(); is_same && itr != attributes.end(); ++itr) {
+            is_same = std::find(keys, keys + spans.size(), itr->first) != keys + spans.size();
+        }
+
+        if (is_same) {
+            for (size_t i = 0; i < spans.size(); ++i) {
+                auto& value = std::find_if(attributes.begin(), attributes.end(), [&](const xml_attributes::value_type& attribute) { return attribute.first == keys[i]; })->second;
+                value.clear();
+                bb::append_unescaped_xml_attribute_value(spans[i], value);
+            }
+            return;
+        }
+        attributes.clear();
+        for (const auto& span : spans) {
+            std::string value;
+            bb::append_unescaped_xml_attribute_value(span, value);
+            attributes.set(names.intern(std::string_view(span.key_first, span.key_last - span.key_first)), std::move(value));
+        }
+    }
+}
+
+/**
+ * The pool of the nodes, and the builder of bb::parse_xml_markup() which takes the nodes from it in the document order;
+ * so a node is reused for the node at the same place in the next document, whose strings and lists fit it already.
+ */
+struct xml_document_parser::state {
+    xml_parse_limits limits;
+    std::shared_ptr<xml_name_table> names = std::make_shared<xml_name_table>();
+    xml_name text_name = names->intern("#text");
+
+    std::vector<std::shared_ptr<xml_node>> nodes;   // the pool; [0, used) are in the document
+    std::vector<size_t> parents;                    // of the nodes, the index of the parent or no_parent at the top
+    std::vector<unsigned char> is_linked;           // of the nodes, whether it is in the list of the parent
+    std::vector<unsigned char> is_kept;             // of the nodes, by reset(); grown with the pool so that reset() never allocates
+    size_t used = 0;
+
+    std::shared_ptr<xml_node> top_node = std::make_shared<xml_node>();
+    std::vector<size_t> open_nodes;                 // indexes of the open elements
+    std::string text_before_tag;
+    std::vector<bb::xml_attribute_span> spans;
+    bb::xml_open_elements open_elements;
+    xml_attributes declaration_attributes;          // of the last document, while the document is empty
+
+    xml_document document{std::string(), xml_attributes(), nullptr, names};
+
+    explicit state(const xml_parse_limits& limits) : limits(limits) {}
+
+    xml_node& current_node() {
+        return open_nodes.empty() ? *top_node : *nodes[open_nodes.back()];
+    }
+
+    /**
+     * Takes the next node of the pool, or a new one, and appends it to the current node
+     */
+    size_t acquire_node() {
+        if (used == nodes.size()) {
+            nodes.push_back(std::make_shared<xml_node>());
+            nodes.back()->names = names;
+            parents.push_back(no_parent);
+            is_linked.push_back(false);
+            is_kept.push_back(false);
+        }
+        const auto index = used++;
+        auto& node = nodes[index];
+        parents[index] = open_nodes.empty() ? no_parent : open_nodes.back();
+        if (parents[index] != no_parent) {
+            node->parent = nodes[parents[index]];
+        }
+        current_node().nodes.push_back(node);
+        is_linked[index] = true;
+        return index;
+    }
+
+    void flush_text() {
+        if (!bb::is_space(text_before_tag.data(), text_before_tag.data() + text_before_tag.size())) {
+            auto& node = *nodes[acquire_node()];
+            node.name = text_name;
+            node.attributes.clear();
+            node.value.assign(text_before_tag);
+        }
+        text_before_tag.clear();
+    }
+
+    void declaration(const char* version_first, const char* version_last, const std::vector<bb::xml_attribute_span>& attributes) {
+        document.version.assign(version_first, version_last);
+        assign_attributes(declaration_attributes, attributes, *names);
+        document.attributes = std::move(declaration_attributes);
+    }
+
+    void text(const char* first, const char* last) {
+        bb::append_unescaped_xml_inner_text(first, last, text_before_tag);
+    }
+
+    void cdata(const char* first, const char* last) {
+        text_before_tag.append(first, last);
+    }
+
+    void comment(const char*, const char*) {
+    }
+
+    void start_element(const char* name_first, const char* name_last, const std::vector<bb::xml_attribute_span>& attributes, bool is_independent) {
+        flush_text();
+        const auto index = acquire_node();
+        auto& node = *nodes[index];
+        node.name = names->intern(std::string_view(name_first, name_last - name_first));
+        assign_attributes(node.attributes, attributes, *names);
+        if (!is_independent) {
+            open_nodes.push_back(index);
+        }
+    }
+
+    /**
+     * Folds a single text node into the value same as bb::xml_node_builder.
+     * The text is copied rather than moved, so that the buffers of the element and of the text node stay with them in the pool.
+     */
+    void end_element(const char*, const char*) {
+        flush_text();
+        assert(!open_nodes.empty());
+        auto& node = *nodes[open_nodes.back()];
+        if (node.nodes.size() == 1 && node.nodes[0]->name == text_name) {
+            node.value.assign(node.nodes[0]->value);
+            node.nodes.clear();
+            is_linked[open_nodes.back() + 1] = false;   // the text is the next node of the pool
+        }
+        open_nodes.pop_back();
+    }
+
+    void parse(const char* first, const char* last) {
+        auto cursor = bb::make_char_cursor(first, last);
+        bb::parse_xml_declaration(cursor, *this, spans, limits);
+        open_elements.reset(limits);
+        while (cursor.current < cursor.end && bb::parse_xml_markup(cursor, *this, spans, open_elements)) {
+        }
+        bb::parse_xml_end(cursor);
+
+        // XML document has exactly one single root element.
+        document.root_node = bb::find_xml_root_node(*top_node);
+    }
+
+    /**
+     * Returns the nodes to the pool, except the ones referenced out of the parser, and their subtrees.
+     * A node of the pool is referenced by the pool, by the list of its parent if it is linked, and by the document if it is the root.
+     */
+    void reset() noexcept {
+        for (size_t i = 0; i < used; ++i) {
+            const auto references = 1 + is_linked[i] + (nodes[i] == document.root_node ? 1 : 0);
+            is_kept[i] = nodes[i].use_count() > references || (parents[i] != no_parent && is_kept[parents[i]]);
+        }
+
+        document.root_node.reset();
+        top_node->nodes.clear();
+        size_t pooled = 0;
+        for (size_t i = 0; i < used; ++i) {
+            if (is_kept[i]) {
+                if (parents[i] == no_parent || !is_kept[parents[i]]) {
+                    nodes[i]->parent.reset();
+                }
+                nodes[i].reset();
+                continue;
+            }
+            auto& node = *nodes[i];
+            node.parent.reset();
+            node.value.clear();
+            node.nodes.clear();     // attributes are kept to be compared by assign_attributes()
+            nodes[pooled++] = std::move(nodes[i]);
+        }
+        if (pooled < used) {
+            // The unused nodes after the used ones
+            std::move(nodes.begin() + used, nodes.end(), nodes.begin() + pooled);
+            const auto size = nodes.size() - (used - pooled);
+            nodes.resize(size);
+            parents.resize(size);
+            is_linked.resize(size);
+            is_kept.resize(size);
+        }
+        used = 0;
+        open_nodes.clear();
+        text_before_tag.clear();
+        document.version.clear();
+        declaration_attributes = std::move(document.attributes);
+    }
+
+    /**
+     * Starts a new table if the names are over max_kept_names, after reset().
+     * The nodes kept out of the parser keep the old one; the pooled ones drop their names and keys of it.
+     */
+    void renew_names() {
+        if (names->size() <= max_kept_names) {
+            return;
+        }
+        auto renewed = std::make_shared<xml_name_table>();
+        text_name = renewed->intern("#text");
+        for (auto& node : nodes) {
+            node->name = xml_name();
+            node->attributes.clear();
+            node->names = renewed;
+        }
+        declaration_attributes.clear();
+        names = renewed;
+        document.names = std::move(renewed);
+    }
+};
+
+xml_document_parser::xml_document_parser(const xml_parse_limits& limits) : state_(new state(limits)) {
+}
+
+xml_document_parser::~xml_document_parser() {
+}
+
+const xml_document& xml_document_parser::parse(const char* first, const char* last) {
+    auto& s = *state_;
+    s.reset();
+    try {
+        s.renew_names();
+        s.parse(first, last);
+    }
+    catch (...) {
+        s.reset();
+        throw;
+    }
+    return s.document;
+}
+
+void xml_document_parser::reset() noexcept {
+    state_->reset();
+}
+
+const xml_document& xml_document_parser::document() const noexcept {
+    return state_->document;
+}
+
+size_t xml_document_parser::pooled_nodes() const noexcept {
+    return state_->nodes.size();
+}
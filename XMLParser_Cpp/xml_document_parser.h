@@ -0,0 +1,68 @@
+//
+//  xml_document_parser.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_document_parser_h
+#define xml_document_parser_h
+
+#include "xml_document.h"
+
+#include <memory>
+#include <string>
+
+namespace bbxml {
+
+    /**
+     * Parses documents one after another into the same xml_document, same as parse_xml(),
+     * reusing the nodes, the strings, the attribute arrays, the names and the buffers of the tokenizer of the last ones.
+     *
+     * Once it has parsed a document of the same shape, parsing another one with no more nodes nor longer texts allocates nothing; a message loop of documents of one schema runs without malloc nor free.
+     * The names interned are kept over documents, so the table grows with the vocabulary, not with the documents;
+     * past a few thousand names, such as generated ones, a new table is started.
+     *
+     * The document is valid until the next parse() or reset().
+     * A node, or a copy of the document, which is kept out of the parser is left as it is then, with its subtree,
+     * and it is replaced in the pool by a new one.
+     *
+     * Not thread-safe; a parser per thread.
+     */
+    class xml_document_parser {
+    public:
+        explicit xml_document_parser(const xml_parse_limits& limits = xml_parse_limits());
+        ~xml_document_parser();
+        xml_document_parser(const xml_document_parser&) = delete;
+        xml_document_parser& operator=(const xml_document_parser&) = delete;
+
+        /**
+         * Resets, and parses [first, last) into the document
+         *
+         * @throw xml_error same as parse_xml(); the document is empty then
+         */
+        const xml_document& parse(const char* first, const char* last);
+
+        const xml_document& parse(const std::string& text) {
+            return parse(text.data(), text.data() + text.size());
+        }
+
+        /**
+         * Empties the document, and returns its nodes to the pool
+         */
+        void reset() noexcept;
+
+        const xml_document& document() const noexcept;
+
+        /**
+         * The number of the nodes in the pool, used or not
+         */
+        size_t pooled_nodes() const noexcept;
+
+    private:
+        struct state;
+        std::unique_ptr<state> state_;
+    };
+
+}
+
+#endif /* xml_document_parser_h */
@@ -0,0 +1,24 @@
+//
+//  xml_document_reference.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_document_reference_h
+#define xml_document_reference_h
+
+#include "xml_document.h"
+
+namespace bbxml {
+    
+    /**
+     * The original std::regex driven parser.
+     * Kept as the reference implementation to compare the hand-written tokenizer against; do not use it in production.
+     */
+    namespace reference {
+        extern xml_document parse_xml(const std::string& text);
+    }
+    
+}
+
+#endif /* xml_document_reference_h */
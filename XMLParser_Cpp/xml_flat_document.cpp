@@ -0,0 +1,482 @@
+//
+//  xml_flat_document.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_flat_document.h"
+#include "xml_parser.h"
+#include "xml_mapped_file.h"
+
+#include <assert.h>
+#include <cstring>
+#include <stdexcept>
+
+using namespace bbxml;
+
+namespace {
+    const char text_node_name[] = "#text";
+
+    /**
+     * Whether a validated text is only spaces once unescaped, same as parse_xml() checks it.
+     * Only a character reference can be a space, so the text is unescaped only when the rest of it is spaces.
+     */
+    inline bool is_space_unescaped(const char* first, const char* last) {
+        for (auto itr = first; itr < last; ++itr) {
+            if (*itr == '&') {
+                if (itr + 1 == last || itr[1] != '#') {
+                    return false;
+                }
+                itr = bb::find(itr, last, ';');
+            }
+            else if (!bb::is_space(*itr)) {
+                return false;
+            }
+        }
+        const auto unescaped = bb::unescape_xml_inner_text(first, last);
+        return bb::is_space(unescaped.data(), unescaped.data() + unescaped.size());
+    }
+
+    /**
+     * Builds xml_flat_document
+     *
+     * "#text" is stored at the head of the strings, and all text nodes share it.
+     * When the document refers the source, a text which is a single slice of the source stays there,
+     * and texts joined over comments or CDATA sections are copied into the strings.
+     *
+     * In situ, `in_situ` is the source itself; the strings are unescaped and joined in it, and "\0" is put after each of them.
+     * Only the bytes behind the tokenizer are rewritten, and the lines are counted before,
+     * so that an error after them is reported at the same position as the other modes.
+     */
+    struct xml_flat_builder {
+        struct open_node {
+            xml_node_id id;
+            xml_node_id last_child;
+        };
+
+        xml_flat_document& document;
+        const bool refers_source;
+        char* const in_situ;
+        bb::line_counter* lines = nullptr;     // of the cursor, when in situ
+        std::vector<open_node> open_nodes;
+        size_t text_offset;     // the head of the text before the next tag, in the strings
+        const char* text_slice_first = nullptr;    // the text before the next tag, if it is a slice of the source
+        const char* text_slice_last = nullptr;
+        bool text_slice_escaped = false;
+
+        xml_flat_builder(xml_flat_document& document, bool refers_source, char* in_situ = nullptr) : document(document), refers_source(refers_source), in_situ(in_situ) {
+            document.strings.assign(text_node_name);
+            open_nodes.push_back({xml_null_node_id, xml_null_node_id});
+            text_offset = document.strings.size();
+        }
+
+        /**
+         * The writable byte of the source at `itr`
+         */
+        char* writable(const char* itr) const {
+            return in_situ + (itr - document.source.data());
+        }
+
+        /**
+         * Counts the lines up to `last` before the bytes before it are rewritten
+         */
+        void will_rewrite(const char* last) {
+            if (last > lines->checked) {
+                lines->advance(last);
+            }
+        }
+
+        uint32_t append_string(const char* first, const char* last) {
+            auto offset = static_cast<uint32_t>(document.strings.size());
+            document.strings.append(first, last);
+            return offset;
+        }
+
+        /**
+         * @return (offset, size) of the string; a slice of the source if the document refers it, or a copy in the strings
+         */
+        std::pair<uint32_t, uint32_t> make_string(const char* first, const char* last) {
+            const auto size = static_cast<uint32_t>(last - first);
+            if (refers_source) {
+                return {static_cast<uint32_t>(first - document.source.data()), size | xml_flat_string_in_source};
+            }
+            return {append_string(first, last), size};
+        }
+
+        std::pair<uint32_t, uint32_t> make_attribute_value(const bb::xml_attribute_span& attribute) {
+            if (in_situ) {
+                auto last = bb::move_unescaped_xml_attribute_value(attribute, writable(attribute.value_first));
+                *last = '\0';     // on the closing quote at least
+                return make_string(attribute.value_first, last);
+            }
+            if (refers_source) {
+                auto value = make_string(attribute.value_first, attribute.value_last);
+                if (bb::validate_xml_attribute_value(attribute)) {
+                    value.second |= xml_flat_string_escaped;
+                }
+                return value;
+            }
+            auto value = bb::unescape_xml_attribute_value(attribute);
+            return {append_string(value.data(), value.data() + value.size()), static_cast<uint32_t>(value.size())};
+        }
+
+        void declaration(const char* version_first, const char* version_last, const std::vector<bb::xml_attribute_span>& attributes) {
+            document.version.assign(version_first, version_last);
+            for (const auto& attribute : attributes) {
+                document.attributes[std::string(attribute.key_first, attribute.key_last)] = bb::unescape_xml_attribute_value(attribute);
+            }
+        }
+
+        void text(const char* first, const char* last) {
+            if (in_situ) {
+                append_in_situ(first, last, true);
+            }
+            else if (refers_source) {
+                append_text(first, last, bb::validate_xml_inner_text(first, last));
+            }
+            else {
+                bb::append_unescaped_xml_inner_text(first, last, document.strings);
+            }
+        }
+
+        void cdata(const char* first, const char* last) {
+            if (in_situ) {
+                append_in_situ(first, last, false);
+            }
+            else if (refers_source) {
+                append_text(first, last, false);
+            }
+            else {
+                document.strings.append(first, last);
+            }
+        }
+
+        void comment(const char*, const char*) {
+        }
+
+        void append_text(const char* first, const char* last, bool is_escaped) {
+            if (text_slice_first == nullptr && document.strings.size() == text_offset) {
+                text_slice_first = first;
+                text_slice_last = last;
+                text_slice_escaped = is_escaped;
+                return;
+            }
+            // No longer a single slice; joins the texts in the strings
+            if (text_slice_first != nullptr) {
+                append_unescaped(text_slice_first, text_slice_last, text_slice_escaped);
+                text_slice_first = nullptr;
+            }
+            append_unescaped(first, last, is_escaped);
+        }
+
+        /**
+         * Unescapes the text, or moves the CDATA section, just after the text before it,
+         * so that the text before the next tag is a single slice
+         */
+        void append_in_situ(const char* first, const char* last, bool is_text) {
+            if (text_slice_first == nullptr) {
+                text_slice_first = text_slice_last = first;
+            }
+            char* out = writable(text_slice_last);
+            if (is_text && bb::validate_xml_inner_text(first, last)) {
+                will_rewrite(last);
+                out = bb::move_unescaped_xml_inner_text(first, last, out);
+            }
+            else if (out != first) {
+                will_rewrite(last);
+                std::memmove(out, first, last - first);
+                out += last - first;
+            }
+            else {
+                out += last - first;
+            }
+            text_slice_last = out;
+        }
+
+        void append_unescaped(const char* first, const char* last, bool is_escaped) {
+            if (is_escaped) {
+                bb::append_unescaped_xml_inner_text(first, last, document.strings);
+            }
+            else {
+                document.strings.append(first, last);
+            }
+        }
+
+        void start_element(const char* name_first, const char* name_last, const std::vector<bb::xml_attribute_span>& attributes, bool is_independent) {
+            if (in_situ) {
+                // An illegal value is reported before any byte of the tag is rewritten
+                for (const auto& attribute : attributes) {
+                    bb::validate_xml_attribute_value(attribute);
+                }
+                will_rewrite((attributes.empty() ? name_last : attributes.back().value_last) + 1);
+            }
+            flush_text();
+
+            auto attributes_index = static_cast<uint32_t>(document.node_attributes.size());
+            for (const auto& attribute : attributes) {
+                const auto key = std::string_view(attribute.key_first, attribute.key_last - attribute.key_first);
+                auto duplicated = std::find_if(document.node_attributes.begin() + attributes_index, document.node_attributes.end(), [&](const xml_flat_attribute& other) {
+                    return document.string(other.key, other.key_size) == key;
+                });
+                auto value = make_attribute_value(attribute);
+                if (duplicated != document.node_attributes.end()) { // The last one wins, same as std::map
+                    duplicated->value = value.first;
+                    duplicated->value_size = value.second;
+                }
+                else {
+                    auto key_string = make_string(attribute.key_first, attribute.key_last);
+                    document.node_attributes.push_back({key_string.first, key_string.second, value.first, value.second});
+                }
+                if (in_situ) {
+                    *writable(attribute.key_last) = '\0';     // on "="
+                }
+            }
+
+            auto name = make_string(name_first, name_last);
+            if (in_situ) {
+                *writable(name_last) = '\0';      // on a space, "/" or ">"
+            }
+            auto id = append_node(name.first, name.second);
+            auto& node = document.nodes[id];
+            node.attributes = attributes_index;
+            node.attributes_size = static_cast<uint32_t>(document.node_attributes.size() - attributes_index);
+            if (!is_independent) {
+                open_nodes.push_back({id, xml_null_node_id});
+            }
+            text_offset = document.strings.size();
+        }
+
+        void end_element(const char*, const char* name_last) {
+            if (in_situ) {
+                will_rewrite(name_last);
+            }
+            flush_text();
+
+            const auto closed = open_nodes.back();
+            open_nodes.pop_back();
+
+            // Folds a single text node into the value; it is the last node as nodes are in the document order
+            auto& node = document.nodes[closed.id];
+            if (node.first_child != xml_null_node_id && node.first_child == closed.last_child && document.nodes[closed.last_child].name == 0) {
+                assert(closed.last_child + 1 == document.nodes.size());
+                node.value = document.nodes.back().value;
+                node.value_size = document.nodes.back().value_size;
+                node.first_child = xml_null_node_id;
+                document.nodes.pop_back();
+            }
+        }
+
+        /**
+         * Makes a text node of the text before the tag, or drops it if it is only spaces after unescaping
+         */
+        void flush_text() {
+            if (text_slice_first != nullptr) {
+                const auto is_space = text_slice_escaped ? is_space_unescaped(text_slice_first, text_slice_last) : bb::is_space(text_slice_first, text_slice_last);
+                if (!is_space) {
+                    auto value = make_string(text_slice_first, text_slice_last);
+                    auto id = append_node(0, sizeof(text_node_name) - 1);
+                    document.nodes[id].value = value.first;
+                    document.nodes[id].value_size = value.second | (text_slice_escaped ? xml_flat_string_escaped : 0);
+                    if (in_situ) {
+                        *writable(text_slice_last) = '\0';    // before "<" of the tag at last
+                    }
+                }
+                text_slice_first = nullptr;
+                return;
+            }
+
+            const auto text_size = document.strings.size() - text_offset;
+            if (bb::is_space(document.strings.data() + text_offset, document.strings.data() + document.strings.size())) {
+                document.strings.resize(text_offset);
+            }
+            else {
+                auto id = append_node(0, sizeof(text_node_name) - 1);
+                document.nodes[id].value = static_cast<uint32_t>(text_offset);
+                document.nodes[id].value_size = static_cast<uint32_t>(text_size);
+                text_offset = document.strings.size();
+            }
+        }
+
+        xml_node_id append_node(uint32_t name, uint32_t name_size) {
+            auto id = static_cast<xml_node_id>(document.nodes.size());
+            auto& parent = open_nodes.back();
+            // An empty value in situ is the end of "#text", which is "\0" as no string is appended
+            const uint32_t empty_value = in_situ ? sizeof(text_node_name) - 1 : 0;
+            document.nodes.push_back({parent.id, xml_null_node_id, xml_null_node_id, name, name_size, empty_value, 0, 0, 0});
+            if (parent.last_child != xml_null_node_id) {
+                document.nodes[parent.last_child].next_sibling = id;
+            }
+            else if (parent.id != xml_null_node_id) {
+                document.nodes[parent.id].first_child = id;
+            }
+            parent.last_child = id;
+            return id;
+        }
+    };
+
+    inline void parse_xml_flat(std::string_view text, bool refers_source, xml_flat_document& document) {
+        if (text.size() > xml_flat_string_size_mask) {
+            throw std::length_error("xml_flat_document supports up to 1 GiB");
+        }
+        auto cursor = bb::make_char_cursor(text.data(), text.data() + text.size());
+        document.source = refers_source ? text : std::string_view();
+        xml_flat_builder builder{document, refers_source};
+        bb::parse_xml(cursor, builder);
+    }
+
+    inline xml_flat_document parse_xml_flat(std::string_view text, bool refers_source) {
+        xml_flat_document document;
+        parse_xml_flat(text, refers_source, document);
+        return document;
+    }
+}
+
+xml_flat_document bbxml::parse_xml_flat(std::string_view text) {
+    return ::parse_xml_flat(text, false);
+}
+
+void bbxml::parse_xml_flat(std::string_view text, xml_flat_document& document) {
+    document.version.clear();
+    document.attributes.clear();
+    document.nodes.clear();
+    document.node_attributes.clear();
+    document.strings.clear();
+    document.source_file.reset();
+    document.unescaped_strings.clear();
+    ::parse_xml_flat(text, false, document);
+}
+
+xml_flat_document bbxml::parse_xml_view(std::string_view text) {
+    return ::parse_xml_flat(text, true);
+}
+
+xml_flat_document bbxml::parse_xml_in_situ(char* text, size_t size) {
+    if (size > xml_flat_string_size_mask) {
+        throw std::length_error("xml_flat_document supports up to 1 GiB");
+    }
+    xml_flat_document document;
+    auto cursor = bb::make_char_cursor(text, text + size);
+    document.source = std::string_view(text, size);
+    xml_flat_builder builder{document, true, text};
+    builder.lines = &cursor.lines;
+    bb::parse_xml(cursor, builder);
+    return document;
+}
+
+xml_flat_document bbxml::parse_xml_view_file(const std::string& path) {
+    auto file = std::make_shared<const xml_mapped_file>(path);
+    auto document = ::parse_xml_flat(file->data(), true);
+    document.source_file = std::move(file);
+    return document;
+}
+
+std::string_view xml_flat_document::string(uint32_t offset, uint32_t size) const {
+    const auto length = size & xml_flat_string_size_mask;
+    if ((size & xml_flat_string_in_source) == 0) {
+        return {strings.data() + offset, length};
+    }
+    if ((size & xml_flat_string_escaped) == 0) {
+        return source.substr(offset, length);
+    }
+    auto itr = unescaped_strings.find(offset);
+    if (itr == unescaped_strings.end()) {
+        const auto first = source.data() + offset;
+        itr = unescaped_strings.emplace(offset, bb::unescape_xml_inner_text(first, first + length)).first;
+    }
+    return itr->second;
+}
+
+
+xml_attributes_view::value_type xml_attributes_view::iterator::operator*() const {
+    return {document_->string(attribute_->key, attribute_->key_size), document_->string(attribute_->value, attribute_->value_size)};
+}
+
+xml_attributes_view::iterator xml_attributes_view::find(std::string_view key) const {
+    for (auto itr = begin(); itr != end(); ++itr) {
+        if ((*itr).first == key) {
+            return itr;
+        }
+    }
+    return end();
+}
+
+std::string_view xml_attributes_view::at(std::string_view key) const {
+    auto itr = find(key);
+    if (itr == end()) {
+        throw std::out_of_range("xml_attributes_view::at");
+    }
+    return (*itr).second;
+}
+
+xml_node_view xml_nodes_view::iterator::operator*() const {
+    return {document_, id_};
+}
+
+xml_nodes_view::iterator& xml_nodes_view::iterator::operator++() {
+    id_ = document_->nodes[id_].next_sibling;
+    return *this;
+}
+
+xml_node_view xml_nodes_view::front() const {
+    return {document_, first_};
+}
+
+const xml_flat_node& xml_node_view::node() const {
+    return document_->nodes[id_];
+}
+
+xml_node_view xml_node_view::parent() const {
+    return {document_, node().parent};
+}
+
+std::string_view xml_node_view::name() const {
+    return document_->string(node().name, node().name_size);
+}
+
+xml_attributes_view xml_node_view::attributes() const {
+    const auto attributes = document_->node_attributes.data() + node().attributes;
+    return {document_, attributes, attributes + node().attributes_size};
+}
+
+std::string_view xml_node_view::value() const {
+    return document_->string(node().value, node().value_size);
+}
+
+xml_nodes_view xml_node_view::nodes() const {
+    return {document_, node().first_child};
+}
+
+std::string xml_node_view::inner_text() const noexcept {
+    std::string text;
+    append_inner_text(text);
+    return text;
+}
+
+void xml_node_view::append_inner_text(std::string& out) const {
+    out += value();
+    for (auto node : nodes()) {
+        node.append_inner_text(out);
+    }
+}
+
+namespace {
+	inline void describe(const xml_node_view& node, size_t indent, std::string& out) {
+		out.append(indent, ' ').append("+ ").append(node.name());
+		for (auto attribute : node.attributes()) {
+			out.append(", ").append(attribute.first).append("=").append(attribute.second);
+		}
+		if (!node.value().empty()) {
+			out.append(", ").append(node.value());
+		}
+		out += '\n';
+		for (auto child : node.nodes()) {
+			describe(child, indent + 1, out);
+		}
+	}
+}
+
+std::string xml_flat_document::description() const noexcept {
+	std::string out = "XML version=" + version + "\n";
+	describe(root_node(), 0, out);
+	return out;
+}
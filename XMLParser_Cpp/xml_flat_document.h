@@ -0,0 +1,256 @@
+//
+//  xml_flat_document.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_flat_document_h
+#define xml_flat_document_h
+
+#include "xml_document.h"
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+
+namespace bbxml {
+
+    typedef uint32_t xml_node_id;
+    constexpr xml_node_id xml_null_node_id = UINT32_MAX;
+
+    /**
+     * Flags on the size of a string of xml_flat_document
+     */
+    constexpr uint32_t xml_flat_string_in_source = 0x80000000;  // the offset is in xml_flat_document::source
+    constexpr uint32_t xml_flat_string_escaped = 0x40000000;    // contains "&", unescaped on the first access
+    constexpr uint32_t xml_flat_string_size_mask = 0x3FFFFFFF;
+
+    struct xml_flat_document;
+    class xml_node_view;
+    class xml_mapped_file;
+
+    /**
+     * A node of xml_flat_document
+     *
+     * Nodes refer each other by xml_node_id; strings are (offset, size) pairs resolved by xml_flat_document::string().
+     */
+    struct xml_flat_node {
+        xml_node_id parent;
+        xml_node_id first_child;
+        xml_node_id next_sibling;
+        uint32_t name;
+        uint32_t name_size;
+        uint32_t value;
+        uint32_t value_size;
+        uint32_t attributes;        // index of xml_flat_document::node_attributes
+        uint32_t attributes_size;
+    };
+
+    struct xml_flat_attribute {
+        uint32_t key;
+        uint32_t key_size;
+        uint32_t value;
+        uint32_t value_size;
+    };
+
+    /**
+     * Attributes of xml_node_view, in the document order
+     */
+    class xml_attributes_view {
+    public:
+        typedef std::pair<std::string_view, std::string_view> value_type;
+
+        class iterator {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef xml_attributes_view::value_type value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const value_type* pointer;
+            typedef value_type reference;
+
+            iterator(const xml_flat_document* document, const xml_flat_attribute* attribute) : document_(document), attribute_(attribute) {}
+            value_type operator*() const;
+            iterator& operator++() { ++attribute_; return *this; }
+            iterator operator++(int) { auto itr = *this; ++attribute_; return itr; }
+            bool operator==(const iterator& other) const { return attribute_ == other.attribute_; }
+            bool operator!=(const iterator& other) const { return attribute_ != other.attribute_; }
+
+        private:
+            const xml_flat_document* document_;
+            const xml_flat_attribute* attribute_;
+        };
+
+        xml_attributes_view(const xml_flat_document* document, const xml_flat_attribute* first, const xml_flat_attribute* last) : document_(document), first_(first), last_(last) {}
+
+        iterator begin() const { return {document_, first_}; }
+        iterator end() const { return {document_, last_}; }
+        size_t size() const { return last_ - first_; }
+        bool empty() const { return first_ == last_; }
+        size_t count(std::string_view key) const { return find(key) != end() ? 1 : 0; }
+        iterator find(std::string_view key) const;
+
+        /**
+         * @throw std::out_of_range same as std::map::at()
+         */
+        std::string_view at(std::string_view key) const;
+
+    private:
+        const xml_flat_document* document_;
+        const xml_flat_attribute* first_;
+        const xml_flat_attribute* last_;
+    };
+
+    /**
+     * Children of xml_node_view; walks the siblings, so size() is O(n)
+     */
+    class xml_nodes_view {
+    public:
+        class iterator {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef xml_node_view value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const xml_node_view* pointer;
+            typedef xml_node_view reference;
+
+            iterator(const xml_flat_document* document, xml_node_id id) : document_(document), id_(id) {}
+            xml_node_view operator*() const;
+            iterator& operator++();
+            iterator operator++(int) { auto itr = *this; ++*this; return itr; }
+            bool operator==(const iterator& other) const { return id_ == other.id_; }
+            bool operator!=(const iterator& other) const { return id_ != other.id_; }
+
+        private:
+            const xml_flat_document* document_;
+            xml_node_id id_;
+        };
+
+        xml_nodes_view(const xml_flat_document* document, xml_node_id first) : document_(document), first_(first) {}
+
+        iterator begin() const { return {document_, first_}; }
+        iterator end() const { return {document_, xml_null_node_id}; }
+        bool empty() const { return first_ == xml_null_node_id; }
+        size_t size() const { return std::distance(begin(), end()); }
+        xml_node_view front() const;
+
+    private:
+        const xml_flat_document* document_;
+        xml_node_id first_;
+    };
+
+    /**
+     * A reference to a node of xml_flat_document, which reads the same as xml_node.
+     * Valid while the document is alive.
+     */
+    class xml_node_view {
+    public:
+        xml_node_view() : document_(nullptr), id_(xml_null_node_id) {}
+        xml_node_view(const xml_flat_document* document, xml_node_id id) : document_(document), id_(id) {}
+
+        explicit operator bool() const noexcept { return id_ != xml_null_node_id; }
+        xml_node_id id() const noexcept { return id_; }
+
+        xml_node_view parent() const;
+        std::string_view name() const;
+        xml_attributes_view attributes() const;
+        std::string_view value() const;
+        xml_nodes_view nodes() const;
+
+        std::string inner_text() const noexcept;
+
+        /**
+         * Appends the value and the inner texts of the children to `out`, without a string per node
+         */
+        void append_inner_text(std::string& out) const;
+
+    private:
+        const xml_flat_node& node() const;
+
+        const xml_flat_document* document_;
+        xml_node_id id_;
+    };
+
+    /**
+     * A document whose nodes, attributes and strings are stored in three flat arrays.
+     *
+     * The number of heap allocations grows with log(size) instead of with the number of nodes,
+     * and the whole tree is freed at once. Nodes are stored in the document order.
+     *
+     * A document made by parse_xml_view() refers the input as `source` instead of copying it:
+     * - the input must outlive the document and every view into it;
+     * - names and raw texts are slices of the input, and only the strings containing "&" are unescaped,
+     *   on the first access, into `unescaped_strings`;
+     * - so const access is not thread-safe until every escaped string has been read once.
+     */
+    struct xml_flat_document {
+        std::string version;
+        std::map<std::string, std::string> attributes;
+
+        std::vector<xml_flat_node> nodes;
+        std::vector<xml_flat_attribute> node_attributes;
+        std::string strings;
+
+        std::string_view source;
+        std::shared_ptr<const xml_mapped_file> source_file;    // keeps the source alive, made by parse_xml_view_file()
+        mutable std::unordered_map<uint32_t, std::string> unescaped_strings;   // keyed by the offset in the source
+
+        /**
+         * The first node at the top level, same as xml_document::root_node
+         */
+        xml_node_view root_node() const {
+            auto id = nodes.empty() ? xml_null_node_id : 0;
+            while (id != xml_null_node_id && xml_node_view(this, id).name() == "#text") {
+                id = nodes[id].next_sibling;
+            }
+            return {this, id};
+        }
+
+        std::string_view string(uint32_t offset, uint32_t size) const;
+
+        std::string description() const noexcept;
+    };
+
+    /**
+     * Copies the strings of the text into the document
+     */
+    extern xml_flat_document parse_xml_flat(std::string_view text);
+
+    /**
+     * Same as parse_xml_flat(), but into `document` over its previous contents, reusing the capacity of its arrays.
+     * On an error, `document` is left partially built.
+     */
+    extern void parse_xml_flat(std::string_view text, xml_flat_document& document);
+
+    /**
+     * Refers the strings of the text from the document without copying; the text must outlive the document.
+     * The text may be a memory-mapped buffer; see parse_xml_view_file().
+     */
+    extern xml_flat_document parse_xml_view(std::string_view text);
+
+    /**
+     * Parses the text in place, destroying it, for the most throughput; nothing of the text is copied or allocated per string.
+     *
+     * Same as parse_xml_view(), but the entities are unescaped and the texts joined over comments and CDATA sections
+     * in the text itself, and every name, key and value is followed by "\0" there, so `data()` of it is a C string.
+     * The text must outlive the document; the bytes between the strings are left undefined.
+     * On an error, the same xml_error as parse_xml() is thrown, and the text is left partially rewritten.
+     */
+    extern xml_flat_document parse_xml_in_situ(char* text, size_t size);
+
+    inline xml_flat_document parse_xml_in_situ(std::string& text) {
+        return parse_xml_in_situ(&text[0], text.size());
+    }
+
+    /**
+     * Maps the file, and refers it from the document same as parse_xml_view(); the document owns the mapping.
+     * The bytes of the file are never copied, except strings to be unescaped or joined.
+     *
+     * @throw std::system_error if the file can not be read
+     */
+    extern xml_flat_document parse_xml_view_file(const std::string& path);
+
+}
+
+#endif /* xml_flat_document_h */
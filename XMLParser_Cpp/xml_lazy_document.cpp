@@ -0,0 +1,358 @@
+//
+//  xml_lazy_document.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_lazy_document.h"
+#include "xml_parser.h"
+#include "xml_mapped_file.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace bbxml;
+
+namespace {
+    const char text_node_name[] = "#text";
+
+    /**
+     * Builds the index of xml_lazy_document; an entry per element, and one per text between two tags.
+     *
+     * The texts and the attribute values are validated, as parse_xml() does, so that decoding them later never fails.
+     * A text is a range of the source from its first part to its last one, over the comments and the CDATA sections between them;
+     * a text after the last tag is dropped, same as parse_xml().
+     */
+    struct xml_lazy_builder {
+        xml_lazy_document& document;
+        std::vector<xml_node_id> open_elements;
+        bool is_in_text = false;    // the last entry is the text before the next tag
+
+        explicit xml_lazy_builder(xml_lazy_document& document) : document(document) {}
+
+        uint32_t offset_of(const char* itr) const {
+            return static_cast<uint32_t>(itr - document.source.data());
+        }
+
+        xml_node_id current_element() const {
+            return open_elements.empty() ? xml_null_node_id : open_elements.back();
+        }
+
+        /**
+         * Adds a part of a text, which is escaped if it has to be decoded
+         */
+        void append_text(const char* first, const char* last, bool is_escaped) {
+            if (!is_in_text) {
+                const auto id = static_cast<xml_node_id>(document.entries.size());
+                document.entries.push_back({offset_of(first), 0, 0, current_element(), id + 1});
+                is_in_text = true;
+            }
+            else {
+                is_escaped = true;  // over a comment or a CDATA section
+            }
+            auto& entry = document.entries.back();
+            entry.size = (offset_of(last) - entry.first) | (entry.size & xml_lazy_entry_escaped) | xml_lazy_entry_text | (is_escaped ? xml_lazy_entry_escaped : 0);
+        }
+
+        void declaration(const char* version_first, const char* version_last, const std::vector<bb::xml_attribute_span>& attributes) {
+            document.version.assign(version_first, version_last);
+            for (const auto& attribute : attributes) {
+                document.attributes[std::string(attribute.key_first, attribute.key_last)] = bb::unescape_xml_attribute_value(attribute);
+            }
+        }
+
+        void text(const char* first, const char* last) {
+            append_text(first, last, bb::validate_xml_inner_text(first, last));
+        }
+
+        /**
+         * With "<![CDATA[" and "]]>"
+         */
+        void cdata(const char* first, const char* last) {
+            append_text(first - 9, last + 3, true);
+        }
+
+        /**
+         * In a text, with "<!--" and "-->"; a comment before any text is not a part of it
+         */
+        void comment(const char* first, const char* last) {
+            if (is_in_text) {
+                append_text(first - 4, last + 3, true);
+            }
+        }
+
+        /**
+         * Ends the text before a tag; a text of only spaces without "&" is dropped at once, as it never makes a node
+         */
+        void end_text() {
+            if (is_in_text) {
+                const auto& entry = document.entries.back();
+                if ((entry.size & xml_lazy_entry_escaped) == 0) {
+                    const auto first = document.source.data() + entry.first;
+                    if (bb::is_space(first, first + (entry.size & xml_lazy_entry_size_mask))) {
+                        document.entries.pop_back();
+                    }
+                }
+                is_in_text = false;
+            }
+        }
+
+        void start_element(const char* name_first, const char* name_last, const std::vector<bb::xml_attribute_span>& attributes, bool is_independent) {
+            for (const auto& attribute : attributes) {
+                bb::validate_xml_attribute_value(attribute);
+            }
+            end_text();
+
+            const auto id = static_cast<xml_node_id>(document.entries.size());
+            const auto attributes_last = attributes.empty() ? name_last : attributes.back().value_last + 1;     // after the closing quote
+            document.entries.push_back({offset_of(name_first), static_cast<uint32_t>(name_last - name_first), offset_of(attributes_last), current_element(), id + 1});
+            if (!is_independent) {
+                open_elements.push_back(id);
+            }
+        }
+
+        void end_element(const char*, const char*) {
+            end_text();
+            document.entries[open_elements.back()].next = static_cast<xml_node_id>(document.entries.size());
+            open_elements.pop_back();
+        }
+
+        /**
+         * Drops the text after the last tag, and closes the elements left open
+         */
+        void finish() {
+            if (is_in_text) {
+                document.entries.pop_back();
+            }
+            for (auto id : open_elements) {
+                document.entries[id].next = static_cast<xml_node_id>(document.entries.size());
+            }
+        }
+    };
+
+    inline void parse_xml_lazy(std::string_view text, const xml_parse_limits& limits, xml_lazy_document& document) {
+        if (text.size() > xml_lazy_entry_size_mask) {
+            throw std::length_error("xml_lazy_document supports up to 1 GiB");
+        }
+        auto cursor = bb::make_char_cursor(text.data(), text.data() + text.size());
+        document.source = text;
+        xml_lazy_builder builder{document};
+        bb::parse_xml(cursor, builder, limits);
+        builder.finish();
+    }
+
+    const xml_lazy_attributes no_attributes;
+    const std::vector<xml_node_id> no_nodes;
+}
+
+xml_lazy_document bbxml::parse_xml_lazy(std::string_view text, const xml_parse_limits& limits) {
+    xml_lazy_document document;
+    ::parse_xml_lazy(text, limits, document);
+    return document;
+}
+
+xml_lazy_document bbxml::parse_xml_lazy_file(const std::string& path, const xml_parse_limits& limits) {
+    auto file = std::make_shared<const xml_mapped_file>(path);
+    xml_lazy_document document;
+    ::parse_xml_lazy(file->data(), limits, document);
+    document.source_file = std::move(file);
+    return document;
+}
+
+xml_lazy_node xml_lazy_document::root_node() const {
+    const auto& top = materialize_nodes(xml_null_node_id);
+    const auto root = std::find_if(top.nodes.begin(), top.nodes.end(), [&](xml_node_id id) { return (entries[id].size & xml_lazy_entry_text) == 0; });
+    return {this, root != top.nodes.end() ? *root : xml_null_node_id};
+}
+
+/**
+ * Walks the entries of the subtree by `next`; a text of only spaces is dropped, and a single text is folded into the value
+ */
+const xml_lazy_document::element& xml_lazy_document::materialize_nodes(xml_node_id id) const {
+    auto& element = elements_[id];
+    if (element.has_nodes) {
+        return element;
+    }
+    const auto last = id == xml_null_node_id ? static_cast<xml_node_id>(entries.size()) : entries[id].next;
+    for (auto child = id == xml_null_node_id ? 0 : id + 1; child < last; child = entries[child].next) {
+        if ((entries[child].size & xml_lazy_entry_text) == 0) {
+            element.nodes.push_back(child);
+        }
+        else if (const auto value = text(child); !bb::is_space(value.data(), value.data() + value.size())) {
+            element.nodes.push_back(child);
+        }
+    }
+    if (id != xml_null_node_id && element.nodes.size() == 1 && (entries[element.nodes.front()].size & xml_lazy_entry_text) != 0) {
+        element.value = text(element.nodes.front());
+        element.nodes.clear();
+    }
+    element.has_nodes = true;
+    return element;
+}
+
+/**
+ * Scans the attributes of the start tag again; they have been validated by the first pass
+ */
+const xml_lazy_document::element& xml_lazy_document::materialize_attributes(xml_node_id id) const {
+    auto& element = elements_[id];
+    if (element.has_attributes) {
+        return element;
+    }
+    const auto& entry = entries[id];
+    std::vector<bb::xml_attribute_span> spans;
+    bb::scan_xml_attributes(source.data() + entry.first + entry.size, source.data() + entry.attributes_last, spans);
+    auto& attributes = element.attributes.attributes_;
+    for (const auto& span : spans) {
+        std::string_view value(span.value_first, span.value_last - span.value_first);
+        if (value.find('&') != std::string_view::npos) {
+            auto& unescaped = unescaped_strings_[offset_of(span.value_first)];
+            if (unescaped.empty()) {
+                bb::append_unescaped_xml_attribute_value(span, unescaped);
+            }
+            value = unescaped;
+        }
+        const auto key = std::string_view(span.key_first, span.key_last - span.key_first);
+        auto duplicated = std::find_if(attributes.begin(), attributes.end(), [&](const xml_lazy_attributes::value_type& attribute) { return attribute.first == key; });
+        if (duplicated != attributes.end()) {  // The last one wins, same as std::map
+            duplicated->second = value;
+        }
+        else {
+            attributes.emplace_back(key, value);
+        }
+    }
+    element.has_attributes = true;
+    return element;
+}
+
+/**
+ * The value of a text entry; a slice of the source, or the parts joined and decoded without the comments
+ */
+std::string_view xml_lazy_document::text(xml_node_id id) const {
+    const auto& entry = entries[id];
+    const auto first = source.data() + entry.first;
+    const auto last = first + (entry.size & xml_lazy_entry_size_mask);
+    if ((entry.size & xml_lazy_entry_escaped) == 0) {
+        return {first, static_cast<size_t>(last - first)};
+    }
+    auto itr = unescaped_strings_.find(entry.first);
+    if (itr != unescaped_strings_.end()) {
+        return itr->second;
+    }
+
+    std::string value;
+    for (auto part = first; part < last; ) {
+        const auto lt = bb::find(part, last, '<');
+        bb::append_unescaped_xml_inner_text(part, lt, value);
+        if (lt == last) {
+            break;
+        }
+        if (bb::starts_with(lt, last, "<!--")) {
+            part = bb::search(lt + 4, last, "--") + 3;
+        }
+        else {
+            const auto cdata_last = bb::search(lt + 9, last, "]]>");
+            value.append(lt + 9, cdata_last);
+            part = cdata_last + 3;
+        }
+    }
+    return unescaped_strings_.emplace(entry.first, std::move(value)).first->second;
+}
+
+uint32_t xml_lazy_document::offset_of(const char* itr) const {
+    return static_cast<uint32_t>(itr - source.data());
+}
+
+
+xml_lazy_attributes::iterator xml_lazy_attributes::find(std::string_view key) const {
+    return std::find_if(begin(), end(), [&](const value_type& attribute) { return attribute.first == key; });
+}
+
+std::string_view xml_lazy_attributes::at(std::string_view key) const {
+    auto itr = find(key);
+    if (itr == end()) {
+        throw std::out_of_range("xml_lazy_attributes::at");
+    }
+    return itr->second;
+}
+
+xml_lazy_node xml_lazy_nodes::iterator::operator*() const {
+    return {document_, *id_};
+}
+
+xml_lazy_node xml_lazy_nodes::front() const {
+    return {document_, ids_->front()};
+}
+
+xml_lazy_node xml_lazy_nodes::operator[](size_t index) const {
+    return {document_, (*ids_)[index]};
+}
+
+xml_lazy_node xml_lazy_node::parent() const {
+    return {document_, document_->entries[id_].parent};
+}
+
+std::string_view xml_lazy_node::name() const {
+    const auto& entry = document_->entries[id_];
+    if ((entry.size & xml_lazy_entry_text) != 0) {
+        return text_node_name;
+    }
+    return document_->source.substr(entry.first, entry.size);
+}
+
+const xml_lazy_attributes& xml_lazy_node::attributes() const {
+    if ((document_->entries[id_].size & xml_lazy_entry_text) != 0) {
+        return no_attributes;
+    }
+    return document_->materialize_attributes(id_).attributes;
+}
+
+std::string_view xml_lazy_node::value() const {
+    if ((document_->entries[id_].size & xml_lazy_entry_text) != 0) {
+        return document_->text(id_);
+    }
+    return document_->materialize_nodes(id_).value;
+}
+
+xml_lazy_nodes xml_lazy_node::nodes() const {
+    if ((document_->entries[id_].size & xml_lazy_entry_text) != 0) {
+        return {document_, no_nodes};
+    }
+    return {document_, document_->materialize_nodes(id_).nodes};
+}
+
+std::string xml_lazy_node::inner_text() const {
+    std::string text;
+    append_inner_text(text);
+    return text;
+}
+
+void xml_lazy_node::append_inner_text(std::string& out) const {
+    out += value();
+    for (auto node : nodes()) {
+        node.append_inner_text(out);
+    }
+}
+
+namespace {
+	inline void describe(const xml_lazy_node& node, size_t indent, std::string& out) {
+		out.append(indent, ' ').append("+ ").append(node.name());
+		for (auto attribute : node.attributes()) {
+			out.append(", ").append(attribute.first).append("=").append(attribute.second);
+		}
+		if (!node.value().empty()) {
+			out.append(", ").append(node.value());
+		}
+		out += '\n';
+		for (auto child : node.nodes()) {
+			describe(child, indent + 1, out);
+		}
+	}
+}
+
+std::string xml_lazy_document::description() const noexcept {
+	std::string out = "XML version=" + version + "\n";
+	if (auto root = root_node()) {
+		describe(root, 0, out);
+	}
+	return out;
+}
@@ -0,0 +1,226 @@
+//
+//  xml_lazy_document.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_lazy_document_h
+#define xml_lazy_document_h
+
+#include "xml_document.h"
+#include "xml_flat_document.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace bbxml {
+
+    /**
+     * Flags on the size of xml_lazy_entry
+     */
+    constexpr uint32_t xml_lazy_entry_text = 0x80000000;        // a text between two tags, or else an element
+    constexpr uint32_t xml_lazy_entry_escaped = 0x40000000;     // a text with "&", CDATA sections or comments, decoded on the first access
+    constexpr uint32_t xml_lazy_entry_size_mask = 0x3FFFFFFF;
+
+    /**
+     * An entry of the structural index of xml_lazy_document; an element, or the raw text between two tags.
+     *
+     * Entries are in the document order, and an element is followed by its subtree; `next` is the entry after it,
+     * so the children of an element are walked by `next` from the entry after it.
+     */
+    struct xml_lazy_entry {
+        uint32_t first;             // the offset of the name, or of the text, in the source
+        uint32_t size;              // the size of the name or of the text, with the flags
+        uint32_t attributes_last;   // of an element, the end of the attributes of the start tag, which begin at the end of the name
+        xml_node_id parent;
+        xml_node_id next;
+    };
+
+    class xml_lazy_document;
+    class xml_lazy_node;
+
+    /**
+     * Attributes of xml_lazy_node in the document order, the last one of a key wins same as std::map
+     */
+    class xml_lazy_attributes {
+    public:
+        typedef std::pair<std::string_view, std::string_view> value_type;
+        typedef std::vector<value_type>::const_iterator iterator;
+
+        iterator begin() const { return attributes_.begin(); }
+        iterator end() const { return attributes_.end(); }
+        size_t size() const { return attributes_.size(); }
+        bool empty() const { return attributes_.empty(); }
+        size_t count(std::string_view key) const { return find(key) != end() ? 1 : 0; }
+        iterator find(std::string_view key) const;
+
+        /**
+         * @throw std::out_of_range same as std::map::at()
+         */
+        std::string_view at(std::string_view key) const;
+
+    private:
+        friend class xml_lazy_document;
+
+        std::vector<value_type> attributes_;
+    };
+
+    /**
+     * Children of xml_lazy_node
+     */
+    class xml_lazy_nodes {
+    public:
+        class iterator {
+        public:
+            typedef std::random_access_iterator_tag iterator_category;
+            typedef xml_lazy_node value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const xml_lazy_node* pointer;
+            typedef xml_lazy_node reference;
+
+            iterator(const xml_lazy_document* document, const xml_node_id* id) : document_(document), id_(id) {}
+            xml_lazy_node operator*() const;
+            iterator& operator++() { ++id_; return *this; }
+            iterator operator++(int) { auto itr = *this; ++id_; return itr; }
+            difference_type operator-(const iterator& other) const { return id_ - other.id_; }
+            bool operator==(const iterator& other) const { return id_ == other.id_; }
+            bool operator!=(const iterator& other) const { return id_ != other.id_; }
+
+        private:
+            const xml_lazy_document* document_;
+            const xml_node_id* id_;
+        };
+
+        xml_lazy_nodes(const xml_lazy_document* document, const std::vector<xml_node_id>& ids) : document_(document), ids_(&ids) {}
+
+        iterator begin() const { return {document_, ids_->data()}; }
+        iterator end() const { return {document_, ids_->data() + ids_->size()}; }
+        size_t size() const { return ids_->size(); }
+        bool empty() const { return ids_->empty(); }
+        xml_lazy_node front() const;
+        xml_lazy_node operator[](size_t index) const;
+
+    private:
+        const xml_lazy_document* document_;
+        const std::vector<xml_node_id>* ids_;
+    };
+
+    /**
+     * A reference to a node of xml_lazy_document, which reads the same as xml_node.
+     *
+     * The name is a slice of the source; the attributes, the children and the value are materialized on the first access.
+     * Valid while the document is alive.
+     */
+    class xml_lazy_node {
+    public:
+        xml_lazy_node() : document_(nullptr), id_(xml_null_node_id) {}
+        xml_lazy_node(const xml_lazy_document* document, xml_node_id id) : document_(document), id_(id) {}
+
+        explicit operator bool() const noexcept { return id_ != xml_null_node_id; }
+        xml_node_id id() const noexcept { return id_; }
+
+        xml_lazy_node parent() const;
+        std::string_view name() const;
+        const xml_lazy_attributes& attributes() const;
+        std::string_view value() const;
+        xml_lazy_nodes nodes() const;
+
+        std::string inner_text() const;
+
+        /**
+         * Appends the value and the inner texts of the children to `out`, without a string per node
+         */
+        void append_inner_text(std::string& out) const;
+
+    private:
+        const xml_lazy_document* document_;
+        xml_node_id id_;
+    };
+
+    /**
+     * A document of parse_xml_lazy(); a structural index of the elements and the texts over the source,
+     * from which a node is materialized when it is read.
+     *
+     * The source is checked as a whole by the same tokenizer as parse_xml(), so an ill-formed document is rejected at once,
+     * but nothing is built but an entry per element and per text: no node, no attribute, no string.
+     * When only some branches are read, the rest costs the index only.
+     *
+     * The document refers the source same as parse_xml_view(); the source must outlive the document and every node of it.
+     * The materialized parts are cached in the document; even const access mutates the cache of the elements and the unescaped strings,
+     * so a document must not be shared across threads, even read-only.
+     */
+    class xml_lazy_document {
+    public:
+        xml_lazy_document() = default;
+        xml_lazy_document(const xml_lazy_document&) = delete;    // the cached views would refer the caches of the other
+        xml_lazy_document& operator=(const xml_lazy_document&) = delete;
+        xml_lazy_document(xml_lazy_document&&) = default;
+        xml_lazy_document& operator=(xml_lazy_document&&) = default;
+
+        std::string version;
+        std::map<std::string, std::string> attributes;
+
+        std::vector<xml_lazy_entry> entries;
+
+        std::string_view source;
+        std::shared_ptr<const xml_mapped_file> source_file;    // keeps the source alive, made by parse_xml_lazy_file()
+
+        /**
+         * The first node at the top level, same as xml_document::root_node
+         */
+        xml_lazy_node root_node() const;
+
+        /**
+         * The number of the elements materialized so far, for the top level too
+         */
+        size_t materialized_elements() const noexcept { return elements_.size(); }
+
+        std::string description() const noexcept;
+
+    private:
+        friend class xml_lazy_node;
+
+        struct element {
+            bool has_attributes = false;
+            bool has_nodes = false;
+            xml_lazy_attributes attributes;
+            std::vector<xml_node_id> nodes;
+            std::string_view value;
+        };
+
+        /**
+         * The element of `id`, with its children and its value; xml_null_node_id for the top level
+         */
+        const element& materialize_nodes(xml_node_id id) const;
+        const element& materialize_attributes(xml_node_id id) const;
+        std::string_view text(xml_node_id id) const;
+        uint32_t offset_of(const char* itr) const;
+
+        mutable std::unordered_map<xml_node_id, element> elements_;
+        mutable std::unordered_map<uint32_t, std::string> unescaped_strings_;  // keyed by the offset in the source
+    };
+
+    /**
+     * Indexes the text into xml_lazy_document, which refers it; the text must outlive the document.
+     *
+     * @throw xml_error same as parse_xml()
+     * @throw std::length_error if the text is over 1 GiB
+     */
+    extern xml_lazy_document parse_xml_lazy(std::string_view text, const xml_parse_limits& limits = xml_parse_limits());
+
+    /**
+     * Maps the file, and indexes it same as parse_xml_lazy(); the document owns the mapping
+     *
+     * @throw std::system_error if the file can not be read
+     */
+    extern xml_lazy_document parse_xml_lazy_file(const std::string& path, const xml_parse_limits& limits = xml_parse_limits());
+
+}
+
+#endif /* xml_lazy_document_h */
@@ -0,0 +1,108 @@
+//
+//  xml_mapped_file.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_mapped_file.h"
+
+#include <system_error>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+using namespace bbxml;
+
+#if defined(_WIN32)
+
+namespace {
+    [[noreturn]] inline void throw_last_error(const std::string& what) {
+        throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), what);
+    }
+}
+
+xml_mapped_file::xml_mapped_file(const std::string& path) : data_(nullptr), size_(0) {
+    auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw_last_error("Can not open \"" + path + "\"");
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw_last_error("Can not get the size of \"" + path + "\"");
+    }
+    if (size.QuadPart == 0) {   // An empty file can not be mapped
+        CloseHandle(file);
+        return;
+    }
+    auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        throw_last_error("Can not map \"" + path + "\"");
+    }
+    auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);   // The view keeps the mapping
+    if (view == nullptr) {
+        throw_last_error("Can not map \"" + path + "\"");
+    }
+    data_ = static_cast<const char*>(view);
+    size_ = static_cast<size_t>(size.QuadPart);
+}
+
+xml_mapped_file::~xml_mapped_file() {
+    if (data_ != nullptr) {
+        UnmapViewOfFile(data_);
+    }
+}
+
+#else
+
+namespace {
+    [[noreturn]] inline void throw_errno(const std::string& what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+}
+
+xml_mapped_file::xml_mapped_file(const std::string& path) : data_(nullptr), size_(0) {
+    auto file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        throw_errno("Can not open \"" + path + "\"");
+    }
+    struct stat status;
+    if (fstat(file, &status) != 0) {
+        auto error = errno;
+        close(file);
+        throw std::system_error(error, std::generic_category(), "Can not get the size of \"" + path + "\"");
+    }
+    if (status.st_size == 0) {  // An empty file can not be mapped
+        close(file);
+        return;
+    }
+    auto size = static_cast<size_t>(status.st_size);
+    auto view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    auto error = errno;
+    close(file);    // The mapping keeps the file
+    if (view == MAP_FAILED) {
+        throw std::system_error(error, std::generic_category(), "Can not map \"" + path + "\"");
+    }
+    // Only a hint; the read-ahead is widened and the pages behind are freed early
+    madvise(view, size, MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(view);
+    size_ = size;
+}
+
+xml_mapped_file::~xml_mapped_file() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+#endif
@@ -0,0 +1,41 @@
+//
+//  xml_mapped_file.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_mapped_file_h
+#define xml_mapped_file_h
+
+#include <string>
+#include <string_view>
+
+namespace bbxml {
+
+    /**
+     * A whole file mapped read-only into memory, with a hint of the sequential access
+     *
+     * The pages are read on demand by the OS; nothing is copied into the heap.
+     */
+    class xml_mapped_file {
+    public:
+        /**
+         * @throw std::system_error if the file can not be opened or mapped
+         */
+        explicit xml_mapped_file(const std::string& path);
+        ~xml_mapped_file();
+
+        xml_mapped_file(const xml_mapped_file&) = delete;
+        xml_mapped_file& operator=(const xml_mapped_file&) = delete;
+
+        std::string_view data() const noexcept { return {data_, size_}; }
+        size_t size() const noexcept { return size_; }
+
+    private:
+        const char* data_;
+        size_t size_;
+    };
+
+}
+
+#endif /* xml_mapped_file_h */
@@ -0,0 +1,359 @@
+//
+//  xml_node_builder.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_node_builder_h
+#define xml_node_builder_h
+
+#include "xml_document.h"
+#include "xml_parser.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include <string_view>
+
+namespace bb {
+
+    enum class xml_parse_phase {
+        tokenize,
+        attributes,
+        unescape,
+        build,
+    };
+
+    /**
+     * Stats of xml_node_builder which collects nothing; every call is inlined away
+     */
+    struct xml_no_stats {
+        struct scope {
+            scope(xml_no_stats&, xml_parse_phase) noexcept {}
+        };
+
+        void count_node() noexcept {}
+        void count_comment() noexcept {}
+        void count_cdata() noexcept {}
+        void count_entities(const char*, const char*) noexcept {}
+        void count_attributes(const std::vector<xml_attribute_span>&, const bbxml::xml_attributes&) noexcept {}
+        void count_string(const std::string&) noexcept {}
+        void count_push(const std::vector<std::shared_ptr<bbxml::xml_node>>&) noexcept {}
+    };
+
+    /**
+     * Stats of xml_node_builder which adds the counts and the times into bbxml::xml_parse_stats.
+     *
+     * The time is charged to one phase at a time; a scope switches the phase, and switches it back at the end,
+     * so the time out of the builder, the tokenizer's, is charged to `tokenize`.
+     * The allocations are estimated from the sizes and the capacities of the containers of the tree.
+     */
+    struct xml_stats_collector {
+        typedef std::chrono::steady_clock clock;
+
+        struct scope {
+            scope(xml_stats_collector& stats, xml_parse_phase phase) : stats(stats), outer(stats.phase) {
+                stats.switch_to(phase);
+            }
+            ~scope() {
+                stats.switch_to(outer);
+            }
+
+            xml_stats_collector& stats;
+            xml_parse_phase outer;
+        };
+
+        explicit xml_stats_collector(bbxml::xml_parse_stats& stats) : stats(&stats) {}
+
+        void switch_to(xml_parse_phase next) {
+            if (!stats->measures_time) {
+                return;
+            }
+            const auto now = clock::now();
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - since);
+            switch (phase) {
+                case xml_parse_phase::tokenize: stats->tokenize_time += elapsed; break;
+                case xml_parse_phase::attributes: stats->attributes_time += elapsed; break;
+                case xml_parse_phase::unescape: stats->unescape_time += elapsed; break;
+                case xml_parse_phase::build: stats->build_time += elapsed; break;
+            }
+            since = now;
+            phase = next;
+        }
+
+        void count_node() {
+            stats->nodes += 1;
+            stats->allocations += 1;    // the node and its control block by std::make_shared
+        }
+
+        void count_comment() {
+            stats->comments += 1;
+        }
+
+        void count_cdata() {
+            stats->cdata_sections += 1;
+        }
+
+        /**
+         * Every "&" of a validated span is a reference
+         */
+        void count_entities(const char* first, const char* last) {
+            stats->entities += std::count(first, last, '&');
+        }
+
+        void count_attributes(const std::vector<xml_attribute_span>& spans, const bbxml::xml_attributes& attributes) {
+            stats->attributes += spans.size();
+            for (const auto& span : spans) {
+                count_entities(span.value_first, span.value_last);
+            }
+            for (const auto& attribute : attributes) {
+                count_string(attribute.second);
+            }
+            for (size_t capacity = bbxml::xml_attributes::inline_capacity; capacity < attributes.size(); capacity *= 2) {
+                stats->allocations += 1;
+            }
+        }
+
+        /**
+         * A string longer than the inline buffer of std::string is on the heap
+         */
+        void count_string(const std::string& string) {
+            static const size_t inline_capacity = std::string().capacity();
+            if (string.capacity() > inline_capacity) {
+                stats->allocations += 1;
+            }
+        }
+
+        /**
+         * Called before a node is pushed to the list
+         */
+        void count_push(const std::vector<std::shared_ptr<bbxml::xml_node>>& nodes) {
+            if (nodes.size() == nodes.capacity()) {
+                stats->allocations += 1;
+            }
+        }
+
+        /**
+         * Charges the time since the last switch
+         */
+        void finish() {
+            switch_to(phase);
+        }
+
+        bbxml::xml_parse_stats* stats;
+        xml_parse_phase phase = xml_parse_phase::tokenize;
+        clock::time_point since = clock::now();
+    };
+
+    /**
+     * e.g.
+     * R"( key1="value1" key2='value2')" => { { key1, value1 }, { key2, value2 } }
+     *
+     * The values are kept as they are in the input without bbxml::xml_parse_decode_entities.
+     */
+    template <unsigned Flags = bbxml::xml_parse_default>
+    inline bbxml::xml_attributes make_xml_attributes(const std::vector<xml_attribute_span>& attributes, bbxml::xml_name_table& names) {
+        bbxml::xml_attributes map;
+        for (const auto& attribute : attributes) {
+            const auto key = names.intern(std::string_view(attribute.key_first, attribute.key_last - attribute.key_first));
+            if constexpr ((Flags & bbxml::xml_parse_decode_entities) != 0) {
+                map.set(key, unescape_xml_attribute_value(attribute));
+            }
+            else {
+                map.set(key, std::string(attribute.value_first, attribute.value_last));
+            }
+        }
+        return map;
+    }
+
+    /**
+     * Builds a tree of xml_node, whose names are interned in a table of the builder
+     *
+     * When it builds a chunk in the middle of a document, `top_node` holds the nodes at the top level of the chunk,
+     * and the end tags of the elements opened before the chunk are kept in `outer_end_elements` to be matched later.
+     *
+     * `Stats` is told every node, attribute and phase; xml_no_stats for nothing, or xml_stats_collector.
+     * `Flags` are bbxml::xml_parse_flags.
+     */
+    template <class Stats, unsigned Flags = bbxml::xml_parse_default>
+    struct basic_xml_node_builder {
+        static constexpr bool validates_tag_names = (Flags & bbxml::xml_parse_validate_names) != 0;
+
+        struct outer_end_element {
+            size_t top_nodes_size;      // the number of the nodes in `top_node` before the end tag
+            std::string_view name;
+        };
+
+        std::string version;
+        bbxml::xml_attributes attributes;
+        std::shared_ptr<bbxml::xml_name_table> names = std::make_shared<bbxml::xml_name_table>();
+        bbxml::xml_name text_name = names->intern("#text");
+        std::shared_ptr<bbxml::xml_node> top_node = std::make_shared<bbxml::xml_node>();
+        std::shared_ptr<bbxml::xml_node> current_node = top_node;
+        std::string inner_text_before_tag;
+        std::vector<outer_end_element> outer_end_elements;
+        Stats stats;
+
+        explicit basic_xml_node_builder(Stats stats = Stats()) : stats(stats) {}
+
+        void declaration(const char* version_first, const char* version_last, const std::vector<xml_attribute_span>& attributes) {
+            typename Stats::scope scope(stats, xml_parse_phase::attributes);
+            this->version.assign(version_first, version_last);
+            this->attributes = make_xml_attributes<Flags>(attributes, *names);
+            stats.count_attributes(attributes, this->attributes);
+        }
+
+        void text(const char* first, const char* last) {
+            typename Stats::scope scope(stats, xml_parse_phase::unescape);
+            if constexpr ((Flags & bbxml::xml_parse_decode_entities) != 0) {
+                append_unescaped_xml_inner_text(first, last, inner_text_before_tag);
+                stats.count_entities(first, last);
+            }
+            else {
+                inner_text_before_tag.append(first, last);
+            }
+        }
+
+        void cdata(const char* first, const char* last) {
+            typename Stats::scope scope(stats, xml_parse_phase::build);
+            if constexpr ((Flags & bbxml::xml_parse_keep_cdata) != 0) {
+                flush_text();
+                append_node(current_node, names->intern("#cdata-section"), std::string(first, last));
+            }
+            else {
+                inner_text_before_tag.append(first, last);
+            }
+            stats.count_cdata();
+        }
+
+        void comment(const char* first, const char* last) {
+            if constexpr ((Flags & bbxml::xml_parse_keep_comments) != 0) {
+                typename Stats::scope scope(stats, xml_parse_phase::build);
+                flush_text();
+                append_node(current_node, names->intern("#comment"), std::string(first, last));
+            }
+            stats.count_comment();
+        }
+
+        void start_element(const char* name_first, const char* name_last, const std::vector<xml_attribute_span>& attributes, bool is_independent) {
+            typename Stats::scope scope(stats, xml_parse_phase::build);
+            auto node = std::make_shared<bbxml::xml_node>();
+            node->parent = current_node;
+            node->name = names->intern(std::string_view(name_first, name_last - name_first));
+            {
+                typename Stats::scope scope(stats, xml_parse_phase::attributes);
+                node->attributes = make_xml_attributes<Flags>(attributes, *names);
+                stats.count_attributes(attributes, node->attributes);
+            }
+            node->names = names;
+            stats.count_node();
+
+            flush_text();
+            stats.count_push(current_node->nodes);
+            current_node->nodes.push_back(node);
+            if (!is_independent) {
+                current_node = std::move(node);
+            }
+        }
+
+        void end_element(const char* name_first, const char* name_last) {
+            typename Stats::scope scope(stats, xml_parse_phase::build);
+            flush_text();
+            if (current_node == top_node) {     // Only in a chunk
+                outer_end_elements.push_back({top_node->nodes.size(), std::string_view(name_first, name_last - name_first)});
+                return;
+            }
+            if constexpr ((Flags & bbxml::xml_parse_fold_texts) != 0) {
+                fold_value(*current_node);
+            }
+            current_node = current_node->parent.lock();
+            assert(current_node != nullptr);
+        }
+
+        void flush_text() {
+            flush_text(inner_text_before_tag, current_node);
+        }
+
+        /**
+         * Appends the text to the node as a text node unless it is only spaces, and clears it
+         */
+        void flush_text(std::string& text, const std::shared_ptr<bbxml::xml_node>& node) {
+            if constexpr ((Flags & bbxml::xml_parse_trim_texts) != 0) {
+                const auto first = static_cast<size_t>(scan_non_space(text.data(), text.data() + text.size()) - text.data());
+                auto last = text.size();
+                while (last > first && is_space(text[last - 1])) {
+                    --last;
+                }
+                text.erase(last);
+                text.erase(0, first);
+            }
+            if constexpr ((Flags & bbxml::xml_parse_skip_space_texts) != 0) {
+                if (!is_space(text.data(), text.data() + text.size())) {
+                    append_node(node, text_name, std::move(text));
+                }
+            }
+            else if (!text.empty()) {
+                append_node(node, text_name, std::move(text));
+            }
+            text.clear();
+        }
+
+        /**
+         * Appends a node of a text, a CDATA section or a comment
+         */
+        void append_node(const std::shared_ptr<bbxml::xml_node>& node, bbxml::xml_name name, std::string value) {
+            auto text_node = std::make_shared<bbxml::xml_node>();
+            text_node->parent = node;
+            text_node->name = name;
+            text_node->names = names;
+            text_node->value = std::move(value);
+            stats.count_node();
+            stats.count_string(text_node->value);
+            stats.count_push(node->nodes);
+            node->nodes.push_back(text_node);
+        }
+
+        /**
+         * Folds a single text node of the closed element into its value
+         */
+        static void fold_value(bbxml::xml_node& node) {
+            if (node.nodes.size() == 1 && node.nodes[0]->name == std::string_view("#text")) {
+                node.value = std::move(node.nodes[0]->value);
+                node.nodes.clear();
+            }
+        }
+    };
+
+    typedef basic_xml_node_builder<xml_no_stats> xml_node_builder;
+
+    /**
+     * The first element at the top level, after the comments and the texts kept around it; null if none
+     */
+    inline std::shared_ptr<bbxml::xml_node> find_xml_root_node(const bbxml::xml_node& top_node) {
+        for (const auto& node : top_node.nodes) {
+            if (node->name != "#comment" && node->name != "#text" && node->name != "#cdata-section") {
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Parses [first, last) with a builder of basic_xml_node_builder into a document
+     */
+    template <class Builder>
+    inline bbxml::xml_document build_xml_document(const char* first, const char* last, Builder& builder, const bbxml::xml_parse_limits& limits = bbxml::xml_parse_limits()) {
+        auto cursor = make_char_cursor(first, last);
+        parse_xml(cursor, builder, limits);
+
+        // XML document has exactly one single root element.
+        auto root_node = find_xml_root_node(*builder.top_node);
+        if (root_node) {
+            root_node->parent.reset();
+        }
+        return bbxml::xml_document { builder.version, std::move(builder.attributes), root_node, builder.names };
+    }
+
+}
+
+#endif /* xml_node_builder_h */
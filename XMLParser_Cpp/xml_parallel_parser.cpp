@@ -0,0 +1,227 @@
+//
+//  xml_parallel_parser.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_parallel_parser.h"
+#include "xml_node_builder.h"
+
+#include <algorithm>
+#include <exception>
+
+using namespace bbxml;
+
+namespace {
+    constexpr size_t min_chunk_size = 256 * 1024;
+
+    /**
+     * A part of the document, [first, limit), parsed by a worker
+     */
+    struct xml_chunk {
+        const char* first;
+        const char* limit;              // the head of the next chunk, or the end of the document
+        const char* last = nullptr;     // where parsing stopped; `limit` if the chunk ended just before the tag of the cut
+        bb::xml_node_builder builder;
+        std::exception_ptr error;
+        size_t nodes = 0;               // the nodes in the chunk
+        size_t deepest = 0;             // the depth of the deepest element from the head of the chunk
+
+        xml_chunk(const char* first, const char* limit) : first(first), limit(limit) {}
+    };
+
+    inline const char* find_cut(const char* itr, const char* end);
+    inline void parse_chunk(const char* first, const char* last, xml_chunk& chunk, const xml_parse_limits& limits);
+    inline bool join_chunk(xml_chunk& chunk, std::vector<std::shared_ptr<xml_node>>& open_nodes);
+    inline xml_document parse_xml_again(const char* first, const char* last, const char* from, const std::vector<std::shared_ptr<xml_node>>& open_nodes, size_t nodes, const xml_parse_limits& limits);
+}
+
+xml_document bbxml::parse_xml_parallel(const char* first, const char* last, xml_thread_pool& pool, size_t chunk_size, const xml_parse_limits& limits) {
+    const auto size = static_cast<size_t>(last - first);
+    if (chunk_size == 0) {
+        chunk_size = std::max(size / (pool.size() * 4), min_chunk_size);
+    }
+    if (pool.size() < 2 || size < chunk_size * 2) {
+        return parse_xml(first, last, limits);
+    }
+
+    std::vector<xml_chunk> chunks;
+    for (auto chunk_first = first; chunk_first < last; ) {
+        auto cut = (static_cast<size_t>(last - chunk_first) > chunk_size) ? find_cut(chunk_first + chunk_size, last) : last;
+        chunks.emplace_back(chunk_first, cut);
+        chunk_first = cut;
+    }
+
+    pool.run(chunks.size(), [&](size_t index, size_t) {
+        try {
+            parse_chunk(first, last, chunks[index], limits);
+        }
+        catch (...) {
+            chunks[index].error = std::current_exception();
+        }
+    });
+
+    // Joins the chunks in order; a chunk is right only if the one before ended just at its head
+    auto top_node = std::make_shared<xml_node>();
+    std::vector<std::shared_ptr<xml_node>> open_nodes{top_node};
+    std::string text_before_tag;    // the text of a chunk which ran over the cut
+    const char* position = first;
+    size_t nodes = 0;
+    for (auto& chunk : chunks) {
+        if (chunk.limit <= position) {  // The cut is inside a markup of the chunk before
+            continue;
+        }
+        if (chunk.first != position) {
+            chunk.first = position;
+            chunk.builder = bb::xml_node_builder();
+            chunk.builder.inner_text_before_tag = std::move(text_before_tag);
+            chunk.error = nullptr;
+            try {
+                parse_chunk(first, last, chunk, limits);
+            }
+            catch (...) {
+                chunk.error = std::current_exception();
+            }
+        }
+        else {
+            // The chunk begins with a tag, which ends the text
+            chunk.builder.flush_text(text_before_tag, open_nodes.back());
+        }
+
+        // The depth in the chunk is from its head; over the limit from the elements opened before, it is checked one by one
+        if (chunk.error || open_nodes.size() - 1 + chunk.deepest > limits.max_depth || nodes + chunk.nodes > limits.max_nodes || !join_chunk(chunk, open_nodes)) {
+            return parse_xml_again(first, last, chunk.first, open_nodes, nodes, limits);
+        }
+        nodes += chunk.nodes;
+        position = chunk.last;
+        text_before_tag = std::move(chunk.builder.inner_text_before_tag);
+    }
+
+    // XML document has exactly one single root element.
+    auto root_node = bb::find_xml_root_node(*top_node);
+    if (root_node) {
+        root_node->parent.reset();
+    }
+    return xml_document { chunks.front().builder.version, std::move(chunks.front().builder.attributes), root_node, chunks.front().builder.names };
+}
+
+namespace {
+
+    /**
+     * A "<" of a tag; not of a comment, a CDATA section nor a processing instruction
+     */
+    inline const char* find_cut(const char* itr, const char* end) {
+        while ((itr = bb::find(itr, end, '<')) != end) {
+            if (itr + 1 < end && itr[1] != '!' && itr[1] != '?') {
+                return itr;
+            }
+            ++itr;
+        }
+        return end;
+    }
+
+    /**
+     * Parses from the head of the chunk until the cursor reaches the limit.
+     * The head chunk has the XML declaration, and the last one is checked up to the end of the document.
+     *
+     * NOTE: The lines are not counted from the head of the document; an error is reported again by parse_xml_again().
+     */
+    inline void parse_chunk(const char* first, const char* last, xml_chunk& chunk, const xml_parse_limits& limits) {
+        bb::char_cursor cursor{first, last, chunk.first, {first, 0, chunk.first, 0, 1}};
+        std::vector<bb::xml_attribute_span> attributes;
+        bb::xml_open_elements open_elements;
+        open_elements.limits = limits;
+        if (chunk.first == first) {
+            bb::parse_xml_declaration(cursor, chunk.builder, attributes, limits);
+        }
+        else {
+            open_elements.is_partial = true;
+        }
+
+        if (chunk.limit == last) {
+            while (cursor.current < cursor.end && bb::parse_xml_markup(cursor, chunk.builder, attributes, open_elements)) {
+            }
+            bb::parse_xml_end(cursor);
+        }
+        else {
+            while (cursor.current < chunk.limit) {
+                if (bb::find(cursor.current, chunk.limit, '<') == chunk.limit) {
+                    bb::parse_xml_text(cursor, chunk.builder, chunk.limit, open_elements);
+                    break;
+                }
+                bb::parse_xml_markup(cursor, chunk.builder, attributes, open_elements);
+            }
+            if (cursor.current == chunk.limit) {    // The tag of the cut ends the text
+                chunk.builder.flush_text();
+            }
+        }
+        chunk.last = cursor.current;
+        chunk.nodes = open_elements.nodes;
+        chunk.deepest = open_elements.deepest;
+    }
+
+    /**
+     * Moves the nodes at the top level of the chunk into the open elements, closing them by the end tags in the chunk,
+     * and opens the elements left open in the chunk.
+     *
+     * @return false if an end tag does not match; the open elements are not changed then
+     */
+    inline bool join_chunk(xml_chunk& chunk, std::vector<std::shared_ptr<xml_node>>& open_nodes) {
+        auto& builder = chunk.builder;
+
+        auto open_size = open_nodes.size();
+        for (const auto& end_element : builder.outer_end_elements) {
+            if (open_size == 1 || open_nodes[open_size - 1]->name != end_element.name) {
+                return false;
+            }
+            --open_size;
+        }
+
+        std::vector<std::shared_ptr<xml_node>> left_open;
+        for (auto node = builder.current_node; node != builder.top_node; node = node->parent.lock()) {
+            left_open.push_back(node);
+        }
+
+        auto& nodes = builder.top_node->nodes;
+        size_t index = 0;
+        auto move_nodes = [&](size_t last_index) {
+            for (; index < last_index; ++index) {
+                nodes[index]->parent = open_nodes.back();
+                open_nodes.back()->nodes.push_back(std::move(nodes[index]));
+            }
+        };
+        for (const auto& end_element : builder.outer_end_elements) {
+            move_nodes(end_element.top_nodes_size);
+            bb::xml_node_builder::fold_value(*open_nodes.back());
+            open_nodes.pop_back();
+        }
+        move_nodes(nodes.size());
+
+        open_nodes.insert(open_nodes.end(), left_open.rbegin(), left_open.rend());
+        return true;
+    }
+
+    /**
+     * Parses the rest of the document one by one from `from`, with the elements opened before,
+     * to throw the same error as parse_xml() at the right position.
+     */
+    inline xml_document parse_xml_again(const char* first, const char* last, const char* from, const std::vector<std::shared_ptr<xml_node>>& open_nodes, size_t nodes, const xml_parse_limits& limits) {
+        if (from != first) {
+            auto cursor = bb::make_char_cursor(first, last);
+            cursor.current = from;
+            bb::xml_open_elements open_elements;
+            open_elements.limits = limits;
+            open_elements.nodes = nodes;
+            for (auto node = open_nodes.begin() + 1; node != open_nodes.end(); ++node) {
+                open_elements.push((*node)->name.data(), (*node)->name.data() + (*node)->name.size());
+            }
+            std::vector<bb::xml_attribute_span> attributes;
+            bb::xml_node_builder builder;
+            while (cursor.current < cursor.end && bb::parse_xml_markup(cursor, builder, attributes, open_elements)) {
+            }
+            bb::parse_xml_end(cursor);
+        }
+        return parse_xml(first, last, limits);
+    }
+
+}
@@ -0,0 +1,38 @@
+//
+//  xml_parallel_parser.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_parallel_parser_h
+#define xml_parallel_parser_h
+
+#include "xml_document.h"
+#include "xml_thread_pool.h"
+
+namespace bbxml {
+
+    /**
+     * Parses a large document on the workers of the pool, into the same xml_document as parse_xml() with the same errors.
+     *
+     * The text is cut into chunks at "<" of tags, and every chunk is parsed at once as if it began in the content of an element.
+     * Then the partial trees are joined in order, and the end tags of the elements opened in the chunks before are matched.
+     * A cut inside a comment, a CDATA section or a tag is found when the chunk before runs over it,
+     * and the text is parsed again from there. On an error, the document is checked again from the chunk of the error.
+     *
+     * Fits a record-oriented document, such as a long list of elements under the root;
+     * a document smaller than two chunks, or a pool of one worker, is parsed by parse_xml().
+     *
+     * The limits are checked in every chunk, and the depth and the nodes over the chunks when they are joined.
+     *
+     * @param chunk_size the size to cut the text into; 0 chooses it by the size of the text and the workers
+     */
+    extern xml_document parse_xml_parallel(const char* first, const char* last, xml_thread_pool& pool, size_t chunk_size = 0, const xml_parse_limits& limits = xml_parse_limits());
+
+    inline xml_document parse_xml_parallel(const std::string& text, xml_thread_pool& pool, size_t chunk_size = 0, const xml_parse_limits& limits = xml_parse_limits()) {
+        return parse_xml_parallel(text.data(), text.data() + text.size(), pool, chunk_size, limits);
+    }
+
+}
+
+#endif /* xml_parallel_parser_h */
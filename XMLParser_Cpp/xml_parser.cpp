@@ -0,0 +1,337 @@
+//
+//  xml_parser.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_parser.h"
+
+#include <cstdint>
+
+namespace {
+	/**
+	 * Writes into a buffer at or before what is being read, as std::string is appended
+	 */
+	struct _in_place_writer {
+		char* out;
+
+		void append(const char* first, const char* last) {
+			std::memmove(out, first, last - first);
+			out += last - first;
+		}
+		_in_place_writer& operator+=(char c) {
+			*out++ = c;
+			return *this;
+		}
+	};
+
+	template <class FindSpecial, class Out>
+	inline bool _unescape_xml_entity(const char* itr, const char* end, FindSpecial find_special, Out* out);
+	inline const char* _find_inner_text_special(const char* itr, const char* end);
+	inline const char* _find_attribute_value_special(const char* itr, const char* end, char quote);
+	template <class IsSpecial>
+	inline void _escape_xml(const char* itr, const char* end, IsSpecial is_special, std::string& out);
+}
+
+bool bb::next_xml_attribute(const char*& itr, const char* end, xml_attribute_span& attribute) {
+	const auto attribute_first = itr;
+	while (itr < end && is_space(*itr)) {
+		++itr;
+	}
+	if (itr == end) {
+		return false;
+	}
+	if (itr == attribute_first) {
+		throw attribute_first;
+	}
+
+	const auto key_first = itr;
+	const auto key_last = find(key_first, end, '=');
+	if (key_last == key_first || key_last == end || key_last + 1 == end || (key_last[1] != '"' && key_last[1] != '\'')) {
+		throw attribute_first;
+	}
+	const auto quote = key_last[1];
+	const auto value_first = key_last + 2;
+	const auto value_last = find(value_first, end, quote);
+	if (value_last == end) {
+		throw attribute_first;
+	}
+
+	attribute = {key_first, key_last, value_first, value_last, quote};
+	itr = value_last + 1;
+	return true;
+}
+
+const char* bb::scan_tag_name(const char* itr, const char* end) {
+    if (itr < end && *itr == '/') {
+        ++itr;
+    }
+    while (itr < end && *itr != '>' && *itr != '/' && !is_space(*itr)) {
+        ++itr;
+    }
+    return itr;
+}
+
+/**
+ * Rejects "<", ">", "'", "\"" and "&" in a tag name, which would break the markup around it.
+ * The Name production of XML is not checked; a name may start with a digit, "-" or ".", and any other byte is taken as it is.
+ */
+void bb::validate_tag_name(const char* itr, const char* end) {
+    for (; itr < end; ++itr) {
+        switch (*itr) {
+            case '<': case '>': case '\'': case '"': case '&':
+                throw itr;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * "&lt;" -> "<"
+ * "&gt;" -> ">"
+ * "&apos;" -> "'"
+ * "&quot;" -> "\""
+ * "&amp;" -> "&"
+ * "&#NNN;", "&#xHHH;" -> the character in UTF-8
+ */
+std::string bb::unescape_xml_inner_text(const char* itr, const char* end) {
+	std::string unescaped;
+	append_unescaped_xml_inner_text(itr, end, unescaped);
+	return unescaped;
+}
+
+std::string bb::unescape_xml_attribute_value(const xml_attribute_span& attribute) {
+	std::string unescaped;
+	append_unescaped_xml_attribute_value(attribute, unescaped);
+	return unescaped;
+}
+
+void bb::append_unescaped_xml_inner_text(const char* itr, const char* end, std::string& out) {
+	_unescape_xml_entity(itr, end, _find_inner_text_special, &out);
+}
+
+void bb::append_unescaped_xml_attribute_value(const xml_attribute_span& attribute, std::string& out) {
+	_unescape_xml_entity(attribute.value_first, attribute.value_last, [&](const char* itr, const char* end) {
+		return _find_attribute_value_special(itr, end, attribute.quote);
+	}, &out);
+}
+
+bool bb::validate_xml_inner_text(const char* itr, const char* end) {
+	return _unescape_xml_entity(itr, end, _find_inner_text_special, static_cast<std::string*>(nullptr));
+}
+
+bool bb::validate_xml_attribute_value(const xml_attribute_span& attribute) {
+	return _unescape_xml_entity(attribute.value_first, attribute.value_last, [&](const char* itr, const char* end) {
+		return _find_attribute_value_special(itr, end, attribute.quote);
+	}, static_cast<std::string*>(nullptr));
+}
+
+char* bb::move_unescaped_xml_inner_text(const char* itr, const char* end, char* out) {
+	_in_place_writer writer{out};
+	_unescape_xml_entity(itr, end, _find_inner_text_special, &writer);
+	return writer.out;
+}
+
+char* bb::move_unescaped_xml_attribute_value(const xml_attribute_span& attribute, char* out) {
+	_in_place_writer writer{out};
+	_unescape_xml_entity(attribute.value_first, attribute.value_last, [&](const char* itr, const char* end) {
+		return _find_attribute_value_special(itr, end, attribute.quote);
+	}, &writer);
+	return writer.out;
+}
+
+void bb::append_escaped_xml_inner_text(const char* itr, const char* end, std::string& out) {
+	_escape_xml(itr, end, [](char c) { return c == '&' || c == '<' || c == '>'; }, out);
+}
+
+void bb::append_escaped_xml_attribute_value(const char* itr, const char* end, std::string& out) {
+	_escape_xml(itr, end, [](char c) { return c == '&' || c == '<' || c == '>' || c == '"' || c == '\''; }, out);
+}
+
+namespace {
+
+	/**
+	 * "<" or "&"
+	 */
+	inline const char* _find_inner_text_special(const char* itr, const char* end) {
+		//return std::find_if(itr, end, [](char c) { return c == '<' || c == '>' || c == '\'' || c == '"' || c == '&'; });
+		return bb::scan_either(itr, end, '<', '&');	// HACK: ">", "'", "\"" are not always escaped
+	}
+
+	/**
+	 * "<", "'" or "&", and "\"" in a value quoted by "\""
+	 */
+	inline const char* _find_attribute_value_special(const char* itr, const char* end, char quote) {
+		if (quote == '"') {
+			return std::find_if(itr, end, [](char c) { return c == '<' || c == '\'' || c == '"' || c == '&'; });
+		}
+		return std::find_if(itr, end, [](char c) { return c == '<' || c == '\'' || c == '&'; });
+	}
+
+	/**
+	 * Char of XML 1.0; #x9 | #xA | #xD | [#x20-#xD7FF] | [#xE000-#xFFFD] | [#x10000-#x10FFFF]
+	 */
+	inline bool _is_xml_char(uint32_t c) {
+		return (c >= 0x20 && c <= 0xD7FF) || c == 0x9 || c == 0xA || c == 0xD || (c >= 0xE000 && c <= 0xFFFD) || (c >= 0x10000 && c <= 0x10FFFF);
+	}
+
+	template <class Out>
+	inline void _append_utf8(uint32_t c, Out& out) {
+		if (c < 0x80) {
+			out += static_cast<char>(c);
+		}
+		else if (c < 0x800) {
+			out += static_cast<char>(0xC0 | (c >> 6));
+			out += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000) {
+			out += static_cast<char>(0xE0 | (c >> 12));
+			out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else {
+			out += static_cast<char>(0xF0 | (c >> 18));
+			out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (c & 0x3F));
+		}
+	}
+
+	/**
+	 * "#" [0-9]+ ";" or "#x" [0-9a-fA-F]+ ";" of any length, referring a Char
+	 *
+	 * @param itr the next of "&#"
+	 * @return the next of ";", or nullptr if it is not a character reference
+	 */
+	inline const char* _decode_xml_character_reference(const char* itr, const char* end, uint32_t& c) {
+		const bool is_hex = itr < end && *itr == 'x';
+		if (is_hex) {
+			++itr;
+		}
+		const auto digits_first = itr;
+		c = 0;
+		for (; itr < end; ++itr) {
+			uint32_t digit;
+			if (*itr >= '0' && *itr <= '9') {
+				digit = *itr - '0';
+			}
+			else if (is_hex && *itr >= 'a' && *itr <= 'f') {
+				digit = *itr - 'a' + 10;
+			}
+			else if (is_hex && *itr >= 'A' && *itr <= 'F') {
+				digit = *itr - 'A' + 10;
+			}
+			else {
+				break;
+			}
+			c = std::min<uint32_t>(c * (is_hex ? 16 : 10) + digit, 0x110000);	// Saturates beyond the last Char
+		}
+		if (itr == digits_first || itr == end || *itr != ';' || !_is_xml_char(c)) {
+			return nullptr;
+		}
+		return itr + 1;
+	}
+
+	/**
+	 * @param itr "&"
+	 * @return the next of ";", or nullptr if the entity is not defined
+	 */
+	template <class Out>
+	inline const char* _decode_xml_entity(const char* itr, const char* end, Out* out) {
+		++itr;
+		if (itr < end && *itr == '#') {
+			uint32_t c;
+			auto last = _decode_xml_character_reference(itr + 1, end, c);
+			if (last && out) {
+				_append_utf8(c, *out);
+			}
+			return last;
+		}
+
+		static const struct {
+			const char* name;
+			size_t size;
+			char c;
+		} entities[] = { { "lt;", 3, '<' }, { "gt;", 3, '>' }, { "amp;", 4, '&' }, { "apos;", 5, '\'' }, { "quot;", 5, '"' } };
+		for (const auto& entity : entities) {
+			if (static_cast<size_t>(end - itr) >= entity.size && std::memcmp(itr, entity.name, entity.size) == 0) {
+				if (out) {
+					*out += entity.c;
+				}
+				return itr + entity.size;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Validates and unescapes in a single pass; only validates if `out` is null.
+	 * The span is appended at once if it has no "&".
+	 *
+	 * An illegal character is reported before an undefined entity even if it comes after, same as the former two regex searches.
+	 *
+	 * @param find_special finds "&" or an illegal character
+	 * @return whether the span has an entity
+	 * @throw const char* the illegal character or the undefined entity
+	 */
+	template <class FindSpecial, class Out>
+	inline bool _unescape_xml_entity(const char* itr, const char* end, FindSpecial find_special, Out* out) {
+		const char* undefined_entity = nullptr;
+		bool has_entity = false;
+		while (true) {
+			auto special = find_special(itr, end);
+			if (special == end) {
+				break;
+			}
+			if (*special != '&') {
+				throw special;
+			}
+			has_entity = true;
+			if (undefined_entity) {	// Only searches an illegal character
+				itr = special + 1;
+				continue;
+			}
+			if (out) {
+				out->append(itr, special);
+			}
+			auto entity_last = _decode_xml_entity(special, end, out);
+			if (entity_last == nullptr) {
+				undefined_entity = special;
+				itr = special + 1;
+				continue;
+			}
+			itr = entity_last;
+		}
+		if (undefined_entity) {
+			throw undefined_entity;
+		}
+		if (out) {
+			out->append(itr, end);
+		}
+		return has_entity;
+	}
+
+	/**
+	 * Appends the runs of the text between the special characters, and the entities of them
+	 */
+	template <class IsSpecial>
+	inline void _escape_xml(const char* itr, const char* end, IsSpecial is_special, std::string& out) {
+		while (true) {
+			auto special = std::find_if(itr, end, is_special);
+			out.append(itr, special);
+			if (special == end) {
+				break;
+			}
+			switch (*special) {
+				case '&': out.append("&amp;"); break;
+				case '<': out.append("&lt;"); break;
+				case '>': out.append("&gt;"); break;
+				case '"': out.append("&quot;"); break;
+				default: out.append("&apos;"); break;
+			}
+			itr = special + 1;
+		}
+	}
+
+}
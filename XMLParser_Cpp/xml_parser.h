@@ -0,0 +1,709 @@
+//
+//  xml_parser.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_parser_h
+#define xml_parser_h
+
+#include "xml_document.h"
+#include "xml_scan_kernels.h"
+
+#include <cstring>
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//*/
+#define make_xml_error(code, what, position) bbxml::xml_error(code, what, position, __FILE__, __LINE__)
+/*/
+#define make_xml_error(code, what, position) bbxml::xml_error(code, what, position)
+//*/
+
+/**
+ * The tokenizer shared by the document representations.
+ * A representation provides a builder, and bb::parse_xml() drives it through the input.
+ */
+namespace bb {
+    /**
+     * Counts lines incrementally up to a checkpoint,
+     * so that resolving a position costs only the distance from the checkpoint.
+     *
+     * `base` is the offset of `begin` in the input, which is not 0 when the input is streamed through a buffer;
+     * then a position must not be before the checkpoint.
+     */
+    struct line_counter {
+        const char* begin;
+        size_t base;
+        const char* checked;    // lines are counted in [begin, checked)
+        size_t line_head;       // the offset of the head of the current line
+        size_t line;
+
+        void advance(const char* itr) {
+            while (auto lf = static_cast<const char*>(std::memchr(checked, '\n', itr - checked))) {
+                line += 1;
+                line_head = base + (lf + 1 - begin);
+                checked = lf + 1;
+            }
+            checked = itr;
+        }
+
+        bbxml::xml_position position_of(const char* itr) const {
+            auto counter = (itr >= checked) ? *this : line_counter{begin, base, begin, base, 1};
+            counter.advance(itr);
+            const auto offset = base + static_cast<size_t>(itr - begin);
+            return {offset, counter.line, offset - counter.line_head + 1};
+        }
+    };
+
+    struct char_cursor {
+        const char* begin;
+        const char* end;
+        const char* current;
+        line_counter lines;
+
+        bbxml::xml_position position_of(const char* itr) const {
+            return lines.position_of(itr);
+        }
+    };
+
+    inline char_cursor make_char_cursor(const char* first, const char* last) {
+        return {first, last, first, {first, 0, first, 0, 1}};
+    }
+
+    inline char_cursor make_char_cursor(const std::string& str) {
+        return make_char_cursor(str.data(), str.data() + str.size());
+    }
+
+    /**
+     * Same as "\s" of std::regex
+     */
+    inline bool is_space(char c) {
+        return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+    }
+
+    inline bool is_space(const char* itr, const char* end) {
+        return scan_non_space(itr, end) == end;
+    }
+
+    template <size_t N>
+    inline bool starts_with(const char* itr, const char* end, const char (&prefix)[N]) {
+        return static_cast<size_t>(end - itr) >= N - 1 && std::memcmp(itr, prefix, N - 1) == 0;
+    }
+
+    inline const char* find(const char* itr, const char* end, char c) {
+        return scan_char(itr, end, c);
+    }
+
+    template <size_t N>
+    inline const char* search(const char* itr, const char* end, const char (&str)[N]) {
+        static_assert(N == 3 || N == 4, "scan_sequence supports 2 or 3 characters");
+        return scan_sequence(itr, end, str, N - 1);
+    }
+
+    /**
+     * An attribute as it is in the input; the value is not unescaped yet.
+     */
+    struct xml_attribute_span {
+        const char* key_first;
+        const char* key_last;
+        const char* value_first;
+        const char* value_last;
+        char quote;     // '"' or '\''
+    };
+
+    /**
+     * Scans an attribute; \s+ ([^=]+) = (["']) ([\s\S]*?) \2
+     *
+     * @return false if only spaces remain
+     * @throw const char* the head of the illegal attribute
+     */
+    extern bool next_xml_attribute(const char*& itr, const char* end, xml_attribute_span& attribute);
+
+    /**
+     * Tag name is [^>\s/]* with "/" at the head for a closing tag
+     */
+    extern const char* scan_tag_name(const char* itr, const char* end);
+
+    /**
+     * Checks a tag name for "<", ">", "'", "\"" and "&"; not for the Name production of XML
+     *
+     * @throw const char* the illegal character
+     */
+    extern void validate_tag_name(const char* itr, const char* end);
+
+    /**
+     * Validates XML escaping, and Unescapes escaped XML in a single pass.
+     * Character references are decoded to UTF-8.
+     *
+     * @throw const char* the unescaped character or the undefined entity
+     */
+    extern std::string unescape_xml_inner_text(const char* itr, const char* end);
+    extern std::string unescape_xml_attribute_value(const xml_attribute_span& attribute);
+
+    /**
+     * Same as unescape_xml_inner_text(), but appends to `out` without a temporary string
+     */
+    extern void append_unescaped_xml_inner_text(const char* itr, const char* end, std::string& out);
+    extern void append_unescaped_xml_attribute_value(const xml_attribute_span& attribute, std::string& out);
+
+    /**
+     * Validates XML escaping without unescaping
+     *
+     * @return whether it has an entity, that is, it has to be unescaped
+     * @throw const char* the unescaped character or the undefined entity
+     */
+    extern bool validate_xml_inner_text(const char* itr, const char* end);
+    extern bool validate_xml_attribute_value(const xml_attribute_span& attribute);
+
+    /**
+     * Unescapes a validated text into `out`, which may be `itr` itself or before it; an unescaped text never grows.
+     *
+     * @return the end of the unescaped text
+     */
+    extern char* move_unescaped_xml_inner_text(const char* itr, const char* end, char* out);
+    extern char* move_unescaped_xml_attribute_value(const xml_attribute_span& attribute, char* out);
+
+    /**
+     * Escapes a text and appends it to `out`; the inverse of append_unescaped_xml_inner_text().
+     * "&", "<" and ">" are escaped, so that "]]>" never appears.
+     */
+    extern void append_escaped_xml_inner_text(const char* itr, const char* end, std::string& out);
+
+    /**
+     * Same as append_escaped_xml_inner_text(), and escapes "\"" and "'" too; the value can be quoted by either
+     */
+    extern void append_escaped_xml_attribute_value(const char* itr, const char* end, std::string& out);
+
+    /**
+     * Scans the attributes of a tag into `attributes`, which is reused over tags.
+     *
+     * A syntax error is reported after the values before it, the same order as unescaping them one by one.
+     */
+    inline void scan_xml_attributes(const char* itr, const char* end, std::vector<xml_attribute_span>& attributes) {
+        attributes.clear();
+        try {
+            xml_attribute_span attribute;
+            while (next_xml_attribute(itr, end, attribute)) {
+                attributes.push_back(attribute);
+            }
+        }
+        catch (const char*) {
+            for (const auto& attribute : attributes) {
+                validate_xml_attribute_value(attribute);
+            }
+            throw;
+        }
+    }
+
+    /**
+     * Validates the attributes, and makes the pairs of the key and the value into `attributes` for the SAX parser and xml_reader.
+     * A value refers the text unless it has to be unescaped, and then it refers the string in `unescaped_values`.
+     *
+     * @throw const char* same as validate_xml_attribute_value()
+     */
+    inline void make_xml_attribute_views(const std::vector<xml_attribute_span>& spans, std::vector<std::pair<std::string_view, std::string_view>>& attributes, std::vector<std::string>& unescaped_values) {
+        attributes.clear();
+        unescaped_values.clear();
+        for (const auto& span : spans) {
+            const auto key = std::string_view(span.key_first, span.key_last - span.key_first);
+            if (validate_xml_attribute_value(span)) {
+                unescaped_values.push_back(unescape_xml_attribute_value(span));
+                attributes.emplace_back(key, std::string_view());
+            }
+            else {
+                attributes.emplace_back(key, std::string_view(span.value_first, span.value_last - span.value_first));
+            }
+        }
+        // Refers the values after all of them are unescaped, as unescaped_values may be reallocated
+        if (!unescaped_values.empty()) {
+            auto unescaped_value = unescaped_values.begin();
+            for (auto& attribute : attributes) {
+                if (attribute.second.data() == nullptr) {
+                    attribute.second = *unescaped_value++;
+                }
+            }
+        }
+    }
+
+    /**
+     * Names of the open elements, and the counts of the document checked against the limits with them
+     *
+     * The names are copied, so that a streamed input can be discarded behind the cursor.
+     *
+     * When the input is a chunk in the middle of a document, the elements opened before it are unknown;
+     * `is_partial` lets an end tag close one of them, and the builder has to match it later.
+     * The depth and the nodes are counted from the head of the chunk then.
+     *
+     * A streamed input may report a text in parts; `text_size_before` is the size of the parts before,
+     * and `text_position` is the head of the first part.
+     */
+    struct xml_open_elements {
+        std::string names;
+        std::vector<size_t> heads;
+        bool is_partial = false;
+
+        bbxml::xml_parse_limits limits;
+        size_t nodes = 0;
+        size_t deepest = 0;         // the depth of the deepest element so far
+        size_t text_size_before = 0;
+        bbxml::xml_position text_position{};
+
+        bool empty() const { return heads.empty(); }
+        size_t size() const { return heads.size(); }
+        std::string_view back() const { return std::string_view(names).substr(heads.back()); }
+
+        void push(const char* first, const char* last) {
+            heads.push_back(names.size());
+            names.append(first, last);
+        }
+
+        void pop() {
+            names.resize(heads.back());
+            heads.pop_back();
+        }
+
+        /**
+         * Empties it for another document, keeping the capacities
+         */
+        void reset(const bbxml::xml_parse_limits& limits) {
+            names.clear();
+            heads.clear();
+            is_partial = false;
+            this->limits = limits;
+            nodes = 0;
+            deepest = 0;
+            text_size_before = 0;
+            text_position = bbxml::xml_position{};
+        }
+    };
+
+    /**
+     * @throw bbxml::xml_error of `code` at `itr` if the size is over the limit
+     */
+    inline void check_xml_limit(size_t size, size_t limit, bbxml::xml_error_code code, const char* what, const char_cursor& cursor, const char* itr) {
+        if (size > limit) {
+            throw make_xml_error(code, what, cursor.position_of(itr));
+        }
+    }
+
+    /**
+     * Same as scan_xml_attributes(), and checks every attribute against the limits as soon as it is scanned;
+     * the number, the key, the value, and the spaces before it as a text. So the first one over a limit fails whatever follows it.
+     *
+     * If `is_partial`, [itr, end) is the head of a markup which has not ended yet;
+     * the attribute cut at the end is checked as far as it goes, and is not added.
+     *
+     * @throw bbxml::xml_error over a limit
+     * @throw const char* same as scan_xml_attributes()
+     */
+    inline void scan_xml_attributes(const char* itr, const char* end, std::vector<xml_attribute_span>& attributes, const bbxml::xml_parse_limits& limits, const char_cursor& cursor, bool is_partial = false) {
+        using bbxml::xml_error_code;
+        attributes.clear();
+        try {
+            while (true) {
+                const auto attribute_first = itr;
+                itr = scan_non_space(itr, end);
+                check_xml_limit(itr - attribute_first, limits.max_text_length, xml_error_code::too_long_text, "Too many spaces in a tag", cursor, attribute_first);
+                if (itr == end) {
+                    return;
+                }
+                if (itr == attribute_first) {
+                    throw attribute_first;
+                }
+                check_xml_limit(attributes.size() + 1, limits.max_attributes, xml_error_code::too_many_attributes, "Too many attributes", cursor, itr);
+
+                const auto key_first = itr;
+                const auto key_last = find(key_first, end, '=');
+                check_xml_limit(key_last - key_first, limits.max_name_length, xml_error_code::too_long_name, "Too long attribute key", cursor, key_first);
+                if (key_last == key_first) {
+                    throw attribute_first;
+                }
+                if (key_last == end || key_last + 1 == end) {
+                    if (is_partial) {
+                        return;
+                    }
+                    throw attribute_first;
+                }
+                const auto quote = key_last[1];
+                if (quote != '"' && quote != '\'') {
+                    throw attribute_first;
+                }
+                const auto value_first = key_last + 2;
+                const auto value_last = find(value_first, end, quote);
+                check_xml_limit(value_last - value_first, limits.max_text_length, xml_error_code::too_long_text, "Too long attribute value", cursor, value_first);
+                if (value_last == end) {
+                    if (is_partial) {
+                        return;
+                    }
+                    throw attribute_first;
+                }
+
+                attributes.push_back({key_first, key_last, value_first, value_last, quote});
+                itr = value_last + 1;
+            }
+        }
+        catch (const char*) {
+            for (const auto& attribute : attributes) {
+                validate_xml_attribute_value(attribute);
+            }
+            throw;
+        }
+    }
+
+    /**
+     * Counts a node, a text, a CDATA section, a comment or an element
+     */
+    inline void count_xml_node(xml_open_elements& open_elements, const char_cursor& cursor, const char* itr) {
+        open_elements.nodes += 1;
+        check_xml_limit(open_elements.nodes, open_elements.limits.max_nodes, bbxml::xml_error_code::too_many_nodes, "Too many nodes", cursor, itr);
+    }
+
+    /**
+     * Builder:
+     *   void declaration(const char* version_first, const char* version_last, const std::vector<xml_attribute_span>& attributes);
+     *   void text(const char* first, const char* last);       // may throw const char*
+     *   void cdata(const char* first, const char* last);
+     *   void comment(const char* first, const char* last);
+     *   void start_element(const char* name_first, const char* name_last, const std::vector<xml_attribute_span>& attributes, bool is_independent);   // may throw const char*
+     *   void end_element(const char* name_first, const char* name_last);
+     *   static constexpr bool validates_tag_names = false;    // optional, to skip checking the characters of the tag names
+     *
+     * The tokenizer checks well-formedness; the builder only builds.
+     * Texts and CDATA sections before a tag are reported separately; joining them is up to the builder.
+     */
+
+    template <class Builder, class = void>
+    struct validates_tag_names : std::true_type {};
+
+    template <class Builder>
+    struct validates_tag_names<Builder, std::void_t<decltype(Builder::validates_tag_names)>> : std::bool_constant<Builder::validates_tag_names> {};
+
+    /**
+     * Scans "<?xml" \s+ "version=\"" version "\"" at the head of the cursor; the spaces and the version are checked as texts as far as they go
+     *
+     * @return the quote closing the version, or nullptr if it is not the head of a declaration, or the version has not ended
+     * @throw bbxml::xml_error over a limit
+     */
+    inline const char* scan_xml_version(const char_cursor& cursor, const char*& version_first, const bbxml::xml_parse_limits& limits) {
+        using bbxml::xml_error_code;
+        auto itr = cursor.current;
+        if (!starts_with(itr, cursor.end, "<?xml") || itr + 5 == cursor.end || !is_space(itr[5])) {
+            return nullptr;
+        }
+        itr = scan_non_space(itr + 5, cursor.end);
+        check_xml_limit(itr - (cursor.current + 5), limits.max_text_length, xml_error_code::too_long_text, "Too many spaces in the XML declaration", cursor, cursor.current + 5);
+        if (!starts_with(itr, cursor.end, "version=\"") || itr + 9 == cursor.end) {
+            return nullptr;
+        }
+        version_first = itr + 9;
+        const auto version_last = find(version_first + 1, cursor.end, '"');
+        check_xml_limit(version_last - version_first, limits.max_text_length, xml_error_code::too_long_text, "Too long XML version", cursor, version_first);
+        return version_last != cursor.end ? version_last : nullptr;
+    }
+
+    inline bool has_xml_newline(const char* itr, const char* end) {
+        return std::find_if(itr, end, [](char c) { return c == '\n' || c == '\r'; }) != end;
+    }
+
+    /**
+     * Checks a declaration without "?>" as far as it goes, in the same order as parse_xml_declaration(),
+     * so that a declaration over a limit fails even if it does not end.
+     *
+     * @return the error of the declaration once it ends, if it fails whatever follows; none if it may be right yet
+     * @throw bbxml::xml_error over a limit
+     */
+    inline std::optional<bbxml::xml_error> check_xml_unclosed_declaration(const char_cursor& cursor, std::vector<xml_attribute_span>& attributes, const bbxml::xml_parse_limits& limits) {
+        using bbxml::xml_error_code;
+        const char* version_first = nullptr;
+        const auto version_last = scan_xml_version(cursor, version_first, limits);
+        if (version_last == nullptr || has_xml_newline(version_first, version_last)) {
+            return std::nullopt;
+        }
+        if (version_last - version_first != 3 || std::memcmp(version_first, "1.0", 3) != 0) {
+            return make_xml_error(xml_error_code::unsupported_version, "Unsupported XML version \"" + std::string(version_first, version_last) + "\"", cursor.position_of(version_first));
+        }
+        auto attributes_last = cursor.end;
+        if (attributes_last > version_last + 1 && attributes_last[-1] == '?') {
+            --attributes_last;
+        }
+        try {
+            scan_xml_attributes(version_last + 1, attributes_last, attributes, limits, cursor, true);
+        }
+        catch (const char* itr) {
+            return make_xml_error(xml_error_code::illegal_attributes, "Illegal attributes", cursor.position_of(itr));
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * Parses the XML declaration at the head of the cursor; "<?xml" \s+ "version=\"" version "\"" attributes? "?>"
+     */
+    template <class Builder>
+    void parse_xml_declaration(char_cursor& cursor, Builder& builder, std::vector<xml_attribute_span>& attributes, const bbxml::xml_parse_limits& limits) {
+        using bbxml::xml_error_code;
+
+        const char* version_first = nullptr;
+        const auto version_last = scan_xml_version(cursor, version_first, limits);
+        const char* declaration_last = nullptr;
+        if (version_last && !has_xml_newline(version_first, version_last)) {
+            declaration_last = search(version_last, cursor.end, "?>");
+            if (declaration_last == cursor.end) {
+                check_xml_unclosed_declaration(cursor, attributes, limits);
+            }
+        }
+        if (declaration_last == nullptr || declaration_last == cursor.end) {
+            throw make_xml_error(xml_error_code::no_xml_declaration, "No XML declaration", cursor.position_of(cursor.current));
+        }
+
+        if (version_last - version_first != 3 || std::memcmp(version_first, "1.0", 3) != 0) {
+            throw make_xml_error(xml_error_code::unsupported_version, "Unsupported XML version \"" + std::string(version_first, version_last) + "\"", cursor.position_of(version_first));
+        }
+
+        try {
+            scan_xml_attributes(version_last + 1, declaration_last, attributes, limits, cursor);
+            builder.declaration(version_first, version_last, attributes);
+        }
+        catch (const char* itr) {
+            throw make_xml_error(xml_error_code::illegal_attributes, "Illegal attributes", cursor.position_of(itr));
+        }
+        cursor.current = declaration_last + 2;
+    }
+
+    /**
+     * Reports [cursor.current, last) as a text, and moves the cursor to `last`
+     *
+     * A part after `open_elements.text_size_before` is checked with the parts before, and is not counted as a node again.
+     */
+    template <class Builder>
+    void parse_xml_text(char_cursor& cursor, Builder& builder, const char* last, xml_open_elements& open_elements) {
+        if (cursor.current < last) {
+            const auto size = open_elements.text_size_before + (last - cursor.current);
+            if (size > open_elements.limits.max_text_length) {
+                const auto position = open_elements.text_size_before > 0 ? open_elements.text_position : cursor.position_of(cursor.current);
+                throw make_xml_error(bbxml::xml_error_code::too_long_text, "Too long text", position);
+            }
+            if (open_elements.text_size_before == 0) {
+                count_xml_node(open_elements, cursor, cursor.current);
+            }
+            try {
+                builder.text(cursor.current, last);
+            }
+            catch (const char* itr) {
+                throw make_xml_error(bbxml::xml_error_code::no_escaped_character, "Found an unescaped character or an undefined entity", cursor.position_of(itr));
+            }
+            cursor.current = last;
+        }
+    }
+
+    /**
+     * Checks a tag name, from "<" or "</" up to `tag_name_last`; the characters are not checked if `may_go_on`,
+     * as the name may be over the limit of the length yet.
+     */
+    template <class Builder>
+    void check_xml_tag_name(const char_cursor& cursor, const char* tag_name_first, const char* tag_name_last, const bbxml::xml_parse_limits& limits, bool may_go_on = false) {
+        using bbxml::xml_error_code;
+        if (tag_name_first == tag_name_last) {
+            throw make_xml_error(xml_error_code::no_tag_name, "Found a no name tag", cursor.position_of(tag_name_first));
+        }
+        check_xml_limit(tag_name_last - tag_name_first - (*tag_name_first == '/' ? 1 : 0), limits.max_name_length, xml_error_code::too_long_name, "Too long tag name", cursor, tag_name_first);
+        if constexpr (validates_tag_names<Builder>::value) {
+            if (may_go_on) {
+                return;
+            }
+            try {
+                validate_tag_name(tag_name_first, tag_name_last);
+            }
+            catch (const char* itr) {
+                throw make_xml_error(xml_error_code::illegal_tag_name, "Found an illegal character in the tag name \"" + std::string(tag_name_first, tag_name_last) + "\"", cursor.position_of(itr));
+            }
+        }
+    }
+
+    /**
+     * Checks a tag without ">", from `tag_name_first` to the end of the cursor, as far as it goes in the same order as parse_xml_markup();
+     * so that a tag over a limit fails even if it does not end, same as a comment.
+     *
+     * @return the error of the tag once it ends, if it fails whatever follows; none if it may be right yet
+     * @throw bbxml::xml_error an error whether it ends or not
+     */
+    template <class Builder>
+    std::optional<bbxml::xml_error> check_xml_unclosed_tag(const char_cursor& cursor, const char* tag_name_first, std::vector<xml_attribute_span>& attributes, const xml_open_elements& open_elements) {
+        using bbxml::xml_error_code;
+        const auto& limits = open_elements.limits;
+        if (tag_name_first == cursor.end) {
+            return std::nullopt;
+        }
+        const auto tag_name_last = scan_tag_name(tag_name_first, cursor.end);
+        check_xml_tag_name<Builder>(cursor, tag_name_first, tag_name_last, limits, tag_name_last == cursor.end);
+        if (tag_name_last == cursor.end) {
+            return std::nullopt;
+        }
+        if (*tag_name_first != '/') {
+            check_xml_limit(open_elements.size() + 1, limits.max_depth, xml_error_code::too_deep, "Too deep element", cursor, tag_name_first);
+            check_xml_limit(open_elements.nodes + 1, limits.max_nodes, xml_error_code::too_many_nodes, "Too many nodes", cursor, tag_name_first);
+        }
+        auto attributes_last = cursor.end;
+        if (attributes_last[-1] == '/') {
+            --attributes_last;
+        }
+        try {
+            scan_xml_attributes(tag_name_last, attributes_last, attributes, limits, cursor, true);
+        }
+        catch (const char* itr) {
+            return make_xml_error(xml_error_code::illegal_attributes, "Illegal attributes", cursor.position_of(itr));
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * Parses a text and the markup after it; a comment, a CDATA section or a tag.
+     *
+     * @return false if no "<" remains; the cursor stays at the head of the rest
+     */
+    template <class Builder>
+    bool parse_xml_markup(char_cursor& cursor, Builder& builder, std::vector<xml_attribute_span>& attributes, xml_open_elements& open_elements) {
+        using bbxml::xml_error_code;
+        cursor.lines.advance(cursor.current);
+
+        // Searches the head of an tag -> (inner_text?, "<")
+        const char* tag_name_first;
+        {
+            auto lt = find(cursor.current, cursor.end, '<');
+            if (lt == cursor.end) {
+                return false;
+            }
+            parse_xml_text(cursor, builder, lt, open_elements);
+            open_elements.text_size_before = 0;
+            tag_name_first = lt + 1;
+            cursor.current = tag_name_first;
+        }
+
+        const auto& limits = open_elements.limits;
+        if (starts_with(tag_name_first, cursor.end, "!--")) {
+            // Searches an end of the the comment section; a comment over the limit is an error even if it does not end
+            auto dashes = search(tag_name_first + 3, cursor.end, "--");
+            check_xml_limit(dashes - (tag_name_first + 3), limits.max_text_length, xml_error_code::too_long_text, "Too long comment", cursor, tag_name_first);
+            if (dashes == cursor.end) {
+                throw make_xml_error(xml_error_code::missing_closing_tag, "Missing an end of the comment section", cursor.position_of(tag_name_first));
+            }
+            if (dashes + 2 == cursor.end || dashes[2] != '>') {
+                throw make_xml_error(xml_error_code::illegal_comment, "Two dashes in the middle of a comment are not allowed", cursor.position_of(dashes));
+            }
+            count_xml_node(open_elements, cursor, tag_name_first);
+            builder.comment(tag_name_first + 3, dashes);
+            cursor.current = dashes + 3;
+        }
+        else if (starts_with(tag_name_first, cursor.end, "![CDATA[")) {
+            // Searches an end of the CDATA section
+            auto cdata_first = tag_name_first + 8;
+            auto cdata_last = search(cdata_first, cursor.end, "]]>");
+            check_xml_limit(cdata_last - cdata_first, limits.max_text_length, xml_error_code::too_long_text, "Too long CDATA section", cursor, tag_name_first);
+            if (cdata_last == cursor.end) {
+                throw make_xml_error(xml_error_code::missing_closing_tag, "Missing an end of the CDATA section", cursor.position_of(tag_name_first));
+            }
+            count_xml_node(open_elements, cursor, tag_name_first);
+
+            // Excludes "<![CDATA[" and "]]>"
+            builder.cdata(cdata_first, cdata_last);
+            cursor.current = cdata_last + 3;
+        }
+        else {
+            auto tag_name_last = scan_tag_name(tag_name_first, cursor.end);
+            check_xml_tag_name<Builder>(cursor, tag_name_first, tag_name_last, limits);
+
+            // Searches ">" -> (attributes?, "/"?); a tag over a limit is an error even if it does not end
+            auto gt = find(tag_name_last, cursor.end, '>');
+            if (gt == cursor.end) {
+                check_xml_unclosed_tag<Builder>(cursor, tag_name_first, attributes, open_elements);
+                throw make_xml_error(xml_error_code::missing_closing_tag, "Missing \">\" for the tag \"" + std::string(tag_name_first, tag_name_last) + "\"", cursor.position_of(tag_name_first));
+            }
+            auto attributes_last = gt;
+            auto is_independent = attributes_last > tag_name_last && attributes_last[-1] == '/';
+            if (is_independent) {
+                --attributes_last;
+            }
+            cursor.current = gt + 1;
+
+            if (*tag_name_first == '/') { // Closing tag
+                try {
+                    scan_xml_attributes(tag_name_last, attributes_last, attributes, limits, cursor);
+                    for (const auto& attribute : attributes) {
+                        validate_xml_attribute_value(attribute);
+                    }
+                }
+                catch (const char* itr) {
+                    throw make_xml_error(xml_error_code::illegal_attributes, "Illegal attributes", cursor.position_of(itr));
+                }
+                if (is_independent) {
+                    throw make_xml_error(xml_error_code::illegal_closing_tag, "Closing tag can not end with \"/>\", \"" + std::string(tag_name_first, tag_name_last) + "\"", cursor.position_of(attributes_last));
+                }
+                if (open_elements.empty()) {
+                    if (!open_elements.is_partial) {
+                        throw make_xml_error(xml_error_code::missing_opening_tag, "Missing an opening tag for the tag \"" + std::string(tag_name_first, tag_name_last) + "\"", cursor.position_of(tag_name_first));
+                    }
+                }
+                else if (open_elements.back() != std::string_view(tag_name_first + 1, tag_name_last - tag_name_first - 1)) {
+                    throw make_xml_error(xml_error_code::missing_closing_tag, "Missing an closing tag for the tag \"" + std::string(open_elements.back()) + "\"", cursor.position_of(tag_name_first));
+                }
+                if (!attributes.empty()) {
+                    throw make_xml_error(xml_error_code::illegal_closing_tag, "Closing tag can not have attributes, \"" + std::string(tag_name_first, tag_name_last) + "\"", cursor.position_of(tag_name_first));
+                }
+                builder.end_element(tag_name_first + 1, tag_name_last);
+                if (!open_elements.empty()) {
+                    open_elements.pop();
+                }
+            }
+            else { // Opening tag or Independent tag
+                const auto depth = open_elements.size() + 1;
+                check_xml_limit(depth, limits.max_depth, xml_error_code::too_deep, "Too deep element", cursor, tag_name_first);
+                open_elements.deepest = std::max(open_elements.deepest, depth);
+                count_xml_node(open_elements, cursor, tag_name_first);
+                try {
+                    scan_xml_attributes(tag_name_last, attributes_last, attributes, limits, cursor);
+                    builder.start_element(tag_name_first, tag_name_last, attributes, is_independent);
+                }
+                catch (const char* itr) {
+                    throw make_xml_error(xml_error_code::illegal_attributes, "Illegal attributes", cursor.position_of(itr));
+                }
+                if (!is_independent) {
+                    open_elements.push(tag_name_first, tag_name_last);
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Checks that only spaces remain
+     */
+    inline void parse_xml_end(char_cursor& cursor) {
+        if (!is_space(cursor.current, cursor.end)) {
+            throw make_xml_error(bbxml::xml_error_code::illegal_format, "Illegal format", cursor.position_of(cursor.current));
+        }
+    }
+
+    /**
+     * Parses a XML document from the cursor, and builds it with the builder.
+     */
+    template <class Builder>
+    void parse_xml(char_cursor& cursor, Builder& builder, const bbxml::xml_parse_limits& limits = bbxml::xml_parse_limits()) {
+        std::vector<xml_attribute_span> attributes;
+        parse_xml_declaration(cursor, builder, attributes, limits);
+
+        xml_open_elements open_elements;
+        open_elements.limits = limits;
+        while (cursor.current < cursor.end && parse_xml_markup(cursor, builder, attributes, open_elements)) {
+        }
+
+        // Ignores spaces if existed
+        parse_xml_end(cursor);
+    }
+}
+
+#endif /* xml_parser_h */
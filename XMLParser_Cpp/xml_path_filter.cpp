@@ -0,0 +1,229 @@
+//
+//  xml_path_filter.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_path_filter.h"
+#include "xml_mapped_file.h"
+#include "xml_node_builder.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace bbxml;
+
+/**
+ * Matches the start tags against the states of their parents, and builds only the selected subtrees
+ */
+struct xml_path_filter::builder {
+    struct open_element {
+        uint64_t states;        // for the children
+        uint64_t selected;      // the bits of the queries which selected the element
+    };
+
+    const xml_path_filter& filter;
+    const xml_filter_handler& handler;
+    std::vector<open_element> open_elements;    // [0] is the document
+    std::vector<uint32_t> counters;             // the positions of the siblings, for every depth
+    bb::xml_node_builder nodes;
+    size_t build_depth = 0;                     // of the outermost selected element in building; 0 if none
+
+    builder(const xml_path_filter& filter, const xml_filter_handler& handler)
+    : filter(filter), handler(handler), open_elements{{filter.initial_states_, 0}}, counters(filter.counters_size_) {
+    }
+
+    void declaration(const char*, const char*, const std::vector<bb::xml_attribute_span>& attributes) {
+        for (const auto& attribute : attributes) {
+            bb::validate_xml_attribute_value(attribute);
+        }
+    }
+
+    void text(const char* first, const char* last) {
+        if (build_depth > 0) {
+            nodes.text(first, last);
+        }
+        else {
+            bb::validate_xml_inner_text(first, last);
+        }
+    }
+
+    void cdata(const char* first, const char* last) {
+        if (build_depth > 0) {
+            nodes.cdata(first, last);
+        }
+    }
+
+    void comment(const char*, const char*) {
+    }
+
+    void start_element(const char* name_first, const char* name_last, const std::vector<bb::xml_attribute_span>& attributes, bool is_independent) {
+        const auto depth = open_elements.size();
+        const auto base = (depth - 1) * filter.counters_size_;
+        const std::string_view name(name_first, name_last - name_first);
+
+        uint64_t states = 0;
+        uint64_t selected = 0;
+        size_t index = 0;
+        for (auto rest = open_elements.back().states; rest != 0; rest >>= 1, ++index) {
+            if ((rest & 1) == 0) {
+                continue;
+            }
+            const auto& state = filter.states_[index];
+            const auto& query = filter.queries_[state.query];
+            const auto& step = query.steps_[state.step];
+            if (step.is_descendant) {
+                states |= uint64_t(1) << index;
+            }
+            if (matches(state, name, attributes, base)) {
+                if (state.step + 1 == query.steps_.size()) {
+                    selected |= uint64_t(1) << state.query;
+                }
+                else {
+                    states |= uint64_t(1) << (index + 1);
+                }
+            }
+        }
+
+        if (selected != 0 && build_depth == 0) {
+            build_depth = depth;
+        }
+        if (build_depth > 0) {
+            nodes.start_element(name_first, name_last, attributes, is_independent);
+        }
+        else {
+            for (const auto& attribute : attributes) {
+                bb::validate_xml_attribute_value(attribute);
+            }
+        }
+
+        if (is_independent) {
+            close(depth);
+            if (build_depth > 0) {
+                report(selected, nodes.current_node->nodes.back(), depth);
+            }
+            return;
+        }
+        open_elements.push_back({states, selected});
+        if (counters.size() < (depth + 1) * filter.counters_size_) {
+            counters.resize((depth + 1) * filter.counters_size_);
+        }
+        std::fill_n(counters.begin() + depth * filter.counters_size_, filter.counters_size_, 0);
+    }
+
+    void end_element(const char* name_first, const char* name_last) {
+        const auto depth = open_elements.size() - 1;
+        const auto selected = open_elements.back().selected;
+        open_elements.pop_back();
+        close(depth);
+        if (build_depth > 0) {
+            auto node = nodes.current_node;
+            nodes.end_element(name_first, name_last);
+            report(selected, node, depth);
+        }
+    }
+
+    /**
+     * Stops matching after the root element, since parse_xml() keeps only the first element at the top level
+     */
+    void close(size_t depth) {
+        if (depth == 1) {
+            open_elements.front().states = 0;
+        }
+    }
+
+    /**
+     * Reports the elements left open at the end of the document, which parse_xml() keeps as they are
+     */
+    void finish() {
+        while (open_elements.size() > 1) {
+            const auto depth = open_elements.size() - 1;
+            const auto selected = open_elements.back().selected;
+            open_elements.pop_back();
+            if (build_depth > 0) {
+                auto node = nodes.current_node;
+                nodes.current_node = node->parent.lock();
+                report(selected, node, depth);
+            }
+        }
+    }
+
+    bool matches(const state& state, std::string_view name, const std::vector<bb::xml_attribute_span>& attributes, size_t base) {
+        const auto& query = filter.queries_[state.query];
+        const auto& step = query.steps_[state.step];
+        if (!step.is_any && name != state.name) {
+            return false;
+        }
+        for (const auto& predicate : step.predicates) {
+            if (predicate.type == xml_query::predicate::kind::position) {
+                if (++counters[base + state.counters_offset + predicate.counter] != predicate.position) {
+                    return false;
+                }
+                continue;
+            }
+            // The last one wins for a duplicated key, same as the tree
+            const std::string_view key = query.names_[predicate.position];
+            auto attribute = std::find_if(attributes.rbegin(), attributes.rend(), [&](const bb::xml_attribute_span& attribute) {
+                return std::string_view(attribute.key_first, attribute.key_last - attribute.key_first) == key;
+            });
+            if (attribute == attributes.rend()) {
+                return false;
+            }
+            if (predicate.type != xml_query::predicate::kind::has_attribute) {
+                auto is_equal = bb::validate_xml_attribute_value(*attribute)
+                    ? bb::unescape_xml_attribute_value(*attribute) == predicate.value
+                    : std::string_view(attribute->value_first, attribute->value_last - attribute->value_first) == predicate.value;
+                if (is_equal != (predicate.type == xml_query::predicate::kind::attribute_equal)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Reports the closed element to the queries which selected it, detaching it at the top of the subtree
+     */
+    void report(uint64_t selected, std::shared_ptr<xml_node> node, size_t depth) {
+        if (depth == build_depth) {
+            node->parent.reset();
+            nodes.top_node->nodes.clear();
+            build_depth = 0;
+        }
+        for (size_t query = 0; selected != 0; selected >>= 1, ++query) {
+            if (selected & 1) {
+                handler(query, node);
+            }
+        }
+    }
+};
+
+xml_path_filter::xml_path_filter(std::vector<xml_query> queries) : queries_(std::move(queries)) {
+    for (size_t query = 0; query < queries_.size(); ++query) {
+        if (states_.size() + queries_[query].steps_.size() > 64) {
+            throw std::invalid_argument("Too many steps of the queries, more than 64");
+        }
+        initial_states_ |= uint64_t(1) << states_.size();
+        for (size_t step = 0; step < queries_[query].steps_.size(); ++step) {
+            const auto& name = queries_[query].names_[queries_[query].steps_[step].name];
+            states_.push_back({query, step, name, counters_size_});
+        }
+        counters_size_ += queries_[query].counters_size_;
+    }
+}
+
+xml_path_filter::xml_path_filter(std::initializer_list<std::string_view> expressions)
+: xml_path_filter(std::vector<xml_query>(expressions.begin(), expressions.end())) {
+}
+
+void xml_path_filter::parse(const char* first, const char* last, const xml_filter_handler& handler) const {
+    auto cursor = bb::make_char_cursor(first, last);
+    builder builder{*this, handler};
+    bb::parse_xml(cursor, builder);
+    builder.finish();
+}
+
+void xml_path_filter::parse_file(const std::string& path, const xml_filter_handler& handler) const {
+    xml_mapped_file file{path};
+    parse(file.data().data(), file.data().data() + file.size(), handler);
+}
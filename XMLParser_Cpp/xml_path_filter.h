@@ -0,0 +1,91 @@
+//
+//  xml_path_filter.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_path_filter_h
+#define xml_path_filter_h
+
+#include "xml_document.h"
+#include "xml_query.h"
+
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bbxml {
+
+    /**
+     * Receives a subtree selected by a query of xml_path_filter, at its end tag.
+     *
+     * `query` is the index of the query; the node is detached from the document, and can be kept after the call.
+     */
+    typedef std::function<void(size_t query, const std::shared_ptr<xml_node>& node)> xml_filter_handler;
+
+    /**
+     * Pulls the elements selected by the queries out of a document, without building the rest of it.
+     *
+     * The queries are matched on the start tags, so an attribute or a position selects an element before its content.
+     * Only the subtrees of the selected elements are built into xml_node same as parse_xml();
+     * the texts and the attributes outside them are validated and discarded, never unescaped nor copied.
+     * So the memory is bounded by the largest selected subtree and the depth, not by the document.
+     * The whole document is checked as parse_xml(), and an error is thrown after the subtrees before it are reported.
+     *
+     * The elements are the same as xml_query selects on parse_xml(): a relative path begins at the document,
+     * only the first element at the top level is matched, and the elements left open at the end are reported at the end.
+     * An element inside a selected subtree may be selected again, by another query or a "//" step;
+     * it is reported first, as its end tag comes first.
+     */
+    class xml_path_filter {
+    public:
+        /**
+         * @throw std::invalid_argument if the queries have more than 64 steps in total
+         */
+        explicit xml_path_filter(std::vector<xml_query> queries);
+
+        /**
+         * @throw std::invalid_argument if an expression is not in the subset of xml_query
+         */
+        xml_path_filter(std::initializer_list<std::string_view> expressions);
+
+        const std::vector<xml_query>& queries() const noexcept { return queries_; }
+
+        void parse(const char* first, const char* last, const xml_filter_handler& handler) const;
+
+        void parse(const std::string& text, const xml_filter_handler& handler) const {
+            parse(text.data(), text.data() + text.size(), handler);
+        }
+
+        /**
+         * Parses a file through a memory mapping; its pages are only read, so a huge feed does not grow the heap
+         *
+         * @throw std::system_error if the file can not be read
+         */
+        void parse_file(const std::string& path, const xml_filter_handler& handler) const;
+
+    private:
+        /**
+         * A step of a query, which is a bit of the states
+         */
+        struct state {
+            size_t query;
+            size_t step;
+            std::string_view name;
+            size_t counters_offset;     // of the query in the counters of a depth
+        };
+
+        struct builder;
+
+        std::vector<xml_query> queries_;
+        std::vector<state> states_;
+        uint64_t initial_states_ = 0;
+        size_t counters_size_ = 0;
+    };
+
+}
+
+#endif /* xml_path_filter_h */
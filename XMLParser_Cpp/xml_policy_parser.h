@@ -0,0 +1,41 @@
+//
+//  xml_policy_parser.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_policy_parser_h
+#define xml_policy_parser_h
+
+#include "xml_document.h"
+#include "xml_node_builder.h"
+
+#include <string>
+
+namespace bbxml {
+
+    /**
+     * Same as parse_xml(), with the features of `Flags`, xml_parse_flags, only.
+     * The parser is instantiated for the flags, so a feature off costs nothing; parse_xml<xml_parse_default>() is parse_xml().
+     *
+     * e.g.
+     * parse_xml<xml_parse_trusted>(text)                                  // a trusted feed; no checks of the names, no references
+     * parse_xml<xml_parse_default | xml_parse_keep_comments>(text)        // with the comments
+     *
+     * Without xml_parse_validate_names and xml_parse_decode_entities, an illegal name or an illegal reference is not an error,
+     * and it is kept in the document as it is.
+     */
+    template <unsigned Flags>
+    inline xml_document parse_xml(const char* first, const char* last, const xml_parse_limits& limits = xml_parse_limits()) {
+        bb::basic_xml_node_builder<bb::xml_no_stats, Flags> builder;
+        return bb::build_xml_document(first, last, builder, limits);
+    }
+
+    template <unsigned Flags>
+    inline xml_document parse_xml(const std::string& text, const xml_parse_limits& limits = xml_parse_limits()) {
+        return parse_xml<Flags>(text.data(), text.data() + text.size(), limits);
+    }
+
+}
+
+#endif /* xml_policy_parser_h */
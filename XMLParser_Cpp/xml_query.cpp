@@ -0,0 +1,279 @@
+//
+//  xml_query.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_query.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace bbxml;
+
+namespace {
+    constexpr size_t max_steps = 64;    // the bits of the states
+
+    inline bool is_name_char(char c);
+}
+
+/**
+ * The state of an evaluation; the names are resolved again whenever the names of the nodes change their table
+ */
+struct xml_query::evaluation {
+    const xml_query& query;
+    visitor visit;
+    void* function;
+    const xml_name_table* table;
+    std::vector<xml_name> names;
+    std::vector<uint32_t> counters;     // the positions of the siblings, for every depth
+
+    evaluation(const xml_query& query, visitor visit, void* function)
+    : query(query), visit(visit), function(function), table(query.table_.get()), names(query.names_) {
+    }
+
+    void resolve(const xml_name_table* table) {
+        this->table = table;
+        for (size_t i = 0; i < names.size(); ++i) {
+            auto name = table ? table->find(query.names_[i]) : xml_name();
+            names[i] = name.empty() ? query.names_[i] : name;
+        }
+    }
+
+    /**
+     * Matches the siblings against the steps in `states`, and walks down to their children with the steps reached
+     *
+     * @return false if the function stopped the evaluation
+     */
+    bool walk(const std::shared_ptr<xml_node>* first, const std::shared_ptr<xml_node>* last, uint64_t states, size_t depth) {
+        const auto base = depth * query.counters_size_;
+        if (counters.size() < base + query.counters_size_) {
+            counters.resize(base + query.counters_size_);
+        }
+        std::fill_n(counters.begin() + base, query.counters_size_, 0);
+
+        for (auto itr = first; itr != last; ++itr) {
+            const auto& node = *itr;
+            if (!node) {
+                continue;
+            }
+            if (node->name.table() != table) {
+                resolve(node->name.table());
+            }
+            if (node->name == names[0]) {     // A text node
+                continue;
+            }
+
+            uint64_t next_states = 0;
+            bool is_selected = false;
+            size_t index = 0;
+            for (auto rest = states; rest != 0; rest >>= 1, ++index) {
+                if ((rest & 1) == 0) {
+                    continue;
+                }
+                const auto& step = query.steps_[index];
+                if (step.is_descendant) {
+                    next_states |= uint64_t(1) << index;
+                }
+                if (matches(step, *node, base)) {
+                    if (index + 1 == query.steps_.size()) {
+                        is_selected = true;
+                    }
+                    else {
+                        next_states |= uint64_t(1) << (index + 1);
+                    }
+                }
+            }
+
+            if (is_selected && !visit(function, node)) {
+                return false;
+            }
+            if (next_states != 0 && !node->nodes.empty()) {
+                if (!walk(node->nodes.data(), node->nodes.data() + node->nodes.size(), next_states, depth + 1)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool matches(const step& step, const xml_node& node, size_t base) {
+        if (!step.is_any && node.name != names[step.name]) {
+            return false;
+        }
+        for (const auto& predicate : step.predicates) {
+            if (predicate.type == predicate::kind::position) {
+                if (++counters[base + predicate.counter] != predicate.position) {
+                    return false;
+                }
+                continue;
+            }
+            const auto& key = names[predicate.position];
+            auto attribute = std::find_if(node.attributes.begin(), node.attributes.end(), [&](const xml_attributes::value_type& attribute) {
+                return attribute.first == key;
+            });
+            if (attribute == node.attributes.end()) {
+                return false;
+            }
+            if ((predicate.type == predicate::kind::attribute_equal && attribute->second != predicate.value) ||
+                (predicate.type == predicate::kind::attribute_not_equal && attribute->second == predicate.value)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+xml_query::xml_query(std::string_view expression) : expression_(expression), table_(std::make_shared<xml_name_table>()) {
+    names_.push_back(table_->intern("#text"));
+
+    size_t i = 0;
+    auto fail = [&](const char* reason) {
+        throw std::invalid_argument("Illegal path expression \"" + expression_ + "\" at " + std::to_string(i) + ": " + reason);
+    };
+    auto parse_name = [&]() {
+        auto name_first = i;
+        while (i < expression.size() && is_name_char(expression[i])) {
+            ++i;
+        }
+        if (i == name_first) {
+            fail("a name is expected");
+        }
+        auto name = table_->intern(expression.substr(name_first, i - name_first));
+        auto found = std::find(names_.begin(), names_.end(), name);
+        if (found != names_.end()) {
+            return static_cast<size_t>(found - names_.begin());
+        }
+        names_.push_back(name);
+        return names_.size() - 1;
+    };
+
+    bool is_descendant = false;
+    if (i < expression.size() && expression[i] == '/') {
+        is_absolute_ = true;
+        is_descendant = i + 1 < expression.size() && expression[i + 1] == '/';
+        i += is_descendant ? 2 : 1;
+    }
+    while (true) {
+        step step{is_descendant, false, 0, {}};
+        if (i < expression.size() && expression[i] == '*') {
+            step.is_any = true;
+            ++i;
+        }
+        else {
+            step.name = parse_name();
+        }
+
+        while (i < expression.size() && expression[i] == '[') {
+            ++i;
+            predicate predicate{predicate::kind::position, 0, 0, {}};
+            if (i < expression.size() && expression[i] == '@') {
+                ++i;
+                predicate.position = parse_name();
+                if (i < expression.size() && expression[i] == '=') {
+                    predicate.type = predicate::kind::attribute_equal;
+                    ++i;
+                }
+                else if (expression.compare(i, 2, "!=") == 0) {
+                    predicate.type = predicate::kind::attribute_not_equal;
+                    i += 2;
+                }
+                else {
+                    predicate.type = predicate::kind::has_attribute;
+                }
+                if (predicate.type != predicate::kind::has_attribute) {
+                    if (i >= expression.size() || (expression[i] != '\'' && expression[i] != '"')) {
+                        fail("a literal is expected");
+                    }
+                    auto quote = expression.find(expression[i], i + 1);
+                    if (quote == std::string_view::npos) {
+                        fail("the literal is not closed");
+                    }
+                    predicate.value.assign(expression.substr(i + 1, quote - i - 1));
+                    i = quote + 1;
+                }
+            }
+            else if (i < expression.size() && expression[i] >= '0' && expression[i] <= '9') {
+                for (; i < expression.size() && expression[i] >= '0' && expression[i] <= '9'; ++i) {
+                    predicate.position = predicate.position * 10 + (expression[i] - '0');
+                    if (predicate.position > UINT32_MAX) {
+                        fail("the position is too large");
+                    }
+                }
+                if (predicate.position == 0) {
+                    fail("a position begins at 1");
+                }
+                predicate.counter = counters_size_++;
+            }
+            else {
+                fail("a position or an attribute is expected");
+            }
+            if (i >= expression.size() || expression[i] != ']') {
+                fail("\"]\" is expected");
+            }
+            ++i;
+            step.predicates.push_back(std::move(predicate));
+        }
+
+        steps_.push_back(std::move(step));
+        if (steps_.size() > max_steps) {
+            fail("too many steps");
+        }
+        if (i == expression.size()) {
+            break;
+        }
+        if (expression[i] != '/') {
+            fail("\"/\" is expected");
+        }
+        is_descendant = i + 1 < expression.size() && expression[i + 1] == '/';
+        i += is_descendant ? 2 : 1;
+    }
+}
+
+std::vector<std::shared_ptr<xml_node>> xml_query::select(const xml_document& document) const {
+    std::vector<std::shared_ptr<xml_node>> nodes;
+    for_each(document, [&](const std::shared_ptr<xml_node>& node) { nodes.push_back(node); });
+    return nodes;
+}
+
+std::vector<std::shared_ptr<xml_node>> xml_query::select(const std::shared_ptr<xml_node>& context) const {
+    std::vector<std::shared_ptr<xml_node>> nodes;
+    for_each(context, [&](const std::shared_ptr<xml_node>& node) { nodes.push_back(node); });
+    return nodes;
+}
+
+std::shared_ptr<xml_node> xml_query::select_first(const xml_document& document) const {
+    std::shared_ptr<xml_node> first;
+    for_each(document, [&](const std::shared_ptr<xml_node>& node) { first = node; return false; });
+    return first;
+}
+
+std::shared_ptr<xml_node> xml_query::select_first(const std::shared_ptr<xml_node>& context) const {
+    std::shared_ptr<xml_node> first;
+    for_each(context, [&](const std::shared_ptr<xml_node>& node) { first = node; return false; });
+    return first;
+}
+
+void xml_query::evaluate(const std::shared_ptr<xml_node>* first, const std::shared_ptr<xml_node>* last, visitor visit, void* function) const {
+    evaluation evaluation{*this, visit, function};
+    evaluation.walk(first, last, 1, 0);
+}
+
+namespace {
+
+    /**
+     * Any character but the delimiters of the expression; names are not validated more than the tag names
+     */
+    inline bool is_name_char(char c) {
+        switch (c) {
+            case '/': case '[': case ']': case '@': case '=': case '!': case '*':
+            case '\'': case '"': case '<': case '>': case '&':
+            case ' ': case '\t': case '\r': case '\n':
+                return false;
+            default:
+                return true;
+        }
+    }
+
+}
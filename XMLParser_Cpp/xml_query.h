@@ -0,0 +1,128 @@
+//
+//  xml_query.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_query_h
+#define xml_query_h
+
+#include "xml_document.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace bbxml {
+
+    /**
+     * A path expression compiled once, to select elements of a tree in the document order.
+     *
+     * It accepts a subset of XPath 1.0:
+     *   path      := ("/" | "//")? step (("/" | "//") step)*
+     *   step      := ("*" | name) predicate*
+     *   predicate := "[" number "]" | "[@" name "]" | "[@" name ("=" | "!=") literal "]"
+     * e.g. "/catalog/book[@id='bk101']/price", "//book[2]/title", "*[@id]"
+     *
+     * "//" selects the descendants same as XPath, so a position counts among the siblings.
+     * A relative path begins at the children of the context node; the root node is the only child of a document.
+     *
+     * The tree is walked once with the steps reached at every node, so every node is selected at most once
+     * and no node set is collected between the steps. The names are compared by pointers in the table of the nodes.
+     * A query is not changed by an evaluation, and can be evaluated on many threads at once.
+     */
+    class xml_query {
+    public:
+        /**
+         * @throw std::invalid_argument if the expression is not in the subset
+         */
+        explicit xml_query(std::string_view expression);
+
+        const std::string& expression() const noexcept { return expression_; }
+
+        /**
+         * Calls `function(const std::shared_ptr<xml_node>&)` for the selected nodes in the document order.
+         * It stops when the function returns false, if it returns bool.
+         */
+        template <class Function>
+        void for_each(const xml_document& document, Function&& function) const {
+            evaluate(&document.root_node, &document.root_node + 1, &invoke<Function>, address_of(function));
+        }
+
+        template <class Function>
+        void for_each(const std::shared_ptr<xml_node>& context, Function&& function) const {
+            if (is_absolute_) {
+                auto top = context;
+                while (auto parent = top->parent.lock()) {
+                    top = std::move(parent);
+                }
+                evaluate(&top, &top + 1, &invoke<Function>, address_of(function));
+            }
+            else {
+                evaluate(context->nodes.data(), context->nodes.data() + context->nodes.size(), &invoke<Function>, address_of(function));
+            }
+        }
+
+        std::vector<std::shared_ptr<xml_node>> select(const xml_document& document) const;
+        std::vector<std::shared_ptr<xml_node>> select(const std::shared_ptr<xml_node>& context) const;
+
+        /**
+         * @return nullptr if no node is selected
+         */
+        std::shared_ptr<xml_node> select_first(const xml_document& document) const;
+        std::shared_ptr<xml_node> select_first(const std::shared_ptr<xml_node>& context) const;
+
+    private:
+        friend class xml_path_filter;
+
+        struct predicate {
+            enum class kind { position, has_attribute, attribute_equal, attribute_not_equal };
+            kind type;
+            size_t position;        // 1-origin position, or the index of the key in the names
+            size_t counter;         // the index of the counter of a position
+            std::string value;
+        };
+
+        struct step {
+            bool is_descendant;
+            bool is_any;            // "*"
+            size_t name;            // the index in the names
+            std::vector<predicate> predicates;
+        };
+
+        struct evaluation;
+
+        typedef bool (*visitor)(void* function, const std::shared_ptr<xml_node>& node);
+
+        template <class Function>
+        static bool invoke(void* function, const std::shared_ptr<xml_node>& node) {
+            auto& f = *static_cast<std::remove_reference_t<Function>*>(function);
+            if constexpr (std::is_same_v<decltype(f(node)), void>) {
+                f(node);
+                return true;
+            }
+            else {
+                return static_cast<bool>(f(node));
+            }
+        }
+
+        template <class Function>
+        static void* address_of(Function& function) noexcept {
+            return const_cast<void*>(static_cast<const void*>(std::addressof(function)));
+        }
+
+        void evaluate(const std::shared_ptr<xml_node>* first, const std::shared_ptr<xml_node>* last, visitor visit, void* function) const;
+
+        std::string expression_;
+        bool is_absolute_ = false;
+        std::vector<step> steps_;
+        std::shared_ptr<xml_name_table> table_;     // of the names, which are compared by the characters until resolved in the table of the nodes
+        std::vector<xml_name> names_;               // "#text" and the names in the expression
+        size_t counters_size_ = 0;                  // the number of the positional predicates
+    };
+
+}
+
+#endif /* xml_query_h */
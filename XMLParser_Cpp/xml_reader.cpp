@@ -0,0 +1,244 @@
+//
+//  xml_reader.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_reader.h"
+#include "xml_parser.h"
+
+using namespace bbxml;
+
+namespace {
+    /**
+     * A token reported by the tokenizer; [first, last) is the name of a tag, or the content of the others
+     */
+    struct xml_token_span {
+        xml_token type;
+        const char* first;
+        const char* last;
+        size_t depth;
+        bool is_escaped;        // a text with an entity
+        bool is_independent;
+    };
+
+    /**
+     * Builds nothing; skips a subtree with the checks of the tokenizer only
+     */
+    struct xml_skip_builder {
+        const char* end_name_first = nullptr;   // of the last end tag
+        const char* end_name_last = nullptr;
+
+        void text(const char*, const char*) {}
+        void cdata(const char*, const char*) {}
+        void comment(const char*, const char*) {}
+        void start_element(const char*, const char*, const std::vector<bb::xml_attribute_span>&, bool) {}
+        void end_element(const char* name_first, const char* name_last) {
+            end_name_first = name_first;
+            end_name_last = name_last;
+        }
+    };
+}
+
+/**
+ * Runs bb::parse_xml_markup() once per a text and a markup, and queues the tokens of them;
+ * a text, a tag and the end of an independent tag at most.
+ */
+struct xml_reader::state {
+    bb::char_cursor cursor;
+    bb::xml_open_elements open_elements;
+    std::vector<bb::xml_attribute_span> spans;     // of the last start tag
+    size_t depth = 0;
+
+    xml_token_span tokens[3];
+    size_t tokens_size = 0;
+    size_t token_index = 0;
+    bool is_end = false;
+
+    std::string_view version;
+    xml_sax_attributes declaration_attributes;
+    std::vector<std::string> declaration_values;
+
+    // Made on demand for the current token
+    mutable bool has_attributes = false;
+    mutable xml_sax_attributes attributes;
+    mutable std::vector<std::string> unescaped_values;
+    mutable std::string unescaped_text;
+
+    state(std::string_view text, const xml_parse_limits& limits) : cursor(bb::make_char_cursor(text.data(), text.data() + text.size())) {
+        open_elements.limits = limits;
+    }
+
+    const xml_token_span& current() const {
+        return tokens[token_index];
+    }
+
+    void push(xml_token type, const char* first, const char* last, size_t depth, bool is_escaped = false, bool is_independent = false) {
+        tokens[tokens_size++] = {type, first, last, depth, is_escaped, is_independent};
+    }
+
+    // Builder
+
+    void declaration(const char* version_first, const char* version_last, const std::vector<bb::xml_attribute_span>& attributes) {
+        version = std::string_view(version_first, version_last - version_first);
+        bb::make_xml_attribute_views(attributes, declaration_attributes, declaration_values);
+    }
+
+    void text(const char* first, const char* last) {
+        push(xml_token::text, first, last, depth, bb::validate_xml_inner_text(first, last));
+    }
+
+    void cdata(const char* first, const char* last) {
+        push(xml_token::cdata, first, last, depth);
+    }
+
+    void comment(const char* first, const char* last) {
+        push(xml_token::comment, first, last, depth);
+    }
+
+    /**
+     * The values are checked now, same as parse_xml(), and unescaped when they are asked for
+     */
+    void start_element(const char* name_first, const char* name_last, const std::vector<bb::xml_attribute_span>& attributes, bool is_independent) {
+        for (const auto& attribute : attributes) {
+            bb::validate_xml_attribute_value(attribute);
+        }
+        push(xml_token::start_element, name_first, name_last, depth + 1, false, is_independent);
+        if (is_independent) {
+            push(xml_token::end_element, name_first, name_last, depth + 1);
+        }
+        else {
+            ++depth;
+        }
+    }
+
+    void end_element(const char* name_first, const char* name_last) {
+        push(xml_token::end_element, name_first, name_last, depth);
+        --depth;
+    }
+};
+
+xml_reader::xml_reader(std::string_view text, const xml_parse_limits& limits) : state_(new state(text, limits)) {
+    auto& s = *state_;
+    bb::parse_xml_declaration(s.cursor, s, s.spans, limits);
+    s.push(xml_token::end_of_document, nullptr, nullptr, 0);   // no token yet
+}
+
+xml_reader::~xml_reader() {
+}
+
+xml_token xml_reader::next() {
+    auto& s = *state_;
+    s.has_attributes = false;
+    if (++s.token_index < s.tokens_size) {
+        return s.current().type;
+    }
+
+    s.tokens_size = 0;
+    s.token_index = 0;
+    while (s.tokens_size == 0 && !s.is_end) {
+        if (s.cursor.current == s.cursor.end || !bb::parse_xml_markup(s.cursor, s, s.spans, s.open_elements)) {
+            bb::parse_xml_end(s.cursor);
+            s.is_end = true;
+        }
+    }
+    if (s.tokens_size == 0) {
+        s.push(xml_token::end_of_document, s.cursor.end, s.cursor.end, 0);
+    }
+    return s.current().type;
+}
+
+void xml_reader::skip_subtree() {
+    auto& s = *state_;
+    const auto start = s.current();
+    if (start.type != xml_token::start_element) {
+        return;
+    }
+    if (start.is_independent) {
+        next();
+        return;
+    }
+
+    // The start tag is the last token of the queue; the tokenizer stops just after it
+    xml_skip_builder builder;
+    const auto open_size = s.open_elements.size();
+    while (s.open_elements.size() >= open_size) {
+        if (s.cursor.current == s.cursor.end || !bb::parse_xml_markup(s.cursor, builder, s.spans, s.open_elements)) {
+            // Unclosed to the end, which parse_xml() allows
+            s.depth = s.open_elements.size();
+            next();
+            return;
+        }
+    }
+    s.depth = s.open_elements.size();
+    s.tokens_size = 0;
+    s.token_index = 0;
+    s.has_attributes = false;
+    s.push(xml_token::end_element, builder.end_name_first, builder.end_name_last, start.depth);
+}
+
+xml_token xml_reader::token() const noexcept {
+    return state_->current().type;
+}
+
+std::string_view xml_reader::name() const noexcept {
+    const auto& token = state_->current();
+    if (token.type != xml_token::start_element && token.type != xml_token::end_element) {
+        return std::string_view();
+    }
+    return std::string_view(token.first, token.last - token.first);
+}
+
+const xml_sax_attributes& xml_reader::attributes() const {
+    auto& s = *state_;
+    if (!s.has_attributes) {
+        if (s.current().type == xml_token::start_element) {
+            bb::make_xml_attribute_views(s.spans, s.attributes, s.unescaped_values);
+        }
+        else {
+            s.attributes.clear();
+        }
+        s.has_attributes = true;
+    }
+    return s.attributes;
+}
+
+std::string_view xml_reader::value() const {
+    const auto& token = state_->current();
+    switch (token.type) {
+        case xml_token::text:
+            if (token.is_escaped) {
+                state_->unescaped_text = bb::unescape_xml_inner_text(token.first, token.last);
+                return state_->unescaped_text;
+            }
+            return std::string_view(token.first, token.last - token.first);
+        case xml_token::cdata:
+        case xml_token::comment:
+            return std::string_view(token.first, token.last - token.first);
+        default:
+            return std::string_view();
+    }
+}
+
+bool xml_reader::is_empty_element() const noexcept {
+    const auto& token = state_->current();
+    return token.type == xml_token::start_element && token.is_independent;
+}
+
+size_t xml_reader::depth() const noexcept {
+    return state_->current().depth;
+}
+
+xml_position xml_reader::position() const {
+    const auto& s = *state_;
+    const auto itr = s.current().first;
+    return s.cursor.position_of(itr ? itr : s.cursor.begin);
+}
+
+std::string_view xml_reader::version() const noexcept {
+    return state_->version;
+}
+
+const xml_sax_attributes& xml_reader::declaration_attributes() const noexcept {
+    return state_->declaration_attributes;
+}
@@ -0,0 +1,105 @@
+//
+//  xml_reader.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_reader_h
+#define xml_reader_h
+
+#include "xml_document.h"
+#include "xml_sax_parser.h"
+
+#include <memory>
+#include <string_view>
+
+namespace bbxml {
+
+    enum class xml_token {
+        end_of_document,
+        start_element,
+        end_element,    // also follows an independent tag, "<a/>"
+        text,           // texts of only spaces too, same as xml_sax_handler
+        cdata,
+        comment,
+    };
+
+    /**
+     * Reads a XML document token by token; the pull counterpart of parse_xml_sax().
+     *
+     * next() runs the tokenizer of parse_xml() up to the next token, with the same checks and the same errors,
+     * so a consumer can stop as soon as it has what it needs, and the rest of the text is never read.
+     * The attributes are unescaped, and a text is unescaped, only when they are asked for.
+     *
+     * The text must outlive the reader; every string is valid until the next call of next() or skip_subtree().
+     */
+    class xml_reader {
+    public:
+        /**
+         * Reads the XML declaration
+         *
+         * @throw xml_error same as parse_xml()
+         */
+        explicit xml_reader(std::string_view text, const xml_parse_limits& limits = xml_parse_limits());
+        ~xml_reader();
+
+        /**
+         * Moves to the next token
+         *
+         * @return end_of_document at the end, and after it
+         * @throw xml_error same as parse_xml(); the reader can not be used any more then
+         */
+        xml_token next();
+
+        /**
+         * Skips the contents of the current start element, and moves to its end tag.
+         * The skipped tags are checked to be nested right, but the texts and the attributes in them are not unescaped nor checked.
+         * Does nothing unless the current token is start_element.
+         *
+         * @throw xml_error same as next()
+         */
+        void skip_subtree();
+
+        xml_token token() const noexcept;
+
+        /**
+         * The name of start_element or end_element
+         */
+        std::string_view name() const noexcept;
+
+        /**
+         * The attributes of start_element in the document order, with the values unescaped
+         */
+        const xml_sax_attributes& attributes() const;
+
+        /**
+         * The text unescaped, or the content of cdata or comment
+         */
+        std::string_view value() const;
+
+        /**
+         * Whether start_element is of an independent tag, "<a/>"
+         */
+        bool is_empty_element() const noexcept;
+
+        /**
+         * The number of the elements open; a start element and its end tag are counted in it
+         */
+        size_t depth() const noexcept;
+
+        /**
+         * The position of the head of the token; of its name for a tag
+         */
+        xml_position position() const;
+
+        std::string_view version() const noexcept;
+        const xml_sax_attributes& declaration_attributes() const noexcept;
+
+    private:
+        struct state;
+        std::unique_ptr<state> state_;
+    };
+
+}
+
+#endif /* xml_reader_h */
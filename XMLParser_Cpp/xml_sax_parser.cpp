@@ -0,0 +1,492 @@
+//
+//  xml_sax_parser.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_sax_parser.h"
+#include "xml_node_builder.h"
+#include "xml_parser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <optional>
+
+using namespace bbxml;
+
+namespace {
+    /**
+     * Turns the builder protocol of bb::parse_xml() into the events of xml_sax_handler
+     */
+    struct xml_sax_builder {
+        xml_sax_handler& handler;
+        xml_sax_attributes attributes;
+        std::vector<std::string> unescaped_values;
+
+        explicit xml_sax_builder(xml_sax_handler& handler) : handler(handler) {}
+
+        void declaration(const char* version_first, const char* version_last, const std::vector<bb::xml_attribute_span>& attributes) {
+            bb::make_xml_attribute_views(attributes, this->attributes, unescaped_values);
+            handler.declaration(std::string_view(version_first, version_last - version_first), this->attributes);
+        }
+
+        void text(const char* first, const char* last) {
+            if (!bb::validate_xml_inner_text(first, last)) {
+                handler.text(std::string_view(first, last - first));
+            }
+            else {
+                handler.text(bb::unescape_xml_inner_text(first, last));
+            }
+        }
+
+        void cdata(const char* first, const char* last) {
+            handler.cdata(std::string_view(first, last - first));
+        }
+
+        void comment(const char* first, const char* last) {
+            handler.comment(std::string_view(first, last - first));
+        }
+
+        void start_element(const char* name_first, const char* name_last, const std::vector<bb::xml_attribute_span>& attributes, bool is_independent) {
+            const auto name = std::string_view(name_first, name_last - name_first);
+            bb::make_xml_attribute_views(attributes, this->attributes, unescaped_values);
+            handler.start_element(name, this->attributes);
+            if (is_independent) {
+                handler.end_element(name);
+            }
+        }
+
+        void end_element(const char* name_first, const char* name_last) {
+            handler.end_element(std::string_view(name_first, name_last - name_first));
+        }
+    };
+
+    inline const char* find_last(const char* first, const char* last, char c) {
+        auto found = std::find(std::make_reverse_iterator(last), std::make_reverse_iterator(first), c);
+        return (found.base() == first) ? last : found.base() - 1;
+    }
+
+    /**
+     * Whether [amp, last) without ";" can be the head of a reference; one of the five entities, or "&#" and digits
+     */
+    inline bool is_reference_head(const char* amp, const char* last) {
+        auto itr = amp + 1;
+        if (itr < last && *itr == '#') {
+            ++itr;
+            const bool is_hex = itr < last && *itr == 'x';
+            if (is_hex) {
+                ++itr;
+            }
+            return std::all_of(itr, last, [=](char c) { return is_hex ? std::isxdigit(static_cast<unsigned char>(c)) != 0 : (c >= '0' && c <= '9'); });
+        }
+        const auto size = static_cast<size_t>(last - itr);
+        for (const char* name : {"lt;", "gt;", "amp;", "apos;", "quot;"}) {
+            if (std::strncmp(name, itr, size) == 0 && name[size] != '\0') {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+/**
+ * Runs the tokenizer of bb::parse_xml() step by step over a chunk,
+ * only on a markup whose end is in the chunk; the rest is kept in `buffer` for the next chunk.
+ */
+struct xml_push_parser::state {
+    xml_sax_builder builder;
+    std::vector<bb::xml_attribute_span> attributes;
+    bb::xml_open_elements open_elements;
+    bool is_declared = false;
+
+    std::string buffer;     // the rest of the previous chunks
+    size_t base = 0;        // the offset of the head of the buffer in the document
+    size_t line = 1;
+    size_t line_head = 0;
+    size_t resume = 0;      // the offset to resume searching the end of an unfinished markup
+
+    bool is_in_cdata = false;
+    xml_position cdata_position;
+    size_t cdata_size = 0;      // the size of the CDATA section reported so far
+
+    bool has_partial_text = false;  // a text without "<" after it is reported in part
+    bool is_partial_text_space = true;
+    xml_position partial_text_position;
+    size_t checked_tag_size = 0;    // of the unfinished tag checked the last time, to check it again only when it has doubled
+
+    /**
+     * An unfinished markup, or a text at the top level, which fails whatever follows it, but whose error depends on whether it ends;
+     * the rest of it is dropped up to `end` instead of kept
+     */
+    struct pending_failure {
+        std::string_view end;
+        xml_error if_ended;
+        std::optional<xml_error> if_not_ended;      // none for spaces at the top level, which may end the document
+        std::optional<xml_error> if_not_space;      // of a text at the top level, once it has anything but spaces
+    };
+    std::optional<pending_failure> failure;
+
+    state(xml_sax_handler& handler, const xml_parse_limits& limits) : builder{handler} {
+        open_elements.limits = limits;
+    }
+
+    /**
+     * @return the size of the parsed head of [first, last)
+     */
+    size_t parse(const char* first, const char* last, bool is_last) {
+        bb::char_cursor cursor{first, last, first, {first, base, first, line_head, line}};
+        if (failure) {
+            return skip_failure(first, last, is_last);
+        }
+
+        if (!is_declared) {
+            if (!is_last && !is_declaration_complete(first, last)) {
+                // Over a limit, or illegal already, it does not wait for "?>"
+                if (auto error = bb::check_xml_unclosed_declaration(cursor, attributes, open_elements.limits)) {
+                    failure = pending_failure{"?>", std::move(*error), make_xml_error(xml_error_code::no_xml_declaration, "No XML declaration", cursor.position_of(first)), std::nullopt};
+                    const auto parsed = static_cast<size_t>(last - first) - 1;     // keeps "?" of "?>"
+                    base += parsed;
+                    return parsed;
+                }
+                return 0;
+            }
+            bb::parse_xml_declaration(cursor, builder, attributes, open_elements.limits);
+            is_declared = true;
+        }
+
+        while (cursor.current < cursor.end) {
+            if (is_in_cdata) {
+                if (!parse_cdata(cursor, is_last)) {
+                    break;
+                }
+                continue;
+            }
+            if (!is_last && !is_markup_complete(cursor)) {
+                if (is_in_cdata) {
+                    continue;
+                }
+                break;
+            }
+            if (!bb::parse_xml_markup(cursor, builder, attributes, open_elements)) {
+                break;
+            }
+            resume = 0;
+            checked_tag_size = 0;
+            has_partial_text = false;
+        }
+        if (failure) {
+            cursor.current = cursor.end;
+        }
+
+        if (is_last) {
+            if (is_in_cdata) {
+                throw make_xml_error(xml_error_code::missing_closing_tag, "Missing an end of the CDATA section", cdata_position);
+            }
+            // The text at the end of the document is checked as a whole, same as bb::parse_xml()
+            if (has_partial_text && !(is_partial_text_space && bb::is_space(cursor.current, cursor.end))) {
+                throw make_xml_error(xml_error_code::illegal_format, "Illegal format", partial_text_position);
+            }
+            bb::parse_xml_end(cursor);
+        }
+
+        cursor.lines.advance(cursor.current);
+        const auto parsed = static_cast<size_t>(cursor.current - first);
+        base += parsed;
+        line = cursor.lines.line;
+        line_head = cursor.lines.line_head;
+        return parsed;
+    }
+
+    /**
+     * Waits for "?>" after the quote closing the version, same as bb::parse_xml_declaration(),
+     * unless the head is not "<?xml" \s+ "version=\"" already
+     */
+    bool is_declaration_complete(const char* first, const char* last) const {
+        const auto size = std::min<size_t>(last - first, 5);
+        if (std::memcmp(first, "<?xml", size) != 0 || (last - first > 5 && !bb::is_space(first[5]))) {
+            return true;
+        }
+        auto itr = first + size;
+        while (itr < last && bb::is_space(*itr)) {
+            ++itr;
+        }
+        if (std::memcmp(itr, "version=\"", std::min<size_t>(last - itr, 9)) != 0) {
+            return true;
+        }
+        if (last - itr <= 9) {
+            return false;
+        }
+        auto version_last = bb::find(itr + 10, last, '"');
+        if (version_last != last && bb::has_xml_newline(itr + 9, version_last)) {
+            return true;    // fails as no declaration
+        }
+        return version_last != last && bb::search(version_last, last, "?>") != last;
+    }
+
+    /**
+     * Reports the text before an unfinished markup, and the text without "<" up to an entity which may be split.
+     * A text at the top level is kept, since a text at the end of the document is an error instead.
+     *
+     * @return whether the markup after the text ends in the chunk; a CDATA section is entered instead
+     */
+    bool is_markup_complete(bb::char_cursor& cursor) {
+        cursor.lines.advance(cursor.current);
+
+        auto lt = bb::find(cursor.current, cursor.end, '<');
+        if (lt == cursor.end) {
+            if (!open_elements.empty()) {
+                // An entity is kept for the next chunk only while it can still be a reference, and the text is in the limit;
+                // otherwise the text is reported to its end, and fails there same as bb::parse_xml()
+                auto amp = find_last(cursor.current, cursor.end, '&');
+                const auto is_pending = amp != cursor.end && bb::find(amp, cursor.end, ';') == cursor.end && is_reference_head(amp, cursor.end)
+                    && open_elements.text_size_before + (cursor.end - cursor.current) <= open_elements.limits.max_text_length;
+                auto text_last = is_pending ? amp : cursor.end;
+                if (cursor.current < text_last) {
+                    if (!has_partial_text) {
+                        has_partial_text = true;
+                        is_partial_text_space = true;
+                        partial_text_position = cursor.position_of(cursor.current);
+                    }
+                    is_partial_text_space = is_partial_text_space && bb::is_space(cursor.current, text_last);
+                    const auto size = static_cast<size_t>(text_last - cursor.current);
+                    bb::parse_xml_text(cursor, builder, text_last, open_elements);
+                    open_elements.text_position = partial_text_position;
+                    open_elements.text_size_before += size;
+                }
+            }
+            else if (static_cast<size_t>(cursor.end - cursor.current) > open_elements.limits.max_text_length) {
+                // A text at the top level over the limit fails if "<" follows it, and is not an error at the end of the document only if it is of spaces
+                const auto position = cursor.position_of(cursor.current);
+                auto illegal_format = make_xml_error(xml_error_code::illegal_format, "Illegal format", position);
+                failure = pending_failure{"<", make_xml_error(xml_error_code::too_long_text, "Too long text", position), std::nullopt, illegal_format};
+                if (!bb::is_space(cursor.current, cursor.end)) {
+                    failure->if_not_ended = illegal_format;
+                }
+            }
+            return false;
+        }
+        has_partial_text = false;
+
+        const auto tag_name_first = lt + 1;
+        const auto rest = static_cast<size_t>(cursor.end - tag_name_first);
+        if ((rest < 3 && std::memcmp(tag_name_first, "!--", rest) == 0) || (rest < 8 && std::memcmp(tag_name_first, "![CDATA[", rest) == 0)) {
+            bb::parse_xml_text(cursor, builder, lt, open_elements);
+            return false;
+        }
+
+        const auto resume_itr = (resume > base + (tag_name_first - cursor.begin)) ? cursor.begin + (resume - base) : tag_name_first;
+        if (bb::starts_with(tag_name_first, cursor.end, "!--")) {
+            auto dashes = bb::search(std::max(resume_itr, tag_name_first + 3), cursor.end, "--");
+            if (dashes != cursor.end && dashes + 2 < cursor.end) {
+                return true;
+            }
+            // The comment is at least up to the resuming point; over the limit, it fails without waiting for the end, after the text before it
+            const auto comment_last = (dashes != cursor.end) ? dashes : std::max(tag_name_first + 3, cursor.end - 1);
+            bb::parse_xml_text(cursor, builder, lt, open_elements);
+            bb::check_xml_limit(comment_last - (tag_name_first + 3), open_elements.limits.max_text_length, xml_error_code::too_long_text, "Too long comment", cursor, tag_name_first);
+            resume = base + comment_last - cursor.begin;
+        }
+        else if (bb::starts_with(tag_name_first, cursor.end, "![CDATA[")) {
+            // Reports the CDATA section as it arrives
+            bb::parse_xml_text(cursor, builder, lt, open_elements);
+            open_elements.text_size_before = 0;
+            cdata_position = cursor.position_of(tag_name_first);
+            cdata_size = 0;
+            is_in_cdata = true;
+            cursor.current = tag_name_first + 8;
+            return false;
+        }
+        else {
+            auto gt = bb::find(resume_itr, cursor.end, '>');
+            if (gt != cursor.end) {
+                return true;
+            }
+            resume = base + (cursor.end - cursor.begin);
+
+            // Over a limit, or illegal already, it does not wait for ">", after the text before it
+            bb::parse_xml_text(cursor, builder, lt, open_elements);
+            const auto size = static_cast<size_t>(cursor.end - tag_name_first);
+            if (size > 2 * checked_tag_size) {
+                checked_tag_size = size;
+                if (auto error = bb::check_xml_unclosed_tag<xml_sax_builder>(cursor, tag_name_first, attributes, open_elements)) {
+                    const auto tag_name_last = bb::scan_tag_name(tag_name_first, cursor.end);
+                    auto missing = make_xml_error(xml_error_code::missing_closing_tag, "Missing \">\" for the tag \"" + std::string(tag_name_first, tag_name_last) + "\"", cursor.position_of(tag_name_first));
+                    failure = pending_failure{">", std::move(*error), std::move(missing), std::nullopt};
+                }
+            }
+            return false;
+        }
+        bb::parse_xml_text(cursor, builder, lt, open_elements);
+        return false;
+    }
+
+    /**
+     * Drops [first, last) as a part of the failed markup or text, and throws its error at its end, or at the end of the document
+     *
+     * @return the size dropped; the last character is kept if it may be the head of the end
+     */
+    size_t skip_failure(const char* first, const char* last, bool is_last) {
+        auto& pending = *failure;
+        if (std::search(first, last, pending.end.begin(), pending.end.end()) != last) {
+            throw pending.if_ended;
+        }
+        if (pending.if_not_space && !pending.if_not_ended && !bb::is_space(first, last)) {
+            pending.if_not_ended = pending.if_not_space;
+        }
+        if (is_last) {
+            if (pending.if_not_ended) {
+                throw *pending.if_not_ended;
+            }
+            return last - first;
+        }
+        const auto parsed = static_cast<size_t>(last - first) - std::min<size_t>(last - first, pending.end.size() - 1);
+        base += parsed;
+        return parsed;
+    }
+
+    /**
+     * Reports the CDATA section up to "]]>", or up to "]]" which may be the head of "]]>"
+     *
+     * The section is checked and counted same as bb::parse_xml_markup(); the size up to the end of the document at last.
+     *
+     * @return whether "]]>" is found
+     */
+    bool parse_cdata(bb::char_cursor& cursor, bool is_last) {
+        auto cdata_last = bb::search(cursor.current, cursor.end, "]]>");
+        const auto found = (cdata_last != cursor.end);
+        if (!found && !is_last) {
+            cdata_last = std::max(cursor.current, cursor.end - 2);
+        }
+        const auto& limits = open_elements.limits;
+        if (cdata_size + (cdata_last - cursor.current) > limits.max_text_length) {
+            throw make_xml_error(xml_error_code::too_long_text, "Too long CDATA section", cdata_position);
+        }
+        if (found) {
+            if (++open_elements.nodes > limits.max_nodes) {
+                throw make_xml_error(xml_error_code::too_many_nodes, "Too many nodes", cdata_position);
+            }
+            builder.cdata(cursor.current, cdata_last);
+            cursor.current = cdata_last + 3;
+            is_in_cdata = false;
+            return true;
+        }
+        if (!is_last) {
+            if (cursor.current < cdata_last) {
+                builder.cdata(cursor.current, cdata_last);
+                cdata_size += cdata_last - cursor.current;
+                cursor.current = cdata_last;
+            }
+        }
+        return false;
+    }
+};
+
+xml_push_parser::xml_push_parser(xml_sax_handler& handler, const xml_parse_limits& limits) : state_(new state(handler, limits)) {
+}
+
+xml_push_parser::~xml_push_parser() {
+}
+
+/**
+ * Parses the chunk in place if nothing is kept, and copies only the rest
+ */
+void xml_push_parser::feed(const char* data, size_t size) {
+    auto& buffer = state_->buffer;
+    if (buffer.empty()) {
+        auto parsed = state_->parse(data, data + size, false);
+        buffer.assign(data + parsed, data + size);
+    }
+    else {
+        buffer.append(data, size);
+        auto parsed = state_->parse(buffer.data(), buffer.data() + buffer.size(), false);
+        buffer.erase(0, parsed);
+    }
+}
+
+void xml_push_parser::finish() {
+    auto& buffer = state_->buffer;
+    state_->parse(buffer.data(), buffer.data() + buffer.size(), true);
+    buffer.clear();
+}
+
+/**
+ * Drives the tree builder of parse_xml() by the events instead of the spans of the input
+ */
+struct xml_tree_handler::state {
+    bb::xml_node_builder builder;
+
+    bbxml::xml_attributes make_attributes(const xml_sax_attributes& attributes) {
+        bbxml::xml_attributes map;
+        for (const auto& attribute : attributes) {
+            map.set(builder.names->intern(attribute.first), std::string(attribute.second));
+        }
+        return map;
+    }
+};
+
+xml_tree_handler::xml_tree_handler() : state_(new state()) {
+}
+
+xml_tree_handler::~xml_tree_handler() {
+}
+
+void xml_tree_handler::declaration(std::string_view version, const xml_sax_attributes& attributes) {
+    auto& builder = state_->builder;
+    builder.version.assign(version);
+    builder.attributes = state_->make_attributes(attributes);
+}
+
+void xml_tree_handler::start_element(std::string_view name, const xml_sax_attributes& attributes) {
+    auto& builder = state_->builder;
+    auto node = std::make_shared<xml_node>();
+    node->parent = builder.current_node;
+    node->name = builder.names->intern(name);
+    node->attributes = state_->make_attributes(attributes);
+    node->names = builder.names;
+
+    builder.flush_text();
+    builder.current_node->nodes.push_back(node);
+    builder.current_node = std::move(node);
+}
+
+void xml_tree_handler::end_element(std::string_view name) {
+    auto& builder = state_->builder;
+    builder.end_element(name.data(), name.data() + name.size());
+}
+
+void xml_tree_handler::text(std::string_view text) {
+    state_->builder.inner_text_before_tag.append(text);
+}
+
+void xml_tree_handler::cdata(std::string_view text) {
+    state_->builder.inner_text_before_tag.append(text);
+}
+
+xml_document xml_tree_handler::take_document() {
+    // A text after the last tag is dropped, same as parse_xml()
+    auto& builder = state_->builder;
+    auto root_node = bb::find_xml_root_node(*builder.top_node);
+    if (root_node) {
+        root_node->parent.reset();
+    }
+    xml_document document{std::move(builder.version), std::move(builder.attributes), root_node, builder.names};
+    state_.reset(new state());
+    return document;
+}
+
+void bbxml::parse_xml_sax(std::string_view text, xml_sax_handler& handler, const xml_parse_limits& limits) {
+    auto cursor = bb::make_char_cursor(text.data(), text.data() + text.size());
+    xml_sax_builder builder{handler};
+    bb::parse_xml(cursor, builder, limits);
+}
+
+void bbxml::parse_xml_sax(std::istream& stream, xml_sax_handler& handler, size_t chunk_size, const xml_parse_limits& limits) {
+    xml_push_parser parser{handler, limits};
+    std::vector<char> chunk(chunk_size);
+    while (stream.read(chunk.data(), chunk.size()) || stream.gcount() > 0) {
+        parser.feed(chunk.data(), static_cast<size_t>(stream.gcount()));
+    }
+    parser.finish();
+}
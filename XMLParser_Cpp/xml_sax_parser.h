@@ -0,0 +1,109 @@
+//
+//  xml_sax_parser.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_sax_parser_h
+#define xml_sax_parser_h
+
+#include "xml_document.h"
+
+#include <istream>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace bbxml {
+
+    /**
+     * Attributes of a start tag in the document order, with the values unescaped
+     */
+    typedef std::vector<std::pair<std::string_view, std::string_view>> xml_sax_attributes;
+
+    /**
+     * Receives the events of xml_push_parser; every string is valid only during the call.
+     *
+     * A text or a CDATA section may be reported in several calls, split at any boundary of the chunks
+     * but never inside an entity. Texts of only spaces are reported too.
+     */
+    class xml_sax_handler {
+    public:
+        virtual ~xml_sax_handler() = default;
+
+        virtual void declaration(std::string_view /* version */, const xml_sax_attributes& /* attributes */) {}
+        virtual void start_element(std::string_view /* name */, const xml_sax_attributes& /* attributes */) {}
+        virtual void end_element(std::string_view /* name */) {}     // also follows an independent tag, "<a/>"
+        virtual void text(std::string_view /* text */) {}
+        virtual void cdata(std::string_view /* text */) {}
+        virtual void comment(std::string_view /* text */) {}
+    };
+
+    /**
+     * Builds xml_document from the events, the same document as parse_xml() of the whole text
+     *
+     * Comments are dropped, the texts and the CDATA sections between tags are joined, and the attributes are unescaped already.
+     */
+    class xml_tree_handler : public xml_sax_handler {
+    public:
+        xml_tree_handler();
+        ~xml_tree_handler() override;
+
+        void declaration(std::string_view version, const xml_sax_attributes& attributes) override;
+        void start_element(std::string_view name, const xml_sax_attributes& attributes) override;
+        void end_element(std::string_view name) override;
+        void text(std::string_view text) override;
+        void cdata(std::string_view text) override;
+
+        /**
+         * Takes the document after the last event, and begins another one
+         */
+        xml_document take_document();
+
+    private:
+        struct state;
+        std::unique_ptr<state> state_;
+    };
+
+    /**
+     * Parses a XML document pushed in chunks of any size, with the same checks as parse_xml().
+     *
+     * Only an unfinished tag, declaration, comment or entity is kept over chunks; texts and CDATA sections are reported as they arrive,
+     * so the memory is bounded by the chunk size and the limits, not by the document.
+     * The limits are checked as the parts arrive; a markup or a text over the limit fails before its end,
+     * and the rest of a tag or a declaration which is illegal already is dropped up to its end, where it fails.
+     *
+     * Once xml_error is thrown from feed() or finish(), the parser can not be used any more.
+     */
+    class xml_push_parser {
+    public:
+        explicit xml_push_parser(xml_sax_handler& handler, const xml_parse_limits& limits = xml_parse_limits());
+        ~xml_push_parser();
+
+        void feed(const char* data, size_t size);
+        void feed(std::string_view data) { feed(data.data(), data.size()); }
+
+        /**
+         * Tells the end of the document, and checks the rest
+         */
+        void finish();
+
+    private:
+        struct state;
+        std::unique_ptr<state> state_;
+    };
+
+    /**
+     * Parses a whole document in memory
+     */
+    extern void parse_xml_sax(std::string_view text, xml_sax_handler& handler, const xml_parse_limits& limits = xml_parse_limits());
+
+    /**
+     * Pushes a stream to xml_push_parser in chunks of `chunk_size` bytes
+     */
+    extern void parse_xml_sax(std::istream& stream, xml_sax_handler& handler, size_t chunk_size = 64 * 1024, const xml_parse_limits& limits = xml_parse_limits());
+
+}
+
+#endif /* xml_sax_parser_h */
@@ -0,0 +1,253 @@
+//
+//  xml_scan_kernels.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_scan_kernels.h"
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64)   // SSE2 is the baseline of x86-64
+#define BB_SCAN_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#define BB_TARGET_AVX2
+#else
+#include <immintrin.h>
+#define BB_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define BB_SCAN_X86 0
+#endif
+
+using namespace bb;
+
+namespace {
+    struct scan_kernels {
+        scan_isa isa;
+        const char* (*scan_either)(const char*, const char*, char, char);
+        const char* (*scan_sequence)(const char*, const char*, const char*, size_t);
+        const char* (*scan_non_space)(const char*, const char*);
+    };
+
+    inline const scan_kernels& kernels_of(scan_isa isa);
+    std::atomic<const scan_kernels*> current_kernels{nullptr};
+
+    inline const scan_kernels& kernels() {
+        auto kernels = current_kernels.load(std::memory_order_relaxed);
+        if (kernels == nullptr) {
+            kernels = &kernels_of(detected_scan_isa());
+            current_kernels.store(kernels, std::memory_order_relaxed);
+        }
+        return *kernels;
+    }
+
+    inline bool is_space(char c) {
+        return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+    }
+
+    inline unsigned count_trailing_zeros(uint32_t mask) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    // Scalar
+
+    const char* scan_either_scalar(const char* first, const char* last, char c0, char c1) {
+        return std::find_if(first, last, [=](char c) { return c == c0 || c == c1; });
+    }
+
+    const char* scan_sequence_scalar(const char* first, const char* last, const char* seq, size_t size) {
+        return std::search(first, last, seq, seq + size);
+    }
+
+    const char* scan_non_space_scalar(const char* first, const char* last) {
+        return std::find_if(first, last, [](char c) { return !is_space(c); });
+    }
+
+#if BB_SCAN_X86
+
+    // SSE2; 16 bytes at once
+
+    const char* scan_either_sse2(const char* first, const char* last, char c0, char c1) {
+        const auto needle0 = _mm_set1_epi8(c0);
+        const auto needle1 = _mm_set1_epi8(c1);
+        for (; last - first >= 16; first += 16) {
+            const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+            const uint32_t mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, needle0), _mm_cmpeq_epi8(chunk, needle1)));
+            if (mask != 0) {
+                return first + count_trailing_zeros(mask);
+            }
+        }
+        return scan_either_scalar(first, last, c0, c1);
+    }
+
+    /**
+     * Compares the first and the last characters of the sequence at once, then verifies the middle one.
+     */
+    const char* scan_sequence_sse2(const char* first, const char* last, const char* seq, size_t size) {
+        const auto head = _mm_set1_epi8(seq[0]);
+        const auto tail = _mm_set1_epi8(seq[size - 1]);
+        for (; static_cast<size_t>(last - first) >= 16 + size - 1; first += 16) {
+            const auto chunk_head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+            const auto chunk_tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + size - 1));
+            uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(chunk_head, head), _mm_cmpeq_epi8(chunk_tail, tail)));
+            while (mask != 0) {
+                const auto found = first + count_trailing_zeros(mask);
+                if (size < 3 || found[1] == seq[1]) {
+                    return found;
+                }
+                mask &= mask - 1;
+            }
+        }
+        return scan_sequence_scalar(first, last, seq, size);
+    }
+
+    /**
+     * "\s" is ' ' or '\t'...'\r'; (c - '\t') <= 4 as unsigned is min(c - '\t', 4) == c - '\t'
+     */
+    const char* scan_non_space_sse2(const char* first, const char* last) {
+        const auto space = _mm_set1_epi8(' ');
+        const auto tab = _mm_set1_epi8('\t');
+        const auto range = _mm_set1_epi8('\r' - '\t');
+        for (; last - first >= 16; first += 16) {
+            const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+            const auto offset = _mm_sub_epi8(chunk, tab);
+            const auto is_space = _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(_mm_min_epu8(offset, range), offset));
+            const uint32_t mask = ~_mm_movemask_epi8(is_space) & 0xFFFF;
+            if (mask != 0) {
+                return first + count_trailing_zeros(mask);
+            }
+        }
+        return scan_non_space_scalar(first, last);
+    }
+
+    // AVX2; 32 bytes at once
+
+    BB_TARGET_AVX2 const char* scan_either_avx2(const char* first, const char* last, char c0, char c1) {
+        const auto needle0 = _mm256_set1_epi8(c0);
+        const auto needle1 = _mm256_set1_epi8(c1);
+        for (; last - first >= 32; first += 32) {
+            const auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+            const uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, needle0), _mm256_cmpeq_epi8(chunk, needle1)));
+            if (mask != 0) {
+                return first + count_trailing_zeros(mask);
+            }
+        }
+        return scan_either_sse2(first, last, c0, c1);
+    }
+
+    BB_TARGET_AVX2 const char* scan_sequence_avx2(const char* first, const char* last, const char* seq, size_t size) {
+        const auto head = _mm256_set1_epi8(seq[0]);
+        const auto tail = _mm256_set1_epi8(seq[size - 1]);
+        for (; static_cast<size_t>(last - first) >= 32 + size - 1; first += 32) {
+            const auto chunk_head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+            const auto chunk_tail = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + size - 1));
+            uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(chunk_head, head), _mm256_cmpeq_epi8(chunk_tail, tail)));
+            while (mask != 0) {
+                const auto found = first + count_trailing_zeros(mask);
+                if (size < 3 || found[1] == seq[1]) {
+                    return found;
+                }
+                mask &= mask - 1;
+            }
+        }
+        return scan_sequence_sse2(first, last, seq, size);
+    }
+
+    BB_TARGET_AVX2 const char* scan_non_space_avx2(const char* first, const char* last) {
+        const auto space = _mm256_set1_epi8(' ');
+        const auto tab = _mm256_set1_epi8('\t');
+        const auto range = _mm256_set1_epi8('\r' - '\t');
+        for (; last - first >= 32; first += 32) {
+            const auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+            const auto offset = _mm256_sub_epi8(chunk, tab);
+            const auto is_space = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(_mm256_min_epu8(offset, range), offset));
+            const uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(is_space));
+            if (mask != 0) {
+                return first + count_trailing_zeros(mask);
+            }
+        }
+        return scan_non_space_sse2(first, last);
+    }
+
+    inline bool cpu_supports_avx2() {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        __cpuid(info, 1);
+        const bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        __cpuidex(info, 7, 0);
+        return os_saves_ymm && avx && (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+#endif
+
+    inline const scan_kernels& kernels_of(scan_isa isa) {
+        static const scan_kernels scalar{scan_isa::scalar, scan_either_scalar, scan_sequence_scalar, scan_non_space_scalar};
+#if BB_SCAN_X86
+        static const scan_kernels sse2{scan_isa::sse2, scan_either_sse2, scan_sequence_sse2, scan_non_space_sse2};
+        static const scan_kernels avx2{scan_isa::avx2, scan_either_avx2, scan_sequence_avx2, scan_non_space_avx2};
+        switch (isa) {
+            case scan_isa::avx2:
+                return avx2;
+            case scan_isa::sse2:
+                return sse2;
+            case scan_isa::scalar:
+                return scalar;
+        }
+#endif
+        return scalar;
+    }
+}
+
+scan_isa bb::detected_scan_isa() noexcept {
+#if BB_SCAN_X86
+    static const scan_isa isa = cpu_supports_avx2() ? scan_isa::avx2 : scan_isa::sse2;
+    return isa;
+#else
+    return scan_isa::scalar;
+#endif
+}
+
+scan_isa bb::current_scan_isa() noexcept {
+    return kernels().isa;
+}
+
+void bb::set_scan_isa(scan_isa isa) noexcept {
+    if (static_cast<int>(isa) > static_cast<int>(detected_scan_isa())) {
+        isa = detected_scan_isa();
+    }
+    current_kernels.store(&kernels_of(isa), std::memory_order_relaxed);
+}
+
+const char* bb::scan_either(const char* first, const char* last, char c0, char c1) noexcept {
+    return kernels().scan_either(first, last, c0, c1);
+}
+
+const char* bb::scan_sequence(const char* first, const char* last, const char* seq, size_t size) noexcept {
+    if (static_cast<size_t>(last - first) < size) {
+        return last;
+    }
+    return kernels().scan_sequence(first, last, seq, size);
+}
+
+const char* bb::scan_non_space(const char* first, const char* last) noexcept {
+    return kernels().scan_non_space(first, last);
+}
@@ -0,0 +1,67 @@
+//
+//  xml_scan_kernels.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_scan_kernels_h
+#define xml_scan_kernels_h
+
+#include <cstddef>
+#include <cstring>
+
+/**
+ * Byte-class searches used by the tokenizer, vectorized with SSE2 / AVX2.
+ * The instruction set is detected at runtime, and the scalar versions are used on other architectures.
+ *
+ * Every kernel returns `last` if nothing is found.
+ */
+namespace bb {
+
+    enum class scan_isa {
+        scalar,
+        sse2,
+        avx2,
+    };
+
+    /**
+     * The best instruction set of this CPU
+     */
+    extern scan_isa detected_scan_isa() noexcept;
+
+    /**
+     * The instruction set used by the kernels; detected_scan_isa() by default.
+     * Overriding is for benchmarks and tests; an unsupported one falls back to the detected one.
+     */
+    extern scan_isa current_scan_isa() noexcept;
+    extern void set_scan_isa(scan_isa isa) noexcept;
+
+    /**
+     * The first `c`
+     *
+     * memchr for every instruction set; C libraries vectorize and unroll it already,
+     * and glibc's is faster than a plain SSE2 / AVX2 loop.
+     */
+    inline const char* scan_char(const char* first, const char* last, char c) noexcept {
+        auto found = static_cast<const char*>(std::memchr(first, c, last - first));
+        return found ? found : last;
+    }
+
+    /**
+     * The first `c0` or `c1`
+     */
+    extern const char* scan_either(const char* first, const char* last, char c0, char c1) noexcept;
+
+    /**
+     * The first [seq, seq + size); size is 2 or 3, such as "--" or "]]>"
+     */
+    extern const char* scan_sequence(const char* first, const char* last, const char* seq, size_t size) noexcept;
+
+    /**
+     * The first character which is not "\s" of std::regex
+     */
+    extern const char* scan_non_space(const char* first, const char* last) noexcept;
+
+}
+
+#endif /* xml_scan_kernels_h */
@@ -0,0 +1,191 @@
+//
+//  xml_thread_pool.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace bbxml;
+
+namespace {
+    /**
+     * The indices left to a worker, [first, last); on its own cache line as every worker polls it
+     */
+    struct alignas(64) index_queue {
+        std::mutex mutex;
+        size_t first = 0;
+        size_t last = 0;
+
+        bool pop_front(size_t& index) {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (first == last) {
+                return false;
+            }
+            index = first++;
+            return true;
+        }
+
+        /**
+         * Takes the latter half, or the last one
+         */
+        bool steal_back(size_t& steal_first, size_t& steal_last) {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (first == last) {
+                return false;
+            }
+            steal_last = last;
+            last -= (last - first + 1) / 2;
+            steal_first = last;
+            return true;
+        }
+
+        void assign(size_t new_first, size_t new_last) {
+            std::lock_guard<std::mutex> lock{mutex};
+            first = new_first;
+            last = new_last;
+        }
+    };
+}
+
+struct xml_thread_pool::state {
+    std::vector<std::thread> threads;
+    std::unique_ptr<index_queue[]> queues;
+
+    std::mutex run_mutex;           // one job at a time
+    std::mutex mutex;
+    std::condition_variable job_started;
+    std::condition_variable job_finished;
+    size_t generation = 0;
+    size_t running = 0;             // the workers in the current job
+    bool is_stopping = false;
+
+    const std::function<void(size_t, size_t)>* task = nullptr;
+    std::atomic<bool> is_cancelled{false};
+    std::exception_ptr error;
+
+    void work(size_t worker) {
+        size_t seen_generation = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                job_started.wait(lock, [&] { return is_stopping || generation != seen_generation; });
+                if (is_stopping) {
+                    return;
+                }
+                seen_generation = generation;
+            }
+
+            run_job(worker);
+
+            std::lock_guard<std::mutex> lock{mutex};
+            if (--running == 0) {
+                job_finished.notify_all();
+            }
+        }
+    }
+
+    void run_job(size_t worker) {
+        auto& own = queues[worker];
+        size_t index;
+        for (;;) {
+            while (own.pop_front(index)) {
+                if (is_cancelled.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                try {
+                    (*task)(index, worker);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock{mutex};
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    is_cancelled.store(true, std::memory_order_relaxed);
+                    return;
+                }
+            }
+            if (!steal(worker)) {
+                return;
+            }
+        }
+    }
+
+    /**
+     * Moves the latter half of the first non-empty queue after the worker's own into it
+     *
+     * @return false if every queue is empty
+     */
+    bool steal(size_t worker) {
+        const auto size = threads.size();
+        for (size_t i = 1; i < size; ++i) {
+            size_t first, last;
+            if (queues[(worker + i) % size].steal_back(first, last)) {
+                queues[worker].assign(first, last);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+xml_thread_pool::xml_thread_pool(size_t threads) : state_(new state) {
+    if (threads == 0) {
+        threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    state_->queues.reset(new index_queue[threads]);
+    state_->threads.reserve(threads);
+    for (size_t worker = 0; worker < threads; ++worker) {
+        state_->threads.emplace_back([this, worker] { state_->work(worker); });
+    }
+}
+
+xml_thread_pool::~xml_thread_pool() {
+    {
+        std::lock_guard<std::mutex> lock{state_->mutex};
+        state_->is_stopping = true;
+    }
+    state_->job_started.notify_all();
+    for (auto& thread : state_->threads) {
+        thread.join();
+    }
+}
+
+size_t xml_thread_pool::size() const noexcept {
+    return state_->threads.size();
+}
+
+void xml_thread_pool::run(size_t count, const std::function<void(size_t index, size_t worker)>& task) {
+    if (count == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> run_lock{state_->run_mutex};
+
+    const auto size = state_->threads.size();
+    for (size_t worker = 0; worker < size; ++worker) {
+        state_->queues[worker].assign(count * worker / size, count * (worker + 1) / size);
+    }
+    state_->task = &task;
+    state_->is_cancelled.store(false, std::memory_order_relaxed);
+    state_->error = nullptr;
+
+    std::unique_lock<std::mutex> lock{state_->mutex};
+    state_->running = size;
+    ++state_->generation;
+    state_->job_started.notify_all();
+    state_->job_finished.wait(lock, [&] { return state_->running == 0; });
+
+    state_->task = nullptr;
+    if (state_->error) {
+        std::rethrow_exception(std::exchange(state_->error, nullptr));
+    }
+}
@@ -0,0 +1,51 @@
+//
+//  xml_thread_pool.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_thread_pool_h
+#define xml_thread_pool_h
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+namespace bbxml {
+
+    /**
+     * A fixed set of worker threads which run the indices of a job.
+     *
+     * The indices are split evenly into a queue per worker; a worker takes from the head of its own queue,
+     * and steals the latter half of another queue when its own runs out, so uneven tasks are balanced.
+     */
+    class xml_thread_pool {
+    public:
+        /**
+         * @param threads the number of workers; 0 is the number of the hardware threads
+         */
+        explicit xml_thread_pool(size_t threads = 0);
+        ~xml_thread_pool();
+
+        xml_thread_pool(const xml_thread_pool&) = delete;
+        xml_thread_pool& operator=(const xml_thread_pool&) = delete;
+
+        size_t size() const noexcept;
+
+        /**
+         * Calls task(index, worker) for every index in [0, count), and waits for all of them.
+         *
+         * `worker` is in [0, size()) and runs one task at a time, so it can index a state per worker.
+         * Once a task throws, the rest are skipped and the first exception is rethrown here.
+         * Jobs from several threads run one after another; a task must not call run() of the same pool.
+         */
+        void run(size_t count, const std::function<void(size_t index, size_t worker)>& task);
+
+    private:
+        struct state;
+        std::unique_ptr<state> state_;
+    };
+
+}
+
+#endif /* xml_thread_pool_h */
@@ -0,0 +1,166 @@
+//
+//  xml_writer.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_writer.h"
+#include "xml_parser.h"
+
+#include <algorithm>
+#include <ostream>
+
+using namespace bbxml;
+
+namespace {
+    inline bool is_text_node(const xml_node& node);
+    inline void append_cdata(const std::string& text, std::string& out);
+    inline void append_escaped_text(const std::string& text, std::string& out);
+    inline void append_attributes(const xml_attributes& attributes, std::string& out);
+}
+
+xml_writer::xml_writer(std::string& out, const xml_write_options& options) : out_(&out), options_(options) {
+}
+
+xml_writer::xml_writer(std::ostream& stream, const xml_write_options& options, size_t buffer_size)
+: out_(&buffer_), stream_(&stream), buffer_size_(buffer_size), options_(options) {
+    buffer_.reserve(buffer_size);
+}
+
+xml_writer::~xml_writer() {
+    flush();
+}
+
+void xml_writer::write(const xml_document& document) {
+    if (options_.declaration) {
+        out_->append("<?xml version=\"");
+        bb::append_escaped_xml_attribute_value(document.version.data(), document.version.data() + document.version.size(), *out_);
+        out_->append("\"");
+        append_attributes(document.attributes, *out_);
+        out_->append("?>");
+        if (options_.pretty && document.root_node) {
+            out_->append("\n");
+        }
+    }
+    if (document.root_node) {
+        write(*document.root_node);
+    }
+    if (options_.pretty) {
+        out_->append("\n");
+    }
+}
+
+void xml_writer::write(const xml_node& node) {
+    write_node(node, 0);
+    if (stream_ && buffer_.size() >= buffer_size_) {
+        flush();
+    }
+}
+
+void xml_writer::flush() {
+    if (stream_ && !buffer_.empty()) {
+        stream_->write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+}
+
+void xml_writer::write_node(const xml_node& node, size_t depth) {
+    if (node.name == std::string_view("#text")) {
+        append_escaped_text(node.value, *out_);
+        return;
+    }
+    if (node.name == std::string_view("#cdata-section")) {
+        append_cdata(node.value, *out_);
+        return;
+    }
+    if (node.name == std::string_view("#comment")) {
+        out_->append("<!--").append(node.value).append("-->");
+        return;
+    }
+
+    out_->append("<").append(node.name.str());
+    append_attributes(node.attributes, *out_);
+    if (node.value.empty() && node.nodes.empty()) {
+        out_->append("/>");
+        return;
+    }
+    out_->append(">");
+    append_escaped_text(node.value, *out_);
+
+    // Spaces are added only between elements, not to a text
+    const auto breaks_lines = options_.pretty && node.value.empty() && std::none_of(node.nodes.begin(), node.nodes.end(), [](const std::shared_ptr<xml_node>& child) {
+        return is_text_node(*child);
+    });
+    for (const auto& child : node.nodes) {
+        if (breaks_lines) {
+            break_line(depth + 1);
+        }
+        write_node(*child, depth + 1);
+    }
+    if (breaks_lines) {
+        break_line(depth);
+    }
+    out_->append("</").append(node.name.str()).append(">");
+
+    if (stream_ && buffer_.size() >= buffer_size_) {
+        flush();
+    }
+}
+
+void xml_writer::break_line(size_t depth) {
+    out_->append("\n");
+    for (size_t i = 0; i < depth; ++i) {
+        out_->append(options_.indent);
+    }
+}
+
+std::string bbxml::to_xml_string(const xml_document& document, const xml_write_options& options) {
+    std::string out;
+    xml_writer(out, options).write(document);
+    return out;
+}
+
+std::string bbxml::to_xml_string(const xml_node& node, const xml_write_options& options) {
+    std::string out;
+    xml_writer(out, options).write(node);
+    return out;
+}
+
+namespace {
+
+    /**
+     * A text or a CDATA section, around which no space is added
+     */
+    inline bool is_text_node(const xml_node& node) {
+        return node.name == std::string_view("#text") || node.name == std::string_view("#cdata-section");
+    }
+
+    /**
+     * "<![CDATA[text]]>"; "]]>" in the text is split over two sections, as "]]" and ">"
+     */
+    inline void append_cdata(const std::string& text, std::string& out) {
+        out.append("<![CDATA[");
+        size_t first = 0;
+        for (auto end = text.find("]]>"); end != std::string::npos; end = text.find("]]>", first)) {
+            out.append(text, first, end + 2 - first).append("]]><![CDATA[");
+            first = end + 2;
+        }
+        out.append(text, first, std::string::npos).append("]]>");
+    }
+
+    inline void append_escaped_text(const std::string& text, std::string& out) {
+        bb::append_escaped_xml_inner_text(text.data(), text.data() + text.size(), out);
+    }
+
+    /**
+     * ` key="value"` for every attribute
+     */
+    inline void append_attributes(const xml_attributes& attributes, std::string& out) {
+        for (const auto& attribute : attributes) {
+            out.append(" ").append(attribute.first.str()).append("=\"");
+            bb::append_escaped_xml_attribute_value(attribute.second.data(), attribute.second.data() + attribute.second.size(), out);
+            out.append("\"");
+        }
+    }
+
+}
@@ -0,0 +1,67 @@
+//
+//  xml_writer.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_writer_h
+#define xml_writer_h
+
+#include "xml_document.h"
+
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+namespace bbxml {
+
+    struct xml_write_options {
+        bool declaration = true;        // writes "<?xml ...?>" before the root node of a document
+        bool pretty = false;            // breaks lines and indents the children of an element which has only elements
+        std::string_view indent = "  ";
+    };
+
+    /**
+     * Serializes trees into XML in one pass; the inverse of parse_xml(), which parses the output into the same tree.
+     *
+     * The texts and the attribute values are escaped, and the attributes are written in the order of xml_attributes.
+     * A text node, named "#text", is written as its text; a "#comment" node as a comment, and a "#cdata-section" node as a CDATA section.
+     * The pretty print only adds spaces between elements, which parse_xml() skips.
+     *
+     * It appends to a string, or writes to a stream through a buffer of `buffer_size`;
+     * a writer can be kept to write many documents into the same output.
+     */
+    class xml_writer {
+    public:
+        explicit xml_writer(std::string& out, const xml_write_options& options = {});
+        explicit xml_writer(std::ostream& stream, const xml_write_options& options = {}, size_t buffer_size = 64 * 1024);
+        ~xml_writer();
+
+        xml_writer(const xml_writer&) = delete;
+        xml_writer& operator=(const xml_writer&) = delete;
+
+        void write(const xml_document& document);
+        void write(const xml_node& node);
+
+        /**
+         * Writes the buffer to the stream; nothing for a string
+         */
+        void flush();
+
+    private:
+        void write_node(const xml_node& node, size_t depth);
+        void break_line(size_t depth);
+
+        std::string* out_;
+        std::ostream* stream_ = nullptr;
+        std::string buffer_;
+        size_t buffer_size_ = 0;
+        xml_write_options options_;
+    };
+
+    extern std::string to_xml_string(const xml_document& document, const xml_write_options& options = {});
+    extern std::string to_xml_string(const xml_node& node, const xml_write_options& options = {});
+
+}
+
+#endif /* xml_writer_h */
@@ -0,0 +1,329 @@
+//
+//  xml_benchmark.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_corpus.h"
+#include "xml_document.h"
+#include "xml_document_parser.h"
+#include "xml_flat_document.h"
+#include "xml_lazy_document.h"
+#include "xml_policy_parser.h"
+#include "xml_reader.h"
+#include "xml_sax_parser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/**
+ * Counts the allocations of the whole process; every block has a header of its size to track the live bytes.
+ * The aligned allocations are not counted.
+ */
+namespace {
+    constexpr size_t allocation_header = alignof(std::max_align_t);
+
+    std::atomic<size_t> allocation_count{0};
+    std::atomic<size_t> live_bytes{0};
+    std::atomic<size_t> peak_bytes{0};
+
+    inline void* allocate(size_t size) {
+        auto block = static_cast<unsigned char*>(std::malloc(size + allocation_header));
+        if (block == nullptr) {
+            throw std::bad_alloc();
+        }
+        *reinterpret_cast<size_t*>(block) = size;
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        auto live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+        auto peak = peak_bytes.load(std::memory_order_relaxed);
+        while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+        return block + allocation_header;
+    }
+
+    inline void deallocate(void* pointer) noexcept {
+        if (pointer == nullptr) {
+            return;
+        }
+        auto block = static_cast<unsigned char*>(pointer) - allocation_header;
+        live_bytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+        std::free(block);
+    }
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* pointer) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer) noexcept { deallocate(pointer); }
+void operator delete(void* pointer, size_t) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { deallocate(pointer); }
+
+namespace {
+
+    struct benchmark_options {
+        std::vector<bbxml::xml_corpus_kind> kinds{std::begin(bbxml::xml_corpus_kinds), std::end(bbxml::xml_corpus_kinds)};
+        std::vector<size_t> sizes{1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+        std::vector<std::string> parsers{"tree", "flat", "view", "situ", "sax", "reader", "trusted", "reused", "lazy"};
+        double min_time = 0.5;      // seconds per case
+        size_t min_runs = 3;
+        size_t max_runs = 100000;
+    };
+
+    struct benchmark_result {
+        double mb_per_second;
+        double allocations_per_mb;
+        double heap_peak_mb;
+        double rss_peak_mb;
+        std::vector<double> latencies;  // seconds, sorted
+    };
+
+    /**
+     * Parses the text by the parser, and drops the result; "situ" parses `buffer`, a copy of the text made before
+     */
+    inline bool run_parser(const std::string& parser, const std::string& text, std::string& buffer) {
+        if (parser == "tree") {
+            bbxml::parse_xml(text);
+        }
+        else if (parser == "trusted") {    // The tree without the checks of the names nor decoding
+            bbxml::parse_xml<bbxml::xml_parse_trusted>(text);
+        }
+        else if (parser == "reused") {     // The tree into the nodes of the run before
+            static bbxml::xml_document_parser document_parser;
+            document_parser.parse(text);
+        }
+        else if (parser == "flat") {
+            bbxml::parse_xml_flat(text);
+        }
+        else if (parser == "view") {
+            bbxml::parse_xml_view(text);
+        }
+        else if (parser == "lazy") {       // Only the index, and the root materialized
+            bbxml::parse_xml_lazy(text).root_node().attributes();
+        }
+        else if (parser == "situ") {
+            bbxml::parse_xml_in_situ(buffer);
+        }
+        else if (parser == "sax") {
+            bbxml::xml_sax_handler handler;
+            bbxml::parse_xml_sax(text, handler);
+        }
+        else if (parser == "reader") {     // Only the tokens; the texts and the attributes are not unescaped unless asked
+            bbxml::xml_reader reader{text};
+            while (reader.next() != bbxml::xml_token::end_of_document) {
+            }
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    inline double peak_rss_mb() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+        return usage.ru_maxrss / (1024.0 * 1024.0);     // in bytes
+#else
+        return usage.ru_maxrss / 1024.0;                // in kilobytes
+#endif
+#endif
+    }
+
+    inline double percentile(const std::vector<double>& sorted, double p) {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+    }
+
+    /**
+     * Runs the parser over the text until both `min_runs` and `min_time` are reached
+     */
+    benchmark_result measure(const std::string& parser, const std::string& text, const benchmark_options& options) {
+        benchmark_result result{};
+        std::string buffer;     // rewritten by every run in situ, so it is copied out of the time
+        buffer.reserve(text.size());
+        const auto allocations_before = allocation_count.load();
+        size_t heap_peak = 0;
+        double total = 0;
+        while (result.latencies.size() < options.max_runs && (result.latencies.size() < options.min_runs || total < options.min_time)) {
+            if (parser == "situ") {
+                buffer.assign(text);
+            }
+            const auto live_before = live_bytes.load();
+            peak_bytes.store(live_before);
+            auto begin = std::chrono::steady_clock::now();
+            run_parser(parser, text, buffer);
+            auto end = std::chrono::steady_clock::now();
+            heap_peak = std::max(heap_peak, peak_bytes.load() - live_before);
+
+            auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(end - begin).count();
+            result.latencies.push_back(elapsed);
+            total += elapsed;
+        }
+        std::sort(result.latencies.begin(), result.latencies.end());
+
+        const auto runs = result.latencies.size();
+        const auto mb = text.size() / (1024.0 * 1024.0);
+        result.mb_per_second = mb * runs / total;
+        result.allocations_per_mb = (allocation_count.load() - allocations_before) / static_cast<double>(runs) / mb;
+        result.heap_peak_mb = heap_peak / (1024.0 * 1024.0);
+        result.rss_peak_mb = peak_rss_mb();
+        return result;
+    }
+
+    /**
+     * "1K", "64K", "16M", "1G" or bytes
+     */
+    inline bool parse_size(const std::string& text, size_t& size) {
+        char* unit = nullptr;
+        auto value = std::strtoull(text.c_str(), &unit, 10);
+        if (unit == text.c_str() || value == 0) {
+            return false;
+        }
+        switch (*unit) {
+            case '\0': size = value; return true;
+            case 'K': case 'k': size = value * 1024; break;
+            case 'M': case 'm': size = value * 1024 * 1024; break;
+            case 'G': case 'g': size = value * 1024 * 1024 * 1024; break;
+            default: return false;
+        }
+        return unit[1] == '\0';
+    }
+
+    inline std::vector<std::string> split(const std::string& text) {
+        std::vector<std::string> items;
+        size_t first = 0;
+        while (first <= text.size()) {
+            auto last = std::min(text.find(',', first), text.size());
+            items.push_back(text.substr(first, last - first));
+            first = last + 1;
+        }
+        return items;
+    }
+
+    inline std::string format_size(size_t size) {
+        if (size >= 1024 * 1024 * 1024 && size % (1024 * 1024 * 1024) == 0) {
+            return std::to_string(size / (1024 * 1024 * 1024)) + "G";
+        }
+        if (size >= 1024 * 1024 && size % (1024 * 1024) == 0) {
+            return std::to_string(size / (1024 * 1024)) + "M";
+        }
+        if (size >= 1024 && size % 1024 == 0) {
+            return std::to_string(size / 1024) + "K";
+        }
+        return std::to_string(size);
+    }
+
+    inline void print_usage() {
+        std::printf(
+            "usage: xml_benchmark [options]\n"
+            "  --kinds records,deep,wide,entities,cdata,comments\n"
+            "  --sizes 1K,64K,1M,16M        up to 1G; a size is generated once for all the parsers\n"
+            "  --parsers tree,flat,view,situ,sax,reader,trusted,reused,lazy\n"
+            "  --min-time SECONDS           per case, 0.5 by default\n"
+            "  --min-runs N                 per case, 3 by default\n");
+    }
+
+    /**
+     * @return false on an unknown option or value
+     */
+    bool parse_options(int argc, const char* argv[], benchmark_options& options) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string option = argv[i];
+            if (i + 1 >= argc) {
+                return false;
+            }
+            const std::string value = argv[++i];
+            if (option == "--kinds") {
+                options.kinds.clear();
+                for (const auto& name : split(value)) {
+                    bbxml::xml_corpus_kind kind;
+                    if (!bbxml::parse_xml_corpus_kind(name, kind)) {
+                        return false;
+                    }
+                    options.kinds.push_back(kind);
+                }
+            }
+            else if (option == "--sizes") {
+                options.sizes.clear();
+                for (const auto& item : split(value)) {
+                    size_t size;
+                    if (!parse_size(item, size)) {
+                        return false;
+                    }
+                    options.sizes.push_back(size);
+                }
+            }
+            else if (option == "--parsers") {
+                options.parsers = split(value);
+                for (const auto& parser : options.parsers) {
+                    const std::string text = "<?xml version=\"1.0\"?><a/>";
+                    auto buffer = text;
+                    if (!run_parser(parser, text, buffer)) {
+                        return false;
+                    }
+                }
+            }
+            else if (option == "--min-time") {
+                options.min_time = std::atof(value.c_str());
+            }
+            else if (option == "--min-runs") {
+                options.min_runs = std::max<size_t>(1, std::strtoull(value.c_str(), nullptr, 10));
+            }
+            else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+}
+
+int main(int argc, const char * argv[]) {
+    benchmark_options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+
+    std::printf("%-9s %6s %-6s %10s %10s %10s %10s %11s %11s %11s\n",
+                "corpus", "size", "parser", "MB/s", "allocs/MB", "heap MB", "RSS MB", "p50 ms", "p90 ms", "p99 ms");
+    for (auto kind : options.kinds) {
+        for (auto size : options.sizes) {
+            const auto text = bbxml::generate_xml_corpus(kind, size);
+            for (const auto& parser : options.parsers) {
+                try {
+                    auto result = measure(parser, text, options);
+                    std::printf("%-9s %6s %-6s %10.1f %10.1f %10.2f %10.1f %11.4f %11.4f %11.4f\n",
+                                bbxml::xml_corpus_kind_name(kind), format_size(size).c_str(), parser.c_str(),
+                                result.mb_per_second, result.allocations_per_mb, result.heap_peak_mb, result.rss_peak_mb,
+                                percentile(result.latencies, 0.5) * 1000, percentile(result.latencies, 0.9) * 1000, percentile(result.latencies, 0.99) * 1000);
+                }
+                catch (const bbxml::xml_error& e) {
+                    std::printf("%-9s %6s %-6s error: %s\n", bbxml::xml_corpus_kind_name(kind), format_size(size).c_str(), parser.c_str(), e.what());
+                    return 1;
+                }
+                std::fflush(stdout);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+//
+//  xml_corpus.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_corpus.h"
+
+#include <algorithm>
+
+using namespace bbxml;
+
+namespace {
+    const char* const words[] = {
+        "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "sed", "do",
+        "eiusmod", "tempor", "incididunt", "ut", "labore", "et", "dolore", "magna", "aliqua", "enim",
+    };
+    const char* const entities[] = {"&amp;", "&lt;", "&gt;", "&quot;", "&apos;", "&#169;", "&#x20AC;", "&#x1F600;"};
+
+    /**
+     * xorshift32; fast enough to generate a gigabyte, and the same on every platform
+     */
+    struct xml_corpus_random {
+        uint32_t state;
+
+        uint32_t operator()(uint32_t bound) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state % bound;
+        }
+    };
+
+    template <size_t N>
+    inline const char* pick(const char* const (&items)[N], xml_corpus_random& random) {
+        return items[random(N)];
+    }
+
+    inline void append_words(std::string& out, size_t count, xml_corpus_random& random);
+    inline void append_unit(xml_corpus_kind kind, size_t size, size_t index, std::string& out, xml_corpus_random& random);
+}
+
+const char* bbxml::xml_corpus_kind_name(xml_corpus_kind kind) noexcept {
+    switch (kind) {
+        case xml_corpus_kind::records: return "records";
+        case xml_corpus_kind::deep: return "deep";
+        case xml_corpus_kind::wide: return "wide";
+        case xml_corpus_kind::entities: return "entities";
+        case xml_corpus_kind::cdata: return "cdata";
+        case xml_corpus_kind::comments: return "comments";
+    }
+    return "";
+}
+
+bool bbxml::parse_xml_corpus_kind(std::string_view name, xml_corpus_kind& kind) noexcept {
+    for (auto candidate : xml_corpus_kinds) {
+        if (name == xml_corpus_kind_name(candidate)) {
+            kind = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string bbxml::generate_xml_corpus(xml_corpus_kind kind, size_t size, uint32_t seed) {
+    xml_corpus_random random{seed != 0 ? seed : 1};
+    std::string out;
+    out.reserve(size + 64 * 1024);
+    out.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<corpus>\n");
+    for (size_t index = 0; out.size() < size; ++index) {
+        append_unit(kind, size, index, out, random);
+    }
+    out.append("</corpus>\n");
+    return out;
+}
+
+namespace {
+
+    inline void append_words(std::string& out, size_t count, xml_corpus_random& random) {
+        for (size_t i = 0; i < count; ++i) {
+            if (i > 0) {
+                out += ' ';
+            }
+            out.append(pick(words, random));
+        }
+    }
+
+    /**
+     * Appends a unit of the kind; a record, a nest, a tag, a paragraph, a CDATA section or a commented element
+     */
+    inline void append_unit(xml_corpus_kind kind, size_t size, size_t index, std::string& out, xml_corpus_random& random) {
+        const auto number = std::to_string(index);
+        switch (kind) {
+            case xml_corpus_kind::records:
+                out.append("  <book id=\"bk").append(number).append("\">\n");
+                out.append("    <author>");
+                append_words(out, 2, random);
+                out.append("</author>\n    <title>");
+                append_words(out, 4, random);
+                out.append("</title>\n    <price>").append(std::to_string(random(100))).append(".95</price>\n");
+                out.append("    <description>");
+                append_words(out, 12 + random(20), random);
+                out.append("</description>\n  </book>\n");
+                break;
+
+            case xml_corpus_kind::deep: {
+                // Small documents are nested less, to stay near the size
+                const auto depth = std::max<size_t>(1, std::min<size_t>(256, size / 64));
+                for (size_t level = 0; level < depth; ++level) {
+                    out.append("<n").append(std::to_string(level)).append(" level=\"").append(std::to_string(level)).append("\">");
+                }
+                append_words(out, 4, random);
+                for (size_t level = depth; level-- > 0; ) {
+                    out.append("</n").append(std::to_string(level)).append(">");
+                }
+                out += '\n';
+                break;
+            }
+
+            case xml_corpus_kind::wide:
+                out.append("  <item");
+                for (int attribute = 0; attribute < 32; ++attribute) {
+                    out.append(" a").append(std::to_string(attribute)).append("=\"").append(pick(words, random)).append("\"");
+                }
+                out.append("/>\n");
+                break;
+
+            case xml_corpus_kind::entities:
+                out.append("  <p>");
+                for (int i = 0; i < 16; ++i) {
+                    out.append(pick(words, random)).append(pick(entities, random));
+                }
+                out.append("</p>\n");
+                break;
+
+            case xml_corpus_kind::cdata: {
+                const auto cdata_size = std::max<size_t>(64, std::min<size_t>(4096, size / 4));
+                out.append("  <code><![CDATA[");
+                const auto first = out.size();
+                while (out.size() - first < cdata_size) {
+                    out.append("if (a < b && c > d) { x[i] = y[j]; } ");
+                }
+                out.append("]]></code>\n");
+                break;
+            }
+
+            case xml_corpus_kind::comments:
+                for (int i = 0; i < 4; ++i) {
+                    out.append("  <!-- ");
+                    append_words(out, 6, random);
+                    out.append(" -->\n");
+                }
+                out.append("  <e n=\"").append(number).append("\"/>\n");
+                break;
+        }
+    }
+
+}
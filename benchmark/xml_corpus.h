@@ -0,0 +1,50 @@
+//
+//  xml_corpus.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_corpus_h
+#define xml_corpus_h
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace bbxml {
+
+    /**
+     * Shapes of synthetic documents, each of which stresses a part of the parser
+     */
+    enum class xml_corpus_kind {
+        records,    // a long list of small records, same as sample.xml
+        deep,       // elements nested 256 levels deep
+        wide,       // start tags with 32 attributes
+        entities,   // texts full of entity and character references
+        cdata,      // large CDATA sections
+        comments,   // many comments between small elements
+    };
+
+    constexpr xml_corpus_kind xml_corpus_kinds[] = {
+        xml_corpus_kind::records, xml_corpus_kind::deep, xml_corpus_kind::wide,
+        xml_corpus_kind::entities, xml_corpus_kind::cdata, xml_corpus_kind::comments,
+    };
+
+    extern const char* xml_corpus_kind_name(xml_corpus_kind kind) noexcept;
+
+    /**
+     * @return false if no kind has the name
+     */
+    extern bool parse_xml_corpus_kind(std::string_view name, xml_corpus_kind& kind) noexcept;
+
+    /**
+     * Generates a well-formed document of about `size` bytes; the same seed generates the same document.
+     *
+     * The units of the kind are repeated under a root element until the size is reached,
+     * so the document is a little larger than `size`.
+     */
+    extern std::string generate_xml_corpus(xml_corpus_kind kind, size_t size, uint32_t seed = 1);
+
+}
+
+#endif /* xml_corpus_h */
@@ -0,0 +1,40 @@
+//
+//  fuzz_parse_xml.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_document.h"
+#include "xml_flat_document.h"
+#include "xml_sax_parser.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Feeds the input to every parser; only a crash, a sanitizer report or an exception other than xml_error is a finding
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    const std::string text(reinterpret_cast<const char*>(data), size);
+    try {
+        bbxml::parse_xml(text);
+    }
+    catch (const bbxml::xml_error&) {
+    }
+    try {
+        bbxml::parse_xml_view(text).description();
+    }
+    catch (const bbxml::xml_error&) {
+    }
+    try {
+        bbxml::xml_sax_handler handler;
+        bbxml::xml_push_parser parser{handler};
+        parser.feed(text.data(), text.size() / 2);
+        parser.feed(text.data() + text.size() / 2, text.size() - text.size() / 2);
+        parser.finish();
+    }
+    catch (const bbxml::xml_error&) {
+    }
+    return 0;
+}
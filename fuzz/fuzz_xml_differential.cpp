@@ -0,0 +1,26 @@
+//
+//  fuzz_xml_differential.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_differential.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+/**
+ * Aborts when a path of parsing disagrees with parse_xml(), so that the fuzzer keeps the input
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static bbxml::xml_thread_pool pool{2};
+    auto difference = bbxml::find_xml_difference(std::string(reinterpret_cast<const char*>(data), size), pool);
+    if (!difference.empty()) {
+        std::fputs(difference.c_str(), stderr);
+        std::abort();
+    }
+    return 0;
+}
@@ -0,0 +1,448 @@
+//
+//  xml_differential.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_differential.h"
+#include "xml_binary_document.h"
+#include "xml_document.h"
+#include "xml_document_parser.h"
+#include "xml_document_reference.h"
+#include "xml_flat_document.h"
+#include "xml_lazy_document.h"
+#include "xml_parallel_parser.h"
+#include "xml_parser.h"
+#include "xml_policy_parser.h"
+#include "xml_reader.h"
+#include "xml_sax_parser.h"
+#include "xml_writer.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+
+using namespace bbxml;
+
+namespace {
+    const char* const fragments[] = {
+        "<a>", "</a>", "<b x=\"1\">", "</b>", "<c/>", "<c />", " ", "\n", "\r\n", "text", "&amp;", "&lt;", "&bad;", "&#160;", "&#x1F600;", "&#0;",
+        "<!-- c -->", "<!-- a-b -->", "<!-- -- -->", "<!--", "-->", "<![CDATA[<x>]]>", "<![CDATA[a]]]]>", "<![CDATA[", "]]>",
+        "<", ">", "\"", "'", "=", "/", "-", "!", "<!", "<?x?>",
+        "<d y='q\"'>", "</d>", "<e a=\"&apos;\"/>", "</ a>", "<a b>", "<a b=1>", "</a x=\"1\">", "</a/>",
+        "<f a=\"&bad;\" b>", "<f a=\"&amp;\" b=\"x\" a=\"y\">", "</f>", "<g a=\"<\" b=x>", " k=\"v\"",
+        "<rec id=\"1\"><n>v</n><m>w&amp;</m></rec>", "<rec><![CDATA[</rec>]]></rec>", "<rec><!-- </rec> --></rec>",
+    };
+
+    inline std::string describe_error(const xml_error& e);
+    inline std::string describe_document(const xml_document& document);
+    inline std::string describe_document(const xml_flat_document& document);
+    inline std::string describe_document(const xml_lazy_document& document);
+    inline bool has_space_key(const std::string& text);
+    inline std::string run(const std::function<std::string()>& parse);
+    inline std::string difference(const char* path, const std::string& text, const std::string& expected, const std::string& actual);
+
+    /**
+     * Records the SAX events in a string, joining the pieces of a text or a CDATA section
+     */
+    class xml_sax_recorder : public xml_sax_handler {
+    public:
+        std::string events;
+        size_t depth = 0;
+
+        void declaration(std::string_view version, const xml_sax_attributes& attributes) override {
+            add('?', version, attributes);
+        }
+        void start_element(std::string_view name, const xml_sax_attributes& attributes) override {
+            add('<', name, attributes);
+            ++depth;
+        }
+        void end_element(std::string_view name) override {
+            add('/', name, {});
+            --depth;
+        }
+        void text(std::string_view text) override {
+            add('T', text, {});
+        }
+        void cdata(std::string_view text) override {
+            add('C', text, {});
+        }
+        void comment(std::string_view text) override {
+            add('#', text, {});
+        }
+
+    private:
+        void add(char kind, std::string_view string, const xml_sax_attributes& attributes) {
+            if (kind != last_kind_ || (kind != 'T' && kind != 'C')) {
+                events += '\n';
+                events += kind;
+            }
+            events.append(string);
+            for (const auto& attribute : attributes) {
+                events.append(" ").append(attribute.first).append("=").append(attribute.second);
+            }
+            last_kind_ = kind;
+        }
+
+        char last_kind_ = 0;
+    };
+}
+
+std::string bbxml::find_xml_difference(const std::string& text, xml_thread_pool& pool, uint32_t seed) {
+    const auto expected = run([&] { return describe_document(parse_xml(text)); });
+
+    if (text.find("&#") == std::string::npos && !has_space_key(text)) {
+        auto actual = run([&] { return describe_document(reference::parse_xml(text)); });
+        if (actual != expected) {
+            return difference("reference::parse_xml", text, expected, actual);
+        }
+    }
+    {
+        xml_parse_stats stats;
+        auto actual = run([&] { return describe_document(parse_xml(text, stats)); });
+        if (actual != expected) {
+            return difference("parse_xml with stats", text, expected, actual);
+        }
+    }
+    {
+        // Reused over the texts, so that the nodes come from the pool of the documents before
+        static thread_local xml_document_parser parser;
+        auto actual = run([&] { return describe_document(parser.parse(text)); });
+        if (actual != expected) {
+            return difference("xml_document_parser", text, expected, actual);
+        }
+    }
+    // A valid document is the same without the checks; and without decoding, if it has no references
+    if (expected.compare(0, 5, "error") != 0) {
+        auto actual = run([&] { return describe_document(parse_xml<xml_parse_default & ~xml_parse_validate_names>(text)); });
+        if (actual != expected) {
+            return difference("parse_xml<xml_parse_flags> without validate_names", text, expected, actual);
+        }
+        if (text.find('&') == std::string::npos) {
+            actual = run([&] { return describe_document(parse_xml<xml_parse_trusted>(text)); });
+            if (actual != expected) {
+                return difference("parse_xml<xml_parse_trusted>", text, expected, actual);
+            }
+        }
+    }
+    {
+        auto actual = run([&] { return describe_document(parse_xml_flat(text)); });
+        if (actual != expected) {
+            return difference("parse_xml_flat", text, expected, actual);
+        }
+        actual = run([&] { return describe_document(parse_xml_view(text)); });
+        if (actual != expected) {
+            return difference("parse_xml_view", text, expected, actual);
+        }
+        auto buffer = text;
+        actual = run([&] { return describe_document(parse_xml_in_situ(buffer)); });
+        if (actual != expected) {
+            return difference("parse_xml_in_situ", text, expected, actual);
+        }
+        actual = run([&] { return describe_document(parse_xml_lazy(text)); });
+        if (actual != expected) {
+            return difference("parse_xml_lazy", text, expected, actual);
+        }
+    }
+    for (size_t chunk_size : {8, 32}) {
+        auto actual = run([&] { return describe_document(parse_xml_parallel(text, pool, chunk_size)); });
+        if (actual != expected) {
+            return difference(chunk_size == 8 ? "parse_xml_parallel in 8 bytes" : "parse_xml_parallel in 32 bytes", text, expected, actual);
+        }
+    }
+
+    // The SAX parsers report the same errors as parse_xml(), and the events of the whole and the pushed pieces are the same
+    xml_sax_recorder whole;
+    std::string whole_error;
+    try {
+        parse_xml_sax(text, whole);
+    }
+    catch (const xml_error& e) {
+        whole_error = describe_error(e);
+    }
+    if (!whole_error.empty() || expected.compare(0, 5, "error") == 0) {
+        if (whole_error != expected) {
+            return difference("parse_xml_sax", text, expected, whole_error);
+        }
+    }
+    {
+        xml_sax_recorder pulled;
+        std::string pulled_error;
+        try {
+            xml_reader reader{text};
+            pulled.declaration(reader.version(), reader.declaration_attributes());
+            while (reader.next() != xml_token::end_of_document) {
+                switch (reader.token()) {
+                    case xml_token::start_element: pulled.start_element(reader.name(), reader.attributes()); break;
+                    case xml_token::end_element: pulled.end_element(reader.name()); break;
+                    case xml_token::text: pulled.text(reader.value()); break;
+                    case xml_token::cdata: pulled.cdata(reader.value()); break;
+                    default: pulled.comment(reader.value()); break;
+                }
+            }
+        }
+        catch (const xml_error& e) {
+            pulled_error = describe_error(e);
+        }
+        if (pulled_error != whole_error || (whole_error.empty() && pulled.events != whole.events)) {
+            return difference("xml_reader", text, whole_error + whole.events, pulled_error + pulled.events);
+        }
+    }
+    if (whole.depth == 0) {     // An unclosed document ends in a different state; the tree keeps it, and the stream does not
+        std::mt19937 random(seed);
+        xml_sax_recorder pushed;
+        std::string pushed_error;
+        try {
+            xml_push_parser parser{pushed};
+            for (size_t offset = 0; offset < text.size(); ) {
+                auto size = std::min<size_t>(text.size() - offset, 1 + random() % 16);
+                parser.feed(text.data() + offset, size);
+                offset += size;
+            }
+            parser.finish();
+        }
+        catch (const xml_error& e) {
+            pushed_error = describe_error(e);
+        }
+        if (pushed_error != whole_error || (whole_error.empty() && pushed.events != whole.events)) {
+            return difference("xml_push_parser", text, whole_error + whole.events, pushed_error + pushed.events);
+        }
+        if (pushed_error.empty()) {
+            // The tree of the events, as parse_xml_async() builds it
+            xml_tree_handler tree;
+            xml_push_parser parser{tree};
+            for (size_t offset = 0; offset < text.size(); offset += 5) {
+                parser.feed(text.data() + offset, std::min<size_t>(text.size() - offset, 5));
+            }
+            parser.finish();
+            auto actual = describe_document(tree.take_document());
+            if (actual != expected) {
+                return difference("xml_tree_handler", text, expected, actual);
+            }
+        }
+    }
+
+    // The limits fail at the same positions on every path; they are tight to be hit by the short documents
+    {
+        xml_parse_limits limits;
+        limits.max_depth = 3;
+        limits.max_attributes = 2;
+        limits.max_name_length = 4;
+        limits.max_text_length = 8;
+        limits.max_nodes = 20;
+        const auto bounded = run([&] { return describe_document(parse_xml(text, limits)); });
+        auto actual = run([&] { return describe_document(parse_xml_parallel(text, pool, 8, limits)); });
+        if (actual != bounded) {
+            return difference("parse_xml_parallel with limits", text, bounded, actual);
+        }
+        xml_sax_handler handler;
+        actual = run([&] { parse_xml_sax(text, handler, limits); return std::string(); });
+        if (!actual.empty() || bounded.compare(0, 5, "error") == 0) {
+            if (actual != bounded) {
+                return difference("parse_xml_sax with limits", text, bounded, actual);
+            }
+        }
+        if (whole.depth == 0) {
+            std::mt19937 random(seed);
+            auto pushed = run([&] {
+                xml_push_parser parser{handler, limits};
+                for (size_t offset = 0; offset < text.size(); ) {
+                    auto size = std::min<size_t>(text.size() - offset, 1 + random() % 16);
+                    parser.feed(text.data() + offset, size);
+                    offset += size;
+                }
+                parser.finish();
+                return std::string();
+            });
+            if (pushed != actual) {
+                return difference("xml_push_parser with limits", text, actual, pushed);
+            }
+        }
+    }
+
+    // The writer writes what the parser reads back
+    if (expected.compare(0, 5, "error") != 0) {
+        auto document = parse_xml(text);
+        if (document.root_node) {
+            auto written = to_xml_string(document);
+            auto actual = run([&] { return describe_document(parse_xml(written)); });
+            if (actual != expected) {
+                return difference("to_xml_string", written, expected, actual);
+            }
+        }
+        auto actual = run([&] { return describe_document(load_xml_binary(to_xml_binary(parse_xml_view(text)))); });
+        if (actual != expected) {
+            return difference("load_xml_binary", text, expected, actual);
+        }
+    }
+    return std::string();
+}
+
+std::string bbxml::generate_random_xml(std::mt19937& random) {
+    std::string text;
+    switch (random() % 16) {
+        case 0: text = "<?xml version=\"1.0\"?>"; break;
+        case 1: text = "<?xml version=\"1.1\"?>"; break;
+        case 2: text = "<?xm"; break;
+        default: text = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"; break;
+    }
+    const bool has_root = random() % 2;
+    if (has_root) {
+        text += "<root>";
+    }
+    for (auto count = random() % 24; count > 0; --count) {
+        text += fragments[random() % (sizeof(fragments) / sizeof(*fragments))];
+    }
+    if (has_root && random() % 8) {
+        text += "</root>";
+    }
+    return text;
+}
+
+std::string bbxml::mutate_xml(const std::string& text, std::mt19937& random) {
+    auto mutated = text;
+    for (auto count = 1 + random() % 4; count > 0; --count) {
+        const size_t position = mutated.empty() ? 0 : random() % (mutated.size() + 1);
+        switch (random() % 6) {
+            case 0:     // Flips a bit
+                if (position < mutated.size()) {
+                    mutated[position] ^= static_cast<char>(1 << (random() % 8));
+                }
+                break;
+            case 1:     // Replaces with one of the markup characters
+                if (position < mutated.size()) {
+                    mutated[position] = "<>/&;=\"'!?-[] \n"[random() % 15];
+                }
+                break;
+            case 2:
+                mutated.insert(position, 1, static_cast<char>(random() % 256));
+                break;
+            case 3:
+                mutated.erase(position, 1 + random() % 8);
+                break;
+            case 4: {   // Duplicates a span
+                const auto size = std::min<size_t>(mutated.size() - std::min(position, mutated.size()), 1 + random() % 32);
+                mutated.insert(position, mutated.substr(position, size));
+                break;
+            }
+            default:
+                mutated.insert(position, fragments[random() % (sizeof(fragments) / sizeof(*fragments))]);
+                break;
+        }
+    }
+    return mutated;
+}
+
+namespace {
+
+    inline std::string describe_error(const xml_error& e) {
+        return "error " + std::to_string(static_cast<int>(e.code())) + " at " + std::to_string(e.offset())
+            + " (" + std::to_string(e.line()) + ":" + std::to_string(e.column()) + ")";
+    }
+
+    /**
+     * The nodes in a line each, with the attributes sorted by the keys as the reference does; the last of the same keys wins
+     */
+    inline void describe(const xml_node& node, size_t depth, std::string& out) {
+        out.append(depth, ' ').append(node.name.str());
+        std::map<std::string_view, std::string_view> attributes;
+        for (const auto& attribute : node.attributes) {
+            attributes[attribute.first] = attribute.second;
+        }
+        for (const auto& attribute : attributes) {
+            out.append(" ").append(attribute.first).append("=").append(attribute.second);
+        }
+        out.append("|").append(node.value).append("\n");
+        for (const auto& child : node.nodes) {
+            if (child->parent.lock().get() != &node) {
+                out.append("(broken parent)\n");
+            }
+            describe(*child, depth + 1, out);
+        }
+    }
+
+    /**
+     * xml_node_view or xml_lazy_node
+     */
+    template <class Node>
+    inline void describe(const Node& node, size_t depth, std::string& out) {
+        out.append(depth, ' ').append(node.name());
+        std::map<std::string_view, std::string_view> attributes;
+        for (const auto& attribute : node.attributes()) {
+            attributes[attribute.first] = attribute.second;
+        }
+        for (const auto& attribute : attributes) {
+            out.append(" ").append(attribute.first).append("=").append(attribute.second);
+        }
+        out.append("|").append(node.value()).append("\n");
+        for (const auto& child : node.nodes()) {
+            describe(child, depth + 1, out);
+        }
+    }
+
+    inline std::string describe_document(const xml_document& document) {
+        std::string out = document.version;
+        std::map<std::string_view, std::string_view> attributes;
+        for (const auto& attribute : document.attributes) {
+            attributes[attribute.first] = attribute.second;
+        }
+        for (const auto& attribute : attributes) {
+            out.append(" ").append(attribute.first).append("=").append(attribute.second);
+        }
+        out.append("\n");
+        if (document.root_node) {
+            describe(*document.root_node, 0, out);
+        }
+        return out;
+    }
+
+    /**
+     * xml_flat_document or xml_lazy_document
+     */
+    template <class Document>
+    inline std::string describe_flat_document(const Document& document) {
+        std::string out = document.version;
+        for (const auto& attribute : document.attributes) {
+            out.append(" ").append(attribute.first).append("=").append(attribute.second);
+        }
+        out.append("\n");
+        if (auto root = document.root_node()) {
+            describe(root, 0, out);
+        }
+        return out;
+    }
+
+    inline std::string describe_document(const xml_flat_document& document) {
+        return describe_flat_document(document);
+    }
+
+    inline std::string describe_document(const xml_lazy_document& document) {
+        return describe_flat_document(document);
+    }
+
+    /**
+     * The std::regex of the reference takes spaces as a key, as in "<a \n=\"1\"/>", and goes on; the tokenizer stops there
+     */
+    inline bool has_space_key(const std::string& text) {
+        for (auto eq = text.find('='); eq != std::string::npos; eq = text.find('=', eq + 1)) {
+            if (eq >= 2 && bb::is_space(text[eq - 1]) && bb::is_space(text[eq - 2])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline std::string run(const std::function<std::string()>& parse) {
+        try {
+            return parse();
+        }
+        catch (const xml_error& e) {
+            return describe_error(e);
+        }
+    }
+
+    inline std::string difference(const char* path, const std::string& text, const std::string& expected, const std::string& actual) {
+        return std::string(path) + " differs\n--- input\n" + text + "\n--- expected\n" + expected + "\n--- actual\n" + actual + "\n";
+    }
+
+}
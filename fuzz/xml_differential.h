@@ -0,0 +1,50 @@
+//
+//  xml_differential.h
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#ifndef xml_differential_h
+#define xml_differential_h
+
+#include "xml_thread_pool.h"
+
+#include <cstdint>
+#include <random>
+#include <string>
+
+namespace bbxml {
+
+    /**
+     * Parses the text by every path, and compares them with parse_xml(); the trees, or the codes and the positions of the errors.
+     *
+     * - reference::parse_xml(), the std::regex parser, unless the text has a character reference, which it does not decode,
+     *   or spaces before "=", which it takes as a key
+     * - parse_xml() with xml_parse_stats, and parse_xml<Flags>() without the checks for a document without an error
+     * - xml_document_parser, reused over the texts
+     * - parse_xml_flat(), parse_xml_view() and parse_xml_in_situ()
+ * - parse_xml_lazy(), read as a whole
+     * - parse_xml_parallel() in small chunks
+     * - parse_xml_sax() for the errors, and xml_push_parser fed in random pieces and xml_reader for the events
+ * - xml_tree_handler fed by xml_push_parser, for a document without an error
+     * - parse_xml_parallel(), parse_xml_sax() and xml_push_parser with tight xml_parse_limits, for the errors
+     * - to_xml_string() parsed again, for a document without an error
+     * - load_xml_binary() of to_xml_binary(), for a document without an error
+     *
+     * @return the first difference, or an empty string if every path agrees
+     */
+    extern std::string find_xml_difference(const std::string& text, xml_thread_pool& pool, uint32_t seed = 1);
+
+    /**
+     * A short document of random fragments of markup, well-formed or not
+     */
+    extern std::string generate_random_xml(std::mt19937& random);
+
+    /**
+     * Flips, inserts, deletes or duplicates a few bytes, or inserts a fragment of markup
+     */
+    extern std::string mutate_xml(const std::string& text, std::mt19937& random);
+
+}
+
+#endif /* xml_differential_h */
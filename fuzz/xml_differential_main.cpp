@@ -0,0 +1,52 @@
+//
+//  xml_differential_main.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include "xml_differential.h"
+#include "xml_corpus.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/**
+ * Compares every path of parsing with parse_xml() on random documents, and on mutations of the synthetic corpora.
+ *
+ * usage: xml_differential [iterations] [seed]
+ * Prints the first difference and fails; a difference is kept in `xml_differential_failure.xml` to be replayed by fuzz_xml_differential.
+ */
+int main(int argc, const char * argv[]) {
+    const size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+    const uint32_t seed = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 1;
+
+    std::vector<std::string> seeds;
+    for (auto kind : bbxml::xml_corpus_kinds) {
+        seeds.push_back(bbxml::generate_xml_corpus(kind, 512, seed));
+    }
+
+    bbxml::xml_thread_pool pool{2};
+    std::mt19937 random(seed);
+    for (size_t i = 0; i < iterations; ++i) {
+        std::string text;
+        switch (i % 3) {
+            case 0: text = bbxml::generate_random_xml(random); break;
+            case 1: text = bbxml::mutate_xml(bbxml::generate_random_xml(random), random); break;
+            default: text = bbxml::mutate_xml(seeds[random() % seeds.size()], random); break;
+        }
+        auto difference = bbxml::find_xml_difference(text, pool, static_cast<uint32_t>(i));
+        if (!difference.empty()) {
+            std::fputs(difference.c_str(), stderr);
+            if (auto file = std::fopen("xml_differential_failure.xml", "wb")) {
+                std::fwrite(text.data(), 1, text.size(), file);
+                std::fclose(file);
+            }
+            std::fprintf(stderr, "a difference on the iteration %zu of the seed %u\n", i, seed);
+            return 1;
+        }
+    }
+    std::printf("no difference in %zu documents\n", iterations);
+    return 0;
+}
@@ -0,0 +1,36 @@
+//
+//  xml_fuzz_driver.cpp
+//
+//  Copyright © 2016 OTAKE Takayoshi. All rights reserved.
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+/**
+ * Runs a fuzz target without libFuzzer, on the files of the arguments or on the standard input;
+ * to reproduce a finding, to run a corpus as a test, or to fuzz with AFL, e.g. `afl-fuzz -i seeds -o findings -- ./fuzz_parse_xml @@`
+ */
+int main(int argc, const char * argv[]) {
+    if (argc < 2) {
+        std::string input{std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>()};
+        return LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::ifstream file{argv[i], std::ios::binary};
+        if (!file) {
+            std::fprintf(stderr, "Can not read %s\n", argv[i]);
+            return 2;
+        }
+        std::string input{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+    }
+    return 0;
+}